@@ -0,0 +1,127 @@
+#!/bin/sh
+# 生成类似安卓存储布局的合成测试树，以及与之配套的黑白名单规则
+#
+# 用法: bench/gen_tree.sh <输出目录> [种子] [规模]
+#   种子默认 1，规模默认 1（约 2 万个条目，随规模线性增长）。
+#   相同种子和规模在任何机器上生成完全相同的目录树（随机数由 awk 内的
+#   Park-Miller 生成器产生，不依赖各 awk 实现自带的 rand()）。
+#
+# 输出:
+#   <输出目录>/tree                  测试树
+#   <输出目录>/rules/blacklist1.txt  -1 规则
+#   <输出目录>/rules/blacklist2.txt  -2 规则（配合 -D 30）
+#   <输出目录>/rules/whitelist.txt   白名单
+#   规则中的树根写作 @ROOT@，使用前替换为测试树的实际路径。
+#
+# 树的组成:
+#   Android/data/<包名>/cache    深层缓存目录（-1 整体删除）
+#   Android/data/<包名>/files    logs/*.log、tmp、keep（白名单）等混合内容
+#   Android/media/<包名>         混合 .tmp/.log/.jpg 文件（方括号规则）
+#   DCIM/Camera、DCIM/.thumbnails、Download   宽而平的大目录
+#   tencent/MicroMsg/<账号>      image2/xx/yy 两级哈希目录等深层结构
+#   部分缓存目录内有指向树内其他位置的文件/目录符号链接，清理时不得跟随
+# 文件 mtime 取 0/2/7/20/45/90/400 天前之一，均远离 30 天的过期阈值，
+# 避免生成与运行之间的时间差影响结果。
+
+set -e
+
+OUT=${1:?用法: $0 <输出目录> [种子] [规模]}
+SEED=${2:-1}
+SCALE=${3:-1}
+NOW=$(date +%s)
+AGES="0 2 7 20 45 90 400"
+
+rm -rf "$OUT/tree" "$OUT/rules"
+mkdir -p "$OUT/tree" "$OUT/rules"
+MANIFEST=$OUT/manifest.txt
+
+# 清单格式: "d 目录" / "f 天数 文件" / "l 链接目标 链接路径"
+awk -v SEED="$SEED" -v SCALE="$SCALE" -v AGES="$AGES" -v RULES="$OUT/rules" '
+function rnd(n) {
+    state = (state * 16807) % 2147483647
+    return state % n
+}
+function files(dir, n, prefix, ext,    i) {
+    print "d " dir
+    for (i = 0; i < n; i++)
+        print "f " age[1 + rnd(nage)] " " dir "/" prefix i ext
+}
+BEGIN {
+    state = SEED % 2147483646 + 1
+    nage = split(AGES, age, " ")
+
+    npkg = 40 * SCALE
+    for (p = 0; p < npkg; p++) {
+        pkg = sprintf("com.vendor%03d.app%d", rnd(1000), p)
+        if (p == 0)
+            keep_pkg = pkg
+        base = "Android/data/" pkg
+
+        dir = base "/cache"
+        depth = 2 + rnd(5)
+        for (d = 0; d < depth; d++) {
+            dir = dir "/c" d
+            files(dir, 3 + rnd(20), "blob", ".bin")
+        }
+        files(base "/cache/img", 50 + rnd(200), "img", ".webp")
+        files(base "/files", 5 + rnd(10), "data", ".dat")
+        files(base "/files/keep", 3, "keep", ".dat")
+        files(base "/files/logs", 5 + rnd(30), "log", ".log")
+        files(base "/files/tmp", 1 + rnd(10), "t", ".tmp")
+        if (rnd(4) == 0) {
+            print "l ../../../../DCIM/Camera " base "/cache/camera"
+            print "l ../data0.dat " base "/files/logs/data.log"
+        }
+
+        if (rnd(3) == 0) {
+            dir = "Android/media/" pkg
+            files(dir, 5 + rnd(20), "m", ".tmp")
+            files(dir, 5 + rnd(20), "m", ".log")
+            files(dir "/Pictures", 10 + rnd(30), "p", ".jpg")
+            files(dir "/Pictures/.trash", 5 + rnd(10), "p", ".tmp")
+        }
+    }
+
+    files("DCIM/Camera", 3000 * SCALE, "IMG_", ".jpg")
+    files("DCIM/.thumbnails", 2000 * SCALE, "thumb", ".jpg")
+    files("Download", 1500 * SCALE, "dl", ".bin")
+    files("Download/important", 20, "doc", ".pdf")
+
+    naccount = 2 * SCALE
+    for (a = 0; a < naccount; a++) {
+        acc = sprintf("tencent/MicroMsg/%08x%08x", rnd(2147483647), rnd(2147483647))
+        for (i = 0; i < 16; i++)
+            for (j = 0; j < 16; j++)
+                files(sprintf("%s/image2/%02x/%02x", acc, i * 16, j * 16), 1 + rnd(6), "i", "")
+        files(acc "/video", 30 + rnd(30), "v", ".mp4")
+        for (i = 0; i < 8; i++)
+            files(sprintf("%s/voice2/%02x", acc, i * 32), 5 + rnd(20), "msg_", ".amr")
+    }
+
+    print "@ROOT@/Android/data/*/cache" > RULES "/blacklist1.txt"
+    print "@ROOT@/Android/data/*/files/logs/*.log" > RULES "/blacklist1.txt"
+    print "@ROOT@/Android/data/*/files/tmp" > RULES "/blacklist1.txt"
+    print "@ROOT@/Android/media/[*.tmp|*.log]" > RULES "/blacklist1.txt"
+    print "@ROOT@/tencent/MicroMsg/*/voice2" > RULES "/blacklist1.txt"
+
+    print "@ROOT@/DCIM/.thumbnails/*" > RULES "/blacklist2.txt"
+    print "@ROOT@/Download/*" > RULES "/blacklist2.txt"
+    print "@ROOT@/tencent/MicroMsg/*/image2/**" > RULES "/blacklist2.txt"
+
+    print "@ROOT@/Android/data/" keep_pkg > RULES "/whitelist.txt"
+    print "@ROOT@/Android/data/*/files/keep" > RULES "/whitelist.txt"
+    print "@ROOT@/Download/important" > RULES "/whitelist.txt"
+}' > "$MANIFEST"
+
+cd "$OUT/tree"
+awk '$1 == "d" { print $2 }' "$MANIFEST" | xargs mkdir -p
+for a in $AGES; do
+    awk -v a="$a" '$1 == "f" && $2 == a { print $3 }' "$MANIFEST" |
+        xargs -r touch -d "@$((NOW - a * 86400))"
+done
+awk '$1 == "l" { print $2, $3 }' "$MANIFEST" | while read -r target link; do
+    ln -s "$target" "$link"
+done
+rm -f "$MANIFEST"
+
+echo "已生成 $(find . | wc -l) 个条目: $OUT/tree (种子 $SEED, 规模 $SCALE)"
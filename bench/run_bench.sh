@@ -0,0 +1,182 @@
+#!/bin/sh
+# 清理吞吐基准：在 tmpfs 和 ext4 回环镜像上对合成安卓目录树运行清理程序，
+# 报告扫描条目/秒、删除/秒、每条目系统调用数、峰值 RSS，并校验幸存路径集合
+#
+# 用法: bench/run_bench.sh <clean 可执行文件> [参考可执行文件]
+#   环境变量:
+#     SEED=1          生成器种子
+#     SCALE=5         树规模（每 1 约 2 万个条目）
+#     RUNS=3          每种组合的计时次数，取最快一次
+#     BENCH_DIR=/tmp/clean-bench-suite   工作目录
+#     BENCH_FS="tmpfs ext4"              要测试的文件系统
+#     CLEAN_ARGS="-t 4"                  传给清理程序的附加参数
+#     REF_ARGS                           传给参考程序的附加参数（默认同 CLEAN_ARGS）
+#
+# 正确性: 给出参考程序时，以参考程序在同一文件系统上的幸存路径为准；否则与
+# $BENCH_DIR/oracle-<种子>-<规模>.txt 比较，该文件不存在时由本次 tmpfs 运行生成
+# （删除它即可重新建立基线）。
+# 系统调用数由 bench/syscount.c 通过 ptrace 单独跑一次统计，不计入耗时，按测试树
+# 条目数折算；扫描条目数取自 stats.jsonl，不输出统计的旧版本显示为 "-"。
+# 挂载 tmpfs 和 ext4 镜像需要 root；非 root 时 tmpfs 使用 /dev/shm，跳过 ext4。
+
+set -e
+
+BIN=${1:?用法: $0 <clean 可执行文件> [参考可执行文件]}
+REF=${2:-}
+SEED=${SEED:-1}
+SCALE=${SCALE:-5}
+RUNS=${RUNS:-3}
+DIR=${BENCH_DIR:-/tmp/clean-bench-suite}
+FS_LIST=${BENCH_FS:-tmpfs ext4}
+REF_ARGS=${REF_ARGS-$CLEAN_ARGS}
+HERE=$(cd "$(dirname "$0")" && pwd)
+
+abs() {
+    case $1 in
+        /*) echo "$1" ;;
+        *) echo "$(pwd)/$1" ;;
+    esac
+}
+BIN=$(abs "$BIN")
+[ -n "$REF" ] && REF=$(abs "$REF")
+
+mkdir -p "$DIR/mnt" "$DIR/run"
+${CC:-cc} -O2 -o "$DIR/syscount" "$HERE/syscount.c"
+"$HERE/gen_tree.sh" "$DIR/src" "$SEED" "$SCALE"
+ENTRIES=$(find "$DIR/src/tree" | wc -l)
+
+MOUNTS=""
+cleanup() {
+    for m in $MOUNTS; do
+        umount "$m" 2>/dev/null || true
+    done
+}
+trap cleanup EXIT
+
+# 准备文件系统，把挂载点写入 root；不可用时 root 为空
+prepare_fs() {
+    root=""
+    mnt=$DIR/mnt/$1
+    case $1 in
+        tmpfs)
+            if [ "$(id -u)" = 0 ]; then
+                mkdir -p "$mnt"
+                mount -t tmpfs -o size=2g tmpfs "$mnt" && MOUNTS="$MOUNTS $mnt" && root=$mnt
+            elif [ -d /dev/shm ] && [ -w /dev/shm ]; then
+                mkdir -p "/dev/shm/clean-bench-$$" && root=/dev/shm/clean-bench-$$
+            fi
+            ;;
+        ext4)
+            if [ "$(id -u)" = 0 ] && command -v mkfs.ext4 >/dev/null; then
+                mkdir -p "$mnt"
+                img=$DIR/ext4.img
+                rm -f "$img"
+                truncate -s $(( $(du -sm "$DIR/src/tree" | cut -f1) * 2 + 128 ))M "$img"
+                mkfs.ext4 -q -F -N $((ENTRIES * 2 + 16384)) "$img" &&
+                    mount -o loop "$img" "$mnt" && MOUNTS="$MOUNTS $mnt" && root=$mnt
+            fi
+            ;;
+    esac
+}
+
+# 在 $root 下放一份新的测试树和替换过树根的规则
+fresh_copy() {
+    rm -rf "$root/tree" "$root/rules"
+    cp -a "$DIR/src/tree" "$root/tree"
+    mkdir -p "$root/rules"
+    for f in blacklist1 blacklist2 whitelist; do
+        sed "s|@ROOT@|$root/tree|" "$DIR/src/rules/$f.txt" > "$root/rules/$f.txt"
+    done
+    sync
+}
+
+# 运行一次清理程序: run_clean <程序> <附加参数> <syscount 选项>
+# 每次都从冷状态开始：删除上一次留下的扫描状态缓存与规则包，否则之后的运行会跳过目录、
+# 直接映射规则，耗时不可比；支持 -i 的版本改用普通 I/O 调度类，默认的 idle 类会让计时随存储负载波动
+run_clean() {
+    rm -f "$DIR/run/run.log" "$DIR/run/stats.jsonl" "$DIR/run/scan.cache" "$DIR/run/rules.bundle"
+    io_args=""
+    "$1" -h 2>&1 | grep -q -- --ioclass && io_args="-i be"
+    (cd "$DIR/run" && "$DIR/syscount" $3 -o "$DIR/result.txt" -- "$1" \
+        -1 "$root/rules/blacklist1.txt" -2 "$root/rules/blacklist2.txt" \
+        -w "$root/rules/whitelist.txt" -D 30 -d 1 $io_args $2 > /dev/null)
+    eval "$(cat "$DIR/result.txt")"
+}
+
+# 测试一个程序，设置 best_ms/rss/scanned/deleted/syscalls，幸存路径写入 $1
+bench_bin() {
+    out=$1
+    bin=$2
+    args=$3
+    best_ms=""
+    rss=0
+    scanned=""
+    i=0
+    while [ $i -lt "$RUNS" ]; do
+        fresh_copy
+        run_clean "$bin" "$args" ""
+        if [ -z "$best_ms" ] || [ "$wall_ms" -lt "$best_ms" ]; then
+            best_ms=$wall_ms
+        fi
+        [ "$maxrss_kb" -gt "$rss" ] && rss=$maxrss_kb
+        if [ $i = 0 ]; then
+            (cd "$root/tree" && find . | sort) > "$out"
+            deleted=$((ENTRIES - $(wc -l < "$out")))
+            if [ -f "$DIR/run/stats.jsonl" ]; then
+                scanned=$(sed -n 's/.*"scanned":\([0-9]*\).*/\1/p' "$DIR/run/stats.jsonl" |
+                    awk '{ s += $1 } END { print s + 0 }')
+            fi
+        fi
+        i=$((i + 1))
+    done
+    fresh_copy
+    run_clean "$bin" "$args" -t
+}
+
+report() {
+    awk -v fs="$1" -v b="$2" -v ms="$best_ms" -v sc="$scanned" -v del="$deleted" \
+        -v sys="$syscalls" -v n="$ENTRIES" -v rss="$rss" -v ok="$3" 'BEGIN {
+        t = ms > 0 ? ms : 1
+        scan_rate = sc == "" ? "-" : sprintf("%.0f", sc * 1000 / t)
+        printf "%-6s %-5s %12s %10.0f %12.2f %10d %8d  %s\n",
+            fs, b, scan_rate, del * 1000 / t, sys / n, rss, ms, ok
+    }'
+}
+
+ORACLE=$DIR/oracle-$SEED-$SCALE.txt
+echo "测试树: $ENTRIES 个条目 (种子 $SEED, 规模 $SCALE)，每项取 $RUNS 次中最快一次"
+printf "%-6s %-5s %12s %10s %12s %10s %8s  %s\n" 文件系统 程序 扫描条目/秒 删除/秒 系统调用/条目 峰值RSS/KB 耗时/ms 正确性
+failed=0
+for fs in $FS_LIST; do
+    prepare_fs "$fs" || true
+    if [ -z "$root" ]; then
+        echo "$fs: 不可用（需要 root 或相应工具），跳过"
+        continue
+    fi
+
+    if [ -n "$REF" ]; then
+        bench_bin "$DIR/surv-$fs-ref.txt" "$REF" "$REF_ARGS"
+        report "$fs" ref "参考"
+        expect=$DIR/surv-$fs-ref.txt
+    else
+        expect=$ORACLE
+    fi
+
+    bench_bin "$DIR/surv-$fs-new.txt" "$BIN" "$CLEAN_ARGS"
+    if [ ! -f "$expect" ]; then
+        cp "$DIR/surv-$fs-new.txt" "$expect"
+        ok="建立基线"
+    elif cmp -s "$expect" "$DIR/surv-$fs-new.txt"; then
+        ok="一致"
+    else
+        ok="不一致: $(diff "$expect" "$DIR/surv-$fs-new.txt" | grep -c '^[<>]') 条路径不同"
+        failed=1
+    fi
+    report "$fs" new "$ok"
+
+    rm -rf "$root/tree" "$root/rules"
+    case $root in
+        /dev/shm/*) rmdir "$root" ;;
+    esac
+done
+exit $failed
@@ -0,0 +1,135 @@
+// 基准测试用的计数外壳：运行一条命令，报告墙钟时间、峰值 RSS 以及（可选）系统调用次数
+//
+// 用法: syscount [-t] -o <输出文件> -- <命令> [参数...]
+//   -t  用 ptrace 跟踪命令及其所有线程，统计系统调用次数（跟踪本身会显著拖慢
+//       运行，计时应使用不带 -t 的单独一次运行）
+//   输出文件写入一行可供 shell eval 的结果: wall_ms=.. maxrss_kb=.. syscalls=..
+//   未跟踪时 syscalls 为 0。退出码与被运行命令一致。
+//
+// 环境里没有 perf/strace 时也能得到每条目的系统调用数，编译: cc -O2 -o syscount syscount.c
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <errno.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/ptrace.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+static long long monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (long long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 跟踪子进程直至其所有线程退出，返回系统调用停止次数（进入和返回各停一次）
+static long long trace_children(pid_t child, int *exit_status) {
+    long long stops = 0;
+    int status;
+
+    if (waitpid(child, &status, 0) < 0 || !WIFSTOPPED(status)) {
+        return -1;
+    }
+    ptrace(PTRACE_SETOPTIONS, child, 0,
+           PTRACE_O_TRACESYSGOOD | PTRACE_O_TRACECLONE | PTRACE_O_TRACEFORK |
+           PTRACE_O_TRACEVFORK | PTRACE_O_EXITKILL);
+    ptrace(PTRACE_SYSCALL, child, 0, 0);
+
+    for (;;) {
+        pid_t pid = waitpid(-1, &status, __WALL);
+        if (pid < 0) {
+            if (errno == EINTR) continue;
+            break; // ECHILD：全部退出
+        }
+        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+            if (pid == child) {
+                *exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+            }
+            continue;
+        }
+        if (!WIFSTOPPED(status)) continue;
+
+        int sig = WSTOPSIG(status);
+        int deliver = 0;
+        if (sig == (SIGTRAP | 0x80)) {
+            stops++;
+        } else if (sig == SIGTRAP || sig == SIGSTOP) {
+            // ptrace 事件停止，或新线程被附加时的初始 SIGSTOP，均不转发
+        } else {
+            deliver = sig;
+        }
+        ptrace(PTRACE_SYSCALL, pid, 0, deliver);
+    }
+    return stops;
+}
+
+int main(int argc, char *argv[]) {
+    const char *out_path = NULL;
+    int trace = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "to:")) != -1) {
+        switch (opt) {
+            case 't':
+                trace = 1;
+                break;
+            case 'o':
+                out_path = optarg;
+                break;
+            default:
+                fprintf(stderr, "用法: %s [-t] -o <输出文件> -- <命令> [参数...]\n", argv[0]);
+                return 2;
+        }
+    }
+    if (!out_path || optind >= argc) {
+        fprintf(stderr, "用法: %s [-t] -o <输出文件> -- <命令> [参数...]\n", argv[0]);
+        return 2;
+    }
+
+    long long start = monotonic_ms();
+    pid_t child = fork();
+    if (child < 0) {
+        perror("fork");
+        return 2;
+    }
+    if (child == 0) {
+        if (trace) {
+            ptrace(PTRACE_TRACEME, 0, 0, 0);
+            raise(SIGSTOP);
+        }
+        execvp(argv[optind], &argv[optind]);
+        perror(argv[optind]);
+        _exit(127);
+    }
+
+    int exit_status = 0;
+    long long syscalls = 0;
+    if (trace) {
+        long long stops = trace_children(child, &exit_status);
+        if (stops < 0) {
+            fprintf(stderr, "ptrace 跟踪失败\n");
+            return 2;
+        }
+        syscalls = (stops + 1) / 2; // exit_group 只有进入停止
+    } else {
+        int status;
+        while (waitpid(child, &status, 0) < 0 && errno == EINTR) {}
+        exit_status = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    }
+    long long wall = monotonic_ms() - start;
+
+    struct rusage ru;
+    getrusage(RUSAGE_CHILDREN, &ru);
+
+    FILE *out = fopen(out_path, "w");
+    if (!out) {
+        perror(out_path);
+        return 2;
+    }
+    fprintf(out, "wall_ms=%lld maxrss_kb=%ld syscalls=%lld\n", wall, ru.ru_maxrss, syscalls);
+    fclose(out);
+    return exit_status;
+}
@@ -1,8 +1,7 @@
+#define _GNU_SOURCE
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <time.h>
 #include <unistd.h>
 #include <getopt.h>
@@ -10,531 +9,305 @@
 #include <limits.h>
 #include <pwd.h>
 #include <grp.h>
-#include <regex.h>
-#include <fnmatch.h>
-#include <stdarg.h>
-
-int debug_level = 1;
-int total_files_deleted = 0;
-int total_dirs_deleted = 0;
-FILE *log_file;
+#include <fcntl.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/timerfd.h>
+#include <sys/un.h>
+
+#include "libclean.h"
+
+// 命令行入口：解析参数、切换用户后按间隔循环调用清理引擎（见 libclean.h）
+
+static int debug_level = 1;
 char program_name[PATH_MAX];
 uid_t target_uid = -1;
 gid_t target_gid = -1;
 
-#define MAX_LOG_SIZE (256 * 1024)
-
-// 用于描述特殊规则的结构体，同时保存路径和转换后的正则表达式
+#define CTL_LINE_MAX 4096
+
+// 安卓 FUSE 视图到下层 /data/media 的默认映射（/sdcard 经 /storage/self/primary 指向 /storage/emulated/<用户>）
+#define DEFAULT_PATH_MAP "/sdcard=/data/media/0,/storage/self/primary=/data/media/0,/storage/emulated=/data/media"
+
+/*
+   常驻模式（-s 大于 0 或 -W）：SIGHUP 重新编译规则，编译成功后才替换；
+   控制套接字（Unix 域流套接字）每个连接接收一行命令，回复一行 JSON 后关闭:
+     run            立即执行一轮完整扫描
+     run <规则>     只执行 -1/-2 规则文件中与之完全相同的一条规则
+     pause/resume   暂停/恢复定时扫描与监听（暂停期间仍可 run）
+     reload         重新编译规则文件
+     status         运行状态、距下次完整扫描的秒数与规则条数
+     metrics        启动以来的累计删除计数与最近一轮的统计
+   命令在两轮清理之间处理；自管道、监听套接字与到期定时器合并在一个 epoll 描述符中，
+   作为 wake_fd 交给引擎，监听模式等待文件事件时也能及时响应。
+   到期定时器按墙上时钟设在最早的过期时间（clean_next_deadline），设备休眠期间同样计时，
+   到期后只重新处理到期的目标
+*/
 typedef struct {
-    char path[PATH_MAX];
-    regex_t regex;
-    int regex_valid;
-} SpecialRule;
-
-// 获取指定文件的大小，如果失败则返回 -1
-long long get_file_size(const char *filename) {
-    struct stat statbuf;
-    return (stat(filename, &statbuf) == 0) ? statbuf.st_size : -1;
+    CleanContext *ctx;
+    const char *blacklist1;
+    const char *blacklist2;
+    const char *whitelist;
+    int seconds;                // 完整扫描间隔
+    int watch;
+    int listen_fd;
+    int timer_fd;               // 到期定时器，-1 表示不可用（只按 -s 间隔完整扫描）
+    int paused;
+    int64_t next_full;          // 下一轮完整扫描的单调时钟毫秒数
+    time_t started;
+    long long cycles;
+    long long files;
+    long long dirs;
+    long long bytes;
+    long long scanned;
+    CleanStats last;
+} Daemon;
+
+static volatile sig_atomic_t reload_requested = 0;
+static int wake_pipe[2] = { -1, -1 };
+
+static int64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
 }
 
-// 日志文件尺寸超过上限时进行滚动处理：重命名为 run.log.old 后重新创建 run.log
-void rotate_log_file() {
-    fclose(log_file);
-    if (rename("run.log", "run.log.old") == 0) {
-        if (debug_level >= 1)
-            fprintf(stderr, "日志文件已重命名为 run.log.old\n");
-    } else {
-        fprintf(stderr, "日志文件重命名失败: %s\n", strerror(errno));
-    }
-    log_file = fopen("run.log", "a");
-    if (!log_file) {
-        perror("无法打开新的日志文件");
-        exit(EXIT_FAILURE);
+// SIGHUP：只置标志并写自管道，由主循环重新加载
+static void hup_handler(int sig) {
+    (void)sig;
+    int saved = errno;
+    reload_requested = 1;
+    if (write(wake_pipe[1], "", 1) < 0) {
+        // 管道已满时已有未处理的唤醒
     }
-    if (debug_level >= 1)
-        fprintf(log_file, "已打开新的日志文件，程序继续运行。\n");
+    errno = saved;
 }
 
-// 检查当前日志文件大小，如超过限额则执行日志滚动
-void check_and_rotate_log() {
-    if (get_file_size("run.log") > MAX_LOG_SIZE)
-        rotate_log_file();
-}
-
-// 根据调试级别记录日志信息，支持 printf 格式化输出
-void log_message(int level, const char *format, ...) {
-    if (debug_level < level)
-        return;
-    check_and_rotate_log();
-    va_list args;
-    va_start(args, format);
-    vfprintf(log_file, format, args);
-    va_end(args);
-    fflush(log_file);
-}
-
-// 删除文件或目录项，并记录相关操作日志
-static void delete_item(const char *path, int is_dir) {
-    if (!path)
-        return;
-    int (*remove_func)(const char *) = is_dir ? rmdir : remove;
-    if (remove_func(path) == 0) {
-        if (is_dir) {
-            total_dirs_deleted++;
-            log_message(2, "已删除目录: %s\n", path);
-        } else {
-            total_files_deleted++;
-            struct stat statbuf;
-            int is_link = (lstat(path, &statbuf) == 0 && S_ISLNK(statbuf.st_mode));
-            log_message(2, "已删除%s: %s\n", is_link ? "符号链接" : "文件", path);
-        }
-    } else {
-        log_message(1, "删除%s失败: %s, 错误: %s\n", 
-            is_dir ? "目录" : "文件/链接", path, strerror(errno));
-    }
+// 每轮统计累加到常驻进程的计数中，供 metrics 命令查询
+static void on_cycle(void *user, const CleanStats *st) {
+    Daemon *d = user;
+    d->cycles++;
+    d->files += st->files;
+    d->dirs += st->dirs;
+    d->bytes += st->bytes;
+    d->scanned += st->scanned;
+    d->last = *st;
 }
 
-// 将通配符模式转换为正则表达式（支持 '*', '?', 等符号）
-char *wildcard_to_regex(const char *wildcard) {
-    if (!wildcard)
-        return NULL;
-    size_t len = strlen(wildcard);
-    char *regex_str = malloc(len * 3 + 3); // 分配足够空间以容纳转换后的表达式
-    if (!regex_str)
-        return NULL;
-    char *p = regex_str;
-    *p++ = '^'; // 从头开始匹配
-    for (size_t i = 0; i < len; i++) {
-        switch (wildcard[i]) {
-            case '*': *p++ = '.'; *p++ = '*'; break;
-            case '?': *p++ = '.'; break;
-            case '.': *p++ = '\\'; *p++ = '.'; break;
-            case '[': *p++ = '['; break;
-            case ']': *p++ = ']'; break;
-            case '|': *p++ = '|'; break;
-            case '{': *p++ = '('; break;
-            case '}': *p++ = ')'; break;
-            case ',': *p++ = '|'; break;
-            case '\\': *p++ = '\\'; *p++ = '\\'; break;
-            default: *p++ = wildcard[i];
-        }
-    }
-    *p++ = '$'; // 结束匹配
-    *p = '\0';
-    return regex_str;
+static int control_addr(const char *path, struct sockaddr_un *addr) {
+    memset(addr, 0, sizeof(*addr));
+    addr->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr->sun_path))
+        return -1;
+    strcpy(addr->sun_path, path);
+    return 0;
 }
 
-// 解析特殊规则字符串，提取路径和规则模式，转换为正则表达式
-static int parse_special_rule(const char *rule_str, SpecialRule *rule) {
-    if (!rule_str || !rule)
-        return 0;
-    memset(rule, 0, sizeof(SpecialRule));
-    const char *p = rule_str;
-    const char *path_end = rule_str;
-    // 查找 '[' 作为规则模式的开始位置
-    while (*p) {
-        if (*p == '\\') {
-            p++;
-            if (*p) p++;
-        } else if (*p == '[') {
-            path_end = p;
-            break;
-        } else {
-            p++;
-        }
-    }
-    if (*p != '[')
-        return 0;
-    size_t path_len = path_end - rule_str;
-    if (path_len >= PATH_MAX)
-        return 0;
-    strncpy(rule->path, rule_str, path_len);
-    rule->path[path_len] = '\0';
-    p++;  // 跳过 '['
-    const char *regex_start = p;
-    const char *regex_end = NULL;
-    // 查找对应的 ']' 结束标记
-    while (*p) {
-        if (*p == '\\') { 
-            p++; 
-            if (*p) p++; 
-        }
-        else if (*p == ']') { 
-            regex_end = p; 
-            break; 
-        }
-        else { 
-            p++; 
-        }
+// 创建控制套接字（仅属主可访问）；已有实例在监听时不抢占，返回 -1
+static int control_open(const char *path) {
+    struct sockaddr_un addr;
+    if (control_addr(path, &addr) < 0) {
+        log_message(1, "控制套接字路径过长: %s\n", path);
+        return -1;
     }
-    if (!regex_end)
-        return 0;
-    size_t regex_len = regex_end - regex_start;
-    char *regex_pattern = malloc(regex_len + 1);
-    if (!regex_pattern) {
-        log_message(1, "内存分配失败: regex_pattern\n");
-        return 0;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0)
+        return -1;
+    if (connect(fd, (struct sockaddr *)&addr, sizeof(addr)) == 0) {
+        log_message(1, "控制套接字已被其他进程使用: %s，不启用控制接口\n", path);
+        close(fd);
+        return -1;
     }
-    strncpy(regex_pattern, regex_start, regex_len);
-    regex_pattern[regex_len] = '\0';
-    char *final_regex = wildcard_to_regex(regex_pattern);
-    free(regex_pattern);
-    if (!final_regex) {
-        log_message(1, "通配符转换为正则表达式失败\n");
-        return 0;
+    close(fd);
+    // 没有进程监听的是上次异常退出留下的套接字文件
+    unlink(path);
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC | SOCK_NONBLOCK, 0);
+    if (fd < 0)
+        return -1;
+    mode_t old_mask = umask(077);
+    int ret = bind(fd, (struct sockaddr *)&addr, sizeof(addr));
+    umask(old_mask);
+    if (ret < 0 || listen(fd, 8) < 0) {
+        log_message(1, "无法创建控制套接字: %s, 错误: %s\n", path, strerror(errno));
+        close(fd);
+        return -1;
     }
-    if (regcomp(&rule->regex, final_regex, REG_EXTENDED | REG_NOSUB) != 0) {
-        log_message(1, "正则表达式编译失败: %s\n", final_regex);
-        free(final_regex);
-        return 0;
-    }
-    free(final_regex);
-    rule->regex_valid = 1;
-    return 1;
+    log_message(2, "控制套接字: %s\n", path);
+    return fd;
 }
 
-// 释放特殊规则中分配的正则表达式资源
-void free_special_rule(SpecialRule *rule) {
-    if (rule && rule->regex_valid) {
-        regfree(&rule->regex);
-        rule->regex_valid = 0;
+// 客户端模式：发送一条命令并输出回复
+static int control_client(const char *path, const char *cmd) {
+    struct sockaddr_un addr;
+    if (control_addr(path, &addr) < 0) {
+        fprintf(stderr, "%s: 错误: 控制套接字路径过长 '%s'\n", program_name, path);
+        return EXIT_FAILURE;
     }
-}
-
-// 判断文件名是否满足正则表达式匹配
-static int filename_matches_regex(const char *filename, regex_t *regex) {
-    return (filename && regex && regexec(regex, filename, 0, NULL, 0) == 0);
-}
-
-/* 
-   改进后的白名单判断函数：
-   确保路径或者其子路径如果在白名单中，则受保护，不进行删除处理 
-*/
-int is_in_whitelist(const char *path, char **whitelist, int whitelist_count) {
-    if (!path || !whitelist || whitelist_count <= 0)
-        return 0;
-    // 直接比较白名单中是否存在完整匹配
-    for (int i = 0; i < whitelist_count; i++) {
-        if (whitelist[i] && fnmatch(whitelist[i], path, FNM_PATHNAME) == 0)
-            return 1;
+    int fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0 || connect(fd, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        fprintf(stderr, "%s: 无法连接控制套接字 '%s': %s\n", program_name, path, strerror(errno));
+        if (fd >= 0)
+            close(fd);
+        return EXIT_FAILURE;
     }
-    // 检查当前路径是否为白名单指定目录的子目录
-    size_t path_len = strlen(path);
-    char path_with_slash[PATH_MAX];
-    snprintf(path_with_slash, sizeof(path_with_slash), "%s/", path);
-    for (int i = 0; i < whitelist_count; i++) {
-        if (whitelist[i] && strncmp(whitelist[i], path_with_slash, strlen(path_with_slash)) == 0)
-            return 1;
+    char buf[CTL_LINE_MAX];
+    int len = snprintf(buf, sizeof(buf), "%s\n", cmd);
+    if (len >= (int)sizeof(buf) || send(fd, buf, (size_t)len, MSG_NOSIGNAL) != len) {
+        fprintf(stderr, "%s: 发送命令失败\n", program_name);
+        close(fd);
+        return EXIT_FAILURE;
     }
-    return 0;
+    ssize_t n;
+    int replied = 0;
+    while ((n = read(fd, buf, sizeof(buf))) > 0) {
+        fwrite(buf, 1, (size_t)n, stdout);
+        replied = 1;
+    }
+    close(fd);
+    return replied ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
-/* 
-   将配置文件内容按行读取，忽略空行和以 '#' 开头的注释行，
-   每行代表一条规则并存入数组中 
-*/
-int read_file_to_array(const char *filename, char ***array) {
-    if (!filename || !array)
-        return 0;
-    FILE *file = fopen(filename, "r");
-    if (!file) {
-        log_message(1, "无法打开文件: %s, 错误: %s\n", filename, strerror(errno));
-        return 0;
-    }
-    char *line = NULL;
-    size_t line_len = 0;
-    ssize_t read;
-    int count = 0, capacity = 10;
-    char **temp_array = malloc(sizeof(char*) * capacity);
-    if (!temp_array) {
-        log_message(1, "内存分配失败: temp_array\n");
-        fclose(file);
-        return 0;
-    }
-    while ((read = getline(&line, &line_len, file)) != -1) {
-        if (read > 0 && line[read - 1] == '\n')
-            line[read - 1] = '\0';
-        if (line[0] == '#' || line[0] == '\0')
-            continue;
-        if (count >= capacity) {
-            capacity *= 2;
-            char **new_array = realloc(temp_array, sizeof(char*) * capacity);
-            if (!new_array) {
-                log_message(1, "内存重分配失败: new_array\n");
-                for (int j = 0; j < count; j++)
-                    free(temp_array[j]);
-                free(temp_array); 
-                free(line); 
-                fclose(file);
-                return 0;
-            }
-            temp_array = new_array;
-        }
-        temp_array[count] = strdup(line);
-        if (!temp_array[count]) {
-            log_message(1, "内存分配失败: temp_array[%d]\n", count);
-            for (int j = 0; j < count; j++)
-                free(temp_array[j]);
-            free(temp_array);
-            free(line);
-            fclose(file);
-            return 0;
-        }
-        count++;
-    }
-    free(line);
-    fclose(file);
-    *array = temp_array;
-    log_message(2, "成功从 %s 中读取 %d 条规则\n", filename, count);
-    return count;
+// 把一轮统计格式化为回复
+static void reply_stats(char *out, size_t size, const CleanStats *st) {
+    snprintf(out, size, "{\"ok\":true,\"mode\":\"%s\",\"files\":%d,\"dirs\":%d,\"bytes\":%lld,"
+        "\"scanned\":%lld,\"duration_ms\":%lld}\n",
+        st->mode, st->files, st->dirs, st->bytes, st->scanned, (long long)st->duration_ms);
 }
 
-// 检查某文件或目录自上次修改后的时间间隔是否超过指定天数
-int is_expired(const char *path, int days) {
-    if (!path || days < 0)
-        return 0;
-    struct stat statbuf;
-    if (lstat(path, &statbuf) == 0) {
-        time_t current_time = time(NULL);
-        if (current_time == (time_t)-1) {
-            log_message(1, "警告：获取当前时间失败\n");
-            return 0;
+// 执行一条控制命令，回复写入 out
+static void control_command(Daemon *d, const char *cmd, char *out, size_t size) {
+    CleanContext *ctx = d->ctx;
+    CleanStats st;
+    if (strcmp(cmd, "run") == 0) {
+        if (clean_rules_changed(ctx))
+            clean_compile_rules(ctx, d->blacklist1, d->blacklist2, d->whitelist);
+        if (clean_run_cycle(ctx, &st) < 0) {
+            snprintf(out, size, "{\"ok\":false,\"error\":\"no rules\"}\n");
+            return;
         }
-        double diff_time = difftime(current_time, statbuf.st_mtime);
-        return (diff_time > (double)days * 24 * 3600);
+        d->next_full = now_ms() + (int64_t)d->seconds * 1000;
+        reply_stats(out, size, &st);
+    } else if (strncmp(cmd, "run ", 4) == 0) {
+        if (clean_run_rule(ctx, cmd + 4, &st) < 0)
+            snprintf(out, size, "{\"ok\":false,\"error\":\"rule not found\"}\n");
+        else
+            reply_stats(out, size, &st);
+    } else if (strcmp(cmd, "pause") == 0 || strcmp(cmd, "resume") == 0) {
+        d->paused = cmd[0] == 'p';
+        log_message(1, "%s\n", d->paused ? "已暂停定时清理" : "已恢复定时清理");
+        snprintf(out, size, "{\"ok\":true,\"paused\":%d}\n", d->paused);
+    } else if (strcmp(cmd, "reload") == 0) {
+        int ok = clean_compile_rules(ctx, d->blacklist1, d->blacklist2, d->whitelist) == 0;
+        // 监听集合随旧规则释放，需要一轮完整扫描重建
+        if (ok && d->watch)
+            d->next_full = 0;
+        snprintf(out, size, "{\"ok\":%s}\n", ok ? "true" : "false");
+    } else if (strcmp(cmd, "status") == 0) {
+        int b1, b2;
+        clean_rule_counts(ctx, &b1, &b2);
+        int64_t left = d->next_full - now_ms();
+        time_t due = clean_next_deadline(ctx);
+        long long due_left = due ? (long long)(due - time(NULL)) : -1;
+        snprintf(out, size, "{\"ok\":true,\"paused\":%d,\"watch\":%d,\"interval\":%d,\"next_full_s\":%lld,"
+            "\"next_expiry_s\":%lld,\"uptime_s\":%lld,\"rules\":{\"blacklist1\":%d,\"blacklist2\":%d}}\n",
+            d->paused, d->watch, d->seconds, (long long)(left > 0 ? (left + 999) / 1000 : 0),
+            due_left < 0 && due ? 0 : due_left, (long long)(time(NULL) - d->started), b1, b2);
+    } else if (strcmp(cmd, "metrics") == 0) {
+        snprintf(out, size, "{\"ok\":true,\"cycles\":%lld,\"files\":%lld,\"dirs\":%lld,\"bytes\":%lld,"
+            "\"scanned\":%lld,\"last\":{\"mode\":\"%s\",\"ts\":%lld,\"files\":%d,\"dirs\":%d,"
+            "\"bytes\":%lld,\"duration_ms\":%lld}}\n",
+            d->cycles, d->files, d->dirs, d->bytes, d->scanned,
+            d->last.mode ? d->last.mode : "", (long long)d->last.ts, d->last.files, d->last.dirs,
+            d->last.bytes, (long long)d->last.duration_ms);
+    } else {
+        snprintf(out, size, "{\"ok\":false,\"error\":\"unknown command\"}\n");
     }
-    return 0;
 }
 
-/* 
-   函数声明：递归处理指定基路径下的所有条目，
-   同时依据白名单、过期时间等规则进行删除操作 
-*/
-void process_recursive(const char *base_path, char **whitelist, int wl_count, int check_expiry, int days);
-
-// 递归删除目录及其内容：适用于删除符合条件的目录或文件
-void delete_directory_recursive(const char *path, char **whitelist, int wl_count,
-    regex_t *regex, int check_expiry, int days, int skip_root) {
-    if (!path)
-        return;
-    if (!skip_root && is_in_whitelist(path, whitelist, wl_count)) {
-        log_message(2, "目录在白名单中，跳过: %s\n", path);
-        return;
-    }
-    DIR *dir = opendir(path);
-    if (!dir) {
-        log_message(1, "无法打开目录: %s, 错误: %s\n", path, strerror(errno));
+// 处理所有等待中的连接；读取命令最多等待 1 秒，避免异常客户端阻塞清理
+static void control_serve(Daemon *d) {
+    if (d->listen_fd < 0)
         return;
-    }
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (strcmp(entry->d_name, ".") == 0 || strcmp(entry->d_name, "..") == 0)
-            continue;
-        char full_path[PATH_MAX];
-        if (snprintf(full_path, sizeof(full_path), "%s/%s", path, entry->d_name) >= PATH_MAX) {
-            log_message(1, "路径过长: %s/%s\n", path, entry->d_name);
-            continue;
-        }
-        if (is_in_whitelist(full_path, whitelist, wl_count)) {
-            log_message(2, "项目在白名单中，跳过: %s\n", full_path);
-            continue;
-        }
-        struct stat statbuf;
-        if (lstat(full_path, &statbuf) != 0) {
-            log_message(1, "无法获取文件信息: %s, 错误: %s\n", full_path, strerror(errno));
-            continue;
-        }
-        if (S_ISDIR(statbuf.st_mode)) {
-            delete_directory_recursive(full_path, whitelist, wl_count, regex, check_expiry, days, 0);
-        } else {
-            const char *filename = strrchr(full_path, '/');
-            filename = filename ? filename + 1 : full_path;
-            if ((!regex || filename_matches_regex(filename, regex)) &&
-                (!check_expiry || is_expired(full_path, days))) {
-                delete_item(full_path, 0);
-            }
+    int conn;
+    while ((conn = accept4(d->listen_fd, NULL, NULL, SOCK_CLOEXEC)) >= 0) {
+        struct timeval tv = { .tv_sec = 1 };
+        setsockopt(conn, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+        char cmd[CTL_LINE_MAX], out[1024];
+        size_t len = 0;
+        ssize_t n;
+        while (len < sizeof(cmd) - 1 && (n = read(conn, cmd + len, sizeof(cmd) - 1 - len)) > 0) {
+            len += (size_t)n;
+            if (memchr(cmd + len - n, '\n', (size_t)n))
+                break;
         }
-    }
-    closedir(dir);
-    if (!skip_root && !is_in_whitelist(path, whitelist, wl_count)) {
-        dir = opendir(path);
-        if (dir) {
-            int is_empty = 1;
-            while ((entry = readdir(dir)) != NULL) {
-                if (strcmp(entry->d_name, ".") != 0 && strcmp(entry->d_name, "..") != 0) {
-                    is_empty = 0;
-                    break;
-                }
-            }
-            closedir(dir);
-            if (is_empty)
-                delete_item(path, 1);
+        cmd[len] = '\0';
+        cmd[strcspn(cmd, "\r\n")] = '\0';
+        if (cmd[0]) {
+            log_message(2, "控制命令: %s\n", cmd);
+            control_command(d, cmd, out, sizeof(out));
+            if (send(conn, out, strlen(out), MSG_NOSIGNAL) < 0)
+                log_message(2, "回复控制命令失败: %s\n", strerror(errno));
         }
+        close(conn);
     }
 }
 
-// 根据黑名单规则（支持通配符与递归）处理目标文件和目录的删除
-static void process_blacklist(char **blacklist, int count, char **whitelist, int wl_count,
-    int check_expiry, int days) {
-    if (!blacklist || count <= 0)
+// 读空自管道，有待处理的 SIGHUP 时重新加载规则
+static void daemon_reload(Daemon *d) {
+    char buf[64];
+    while (read(wake_pipe[0], buf, sizeof(buf)) > 0)
+        ;
+    if (!reload_requested)
         return;
-    for (int i = 0; i < count; i++) {
-        if (!blacklist[i])
-            continue;
-        char *target_path = strdup(blacklist[i]);
-        if (!target_path) {
-            log_message(1, "内存分配失败\n");
-            continue;
-        }
-        // 去除路径末尾的斜杠
-        size_t len = strlen(target_path);
-        while (len > 0 && target_path[len-1] == '/') {
-            target_path[len-1] = '\0';
-            len--;
-        }
-        // 若目标路径本身在白名单中，则跳过
-        if (is_in_whitelist(target_path, whitelist, wl_count)) {
-            log_message(2, "跳过白名单项: %s\n", target_path);
-            free(target_path);
-            continue;
-        }
-        // 检查是否包含通配符
-        if (strpbrk(target_path, "*?[") != NULL) {
-            char base_path[PATH_MAX] = {0};
-            char pattern_buffer[PATH_MAX] = {0};
-            char *pattern = NULL;
-            int is_recursive = 0;
-            // 检查是否包含 "**" 用于递归匹配
-            char *double_star = strstr(target_path, "**");
-            if (double_star) {
-                is_recursive = 1;
-                size_t base_len = double_star - target_path;
-                while (base_len > 0 && target_path[base_len-1] == '/')
-                    base_len--;
-                if (base_len == 0)
-                    strcpy(base_path, ".");
-                else {
-                    strncpy(base_path, target_path, base_len);
-                    base_path[base_len] = '\0';
-                }
-                char *after_stars = double_star + 2;
-                while (*after_stars == '/')
-                    after_stars++;
-                if (*after_stars) {
-                    strncpy(pattern_buffer, after_stars, sizeof(pattern_buffer)-1);
-                    pattern = pattern_buffer;
-                } else {
-                    pattern = NULL;
-                }
-                // 遍历 base_path 下的所有目录及文件
-                DIR *dir = opendir(base_path);
-                if (dir) {
-                    struct dirent *entry;
-                    while ((entry = readdir(dir)) != NULL) {
-                        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-                            continue;
-                        char full_path[PATH_MAX];
-                        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
-                        struct stat st;
-                        if (lstat(full_path, &st) == 0) {
-                            if (S_ISDIR(st.st_mode)) {
-                                if (!is_in_whitelist(full_path, whitelist, wl_count)) {
-                                    process_recursive(full_path, whitelist, wl_count, check_expiry, days);
-                                    // 若未设置匹配模式或名称符合模式，则删除目录
-                                    if (pattern == NULL || fnmatch(pattern, entry->d_name, FNM_PATHNAME) == 0)
-                                        delete_directory_recursive(full_path, whitelist, wl_count, NULL, check_expiry, days, 0);
-                                }
-                            } else {
-                                if (pattern == NULL || fnmatch(pattern, entry->d_name, FNM_PATHNAME) == 0) {
-                                    if (!is_in_whitelist(full_path, whitelist, wl_count) &&
-                                        (!check_expiry || is_expired(full_path, days)))
-                                        delete_item(full_path, 0);
-                                }
-                            }
-                        }
-                    }
-                    closedir(dir);
-                }
-            } else {
-                // 处理不使用递归匹配的通配符模式
-                char *last_slash = strrchr(target_path, '/');
-                if (last_slash) {
-                    *last_slash = '\0';
-                    pattern = last_slash + 1;
-                    strncpy(base_path, target_path, sizeof(base_path)-1);
-                } else {
-                    strcpy(base_path, ".");
-                    pattern = target_path;
-                }
-                DIR *dir = opendir(base_path);
-                if (dir) {
-                    struct dirent *entry;
-                    while ((entry = readdir(dir)) != NULL) {
-                        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-                            continue;
-                        char full_path[PATH_MAX];
-                        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
-                        if (fnmatch(pattern, entry->d_name, FNM_PATHNAME) == 0) {
-                            if (!is_in_whitelist(full_path, whitelist, wl_count)) {
-                                struct stat st;
-                                if (lstat(full_path, &st) == 0) {
-                                    if (S_ISDIR(st.st_mode))
-                                        delete_directory_recursive(full_path, whitelist, wl_count, NULL, check_expiry, days, 0);
-                                    else if (!check_expiry || is_expired(full_path, days))
-                                        delete_item(full_path, 0);
-                                }
-                            }
-                        }
-                    }
-                    closedir(dir);
-                }
-            }
-        } else {
-            // 处理不包含通配符的目标路径
-            struct stat st;
-            if (lstat(target_path, &st) == 0) {
-                if (S_ISDIR(st.st_mode))
-                    delete_directory_recursive(target_path, whitelist, wl_count, NULL, check_expiry, days, 0);
-                else if (!check_expiry || is_expired(target_path, days))
-                    delete_item(target_path, 0);
-            }
-        }
-        free(target_path);
-    }
+    reload_requested = 0;
+    log_message(1, "收到 SIGHUP，重新加载规则\n");
+    if (clean_compile_rules(d->ctx, d->blacklist1, d->blacklist2, d->whitelist) == 0 && d->watch)
+        d->next_full = 0;
 }
 
-// 递归处理给定基目录下所有文件与目录，根据白名单和过期规则决定是否删除
-void process_recursive(const char *base_path, char **whitelist, int wl_count, int check_expiry, int days) {
-    DIR *dir = opendir(base_path);
-    if (!dir)
+// 把到期定时器设在最早的到期时间；没有待到期目标或已暂停时停止定时器
+static void daemon_arm_timer(Daemon *d) {
+    if (d->timer_fd < 0)
         return;
-    struct dirent *entry;
-    while ((entry = readdir(dir)) != NULL) {
-        if (!strcmp(entry->d_name, ".") || !strcmp(entry->d_name, ".."))
-            continue;
-        char full_path[PATH_MAX];
-        snprintf(full_path, sizeof(full_path), "%s/%s", base_path, entry->d_name);
-        if (!is_in_whitelist(full_path, whitelist, wl_count)) {
-            struct stat st;
-            if (lstat(full_path, &st) == 0) {
-                if (S_ISDIR(st.st_mode)) {
-                    process_recursive(full_path, whitelist, wl_count, check_expiry, days);
-                    delete_directory_recursive(full_path, whitelist, wl_count, NULL, check_expiry, days, 0);
-                } else if (!check_expiry || is_expired(full_path, days))
-                    delete_item(full_path, 0);
-            }
-        }
-    }
-    closedir(dir);
+    uint64_t expirations;
+    while (read(d->timer_fd, &expirations, sizeof(expirations)) > 0)
+        ;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = d->paused ? 0 : clean_next_deadline(d->ctx);
+    timerfd_settime(d->timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
 }
 
-// 释放保存规则的字符串数组
-void free_array(char **array, int count) {
-    if (!array)
-        return;
-    for (int i = 0; i < count; i++)
-        free(array[i]);
-    free(array);
+// 创建自管道、安装 SIGHUP 处理并把自管道、控制套接字与到期定时器合并到一个 epoll 描述符；返回该描述符，失败返回 -1
+static int daemon_setup(Daemon *d, const char *control_path) {
+    d->listen_fd = control_path[0] ? control_open(control_path) : -1;
+    d->timer_fd = timerfd_create(CLOCK_REALTIME, TFD_CLOEXEC | TFD_NONBLOCK);
+    if (pipe2(wake_pipe, O_CLOEXEC | O_NONBLOCK) < 0)
+        return -1;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = hup_handler;
+    sa.sa_flags = SA_RESTART;
+    sigemptyset(&sa.sa_mask);
+    sigaction(SIGHUP, &sa, NULL);
+    int ep = epoll_create1(EPOLL_CLOEXEC);
+    if (ep < 0)
+        return -1;
+    struct epoll_event ev = { .events = EPOLLIN };
+    ev.data.fd = wake_pipe[0];
+    epoll_ctl(ep, EPOLL_CTL_ADD, wake_pipe[0], &ev);
+    if (d->listen_fd >= 0) {
+        ev.data.fd = d->listen_fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, d->listen_fd, &ev);
+    }
+    if (d->timer_fd >= 0) {
+        ev.data.fd = d->timer_fd;
+        epoll_ctl(ep, EPOLL_CTL_ADD, d->timer_fd, &ev);
+    }
+    return ep;
 }
 
 // 打印程序使用说明和命令行选项
@@ -550,14 +323,75 @@ void print_help(const char *program_name) {
     printf("  -d <debug_level>, --debug=<debug_level>      设置调试级别 (0=无日志, 1=基础日志, 2=详细日志)。\n");
     printf("  -u <uid>, --uid=<uid>                        指定以特定用户ID或用户名运行。\n");
     printf("  -g <gid>, --gid=<gid>                        指定以特定组ID或组名运行。\n");
+    printf("  -W, --watch                                 监听模式：只处理发生变更的规则目录，-s 为完整扫描间隔（默认 3600 秒）。\n");
+    printf("  -t <n>, --threads=<n>                        使用 n 个工作线程并行遍历和删除目录（默认 1）。\n");
+    printf("  -b <backend>, --backend=<backend>            文件删除后端：sync（默认）或 uring（批量提交，不支持时自动回退）。\n");
+    printf("  -S <file>, --stats=<file>                    每轮追加一条 JSON 统计记录的文件（默认 stats.jsonl，空串表示不写）。\n");
+    printf("  -I <file>, --cache=<file>                    -2 规则的扫描状态缓存文件（默认 scan.cache，空串表示不使用）。\n");
+    printf("  -R <n>, --rate=<n>                           每秒最多删除 n 个条目（默认 0，不设上限）。\n");
+    printf("  -P <file>, --psi=<file>                      I/O 压力文件（默认 /proc/pressure/io，空串表示不使用），压力升高时降低删除速率。\n");
+    printf("  -i <class>, --ioclass=<class>                I/O 调度类：idle（默认，只在存储空闲时执行）或 be（普通）。\n");
+    printf("  -T, --trash                                 -1 规则命中的整个目录先移入所在文件系统的回收目录（.clean-trash），由后台线程删除。\n");
+    printf("  -k <MB>, --chunk=<MB>                        后台删除大于该大小的文件前每次截断 MB 兆字节（默认 0，不截断）。\n");
+    printf("  -U <n>, --unlink-batch=<n>                   删除目录中的文件时每 n 个按 inode 排序后再处理（默认 0，按读取顺序）。\n");
+    printf("  -p <n>, --profile=<n>                        按规则组统计开销，每轮结束时在日志和统计记录中列出耗时最高的 n 组（默认 0，不统计）。\n");
+    printf("  -M <file>, --mountinfo=<file>                挂载表（默认 /proc/self/mountinfo，空串表示不改写规则），用于确认 -m 中的前缀位于 FUSE 上。\n");
+    printf("  -m <map>, --path-map=<map>                   规则路径前缀映射 \"前缀=下层路径,...\"，前缀位于 FUSE 上时规则改写为下层路径\n");
+    printf("                                               （默认 %s）。\n", DEFAULT_PATH_MAP);
+    printf("  -B <file>, --bundle=<file>                   规则包（默认 rules.bundle，空串表示不使用）：规则文件未变化时直接映射编译结果。\n");
+    printf("  --compile-rules=<file>                      按 -1/-2/-w 编译规则并写入规则包 file 后退出。\n");
+    printf("  -C <path>, --control=<path>                  常驻模式的控制套接字（默认 clean.sock，空串表示不创建）。\n");
+    printf("  -c <cmd>, --ctl=<cmd>                        向运行中的实例发送控制命令并输出回复后退出。\n");
     printf("  -h, --help                                  显示帮助信息。\n");
     printf("\n注意:\n");
     printf("  - 黑名单和白名单文件中每行代表一条规则，支持注释（以 '#' 开头）以及空行。\n");
     printf("  - 黑名单规则支持通配符，并可用方括号指定模式，如: /tmp/cache/[*.tmp|*.log]\n");
+    printf("    方括号规则删除该目录下任意深度内名称匹配的文件；支持花括号候选，如: /tmp/*.{tmp,log}\n");
+    printf("  - \"**\" 表示任意深度，如: /tmp/**/*.log 删除 /tmp 下任意深度的 .log 文件。\n");
+    printf("  - 规则末尾加 \" @<大小>\"（单位 K/M/G）为配额规则，如: /data/*/cache @200M\n");
+    printf("    命中的目录超出配额时从最旧的文件开始删除，直到回到配额以内；配额规则不受 -D 影响。\n");
     printf("  - 白名单规则应为完整路径，匹配该路径及其所有子目录/文件。\n");
+    printf("  - -s 大于 0 或 -W 时常驻运行：收到 SIGHUP 重新加载规则，控制命令有 run、run <规则>、\n");
+    printf("    pause、resume、reload、status、metrics，回复为一行 JSON。\n");
+    printf("    常驻时 -2 规则的文件一到期就只重新处理其所在目标，不必等到下一轮完整扫描。\n");
     printf("\n示例:\n");
     printf("  %s -1 blacklist1.txt -w whitelist.txt -s 60 -d 1\n", program_name);
     printf("  %s -1 blacklist1.txt -2 blacklist2.txt -w whitelist.txt -D 30\n", program_name);
+    printf("  %s -c metrics\n", program_name);
+}
+
+// 只有长选项的参数
+enum { OPT_COMPILE_RULES = 256 };
+
+// --compile-rules：从规则文件编译并写出规则包，供部署时预先生成
+static int compile_rules(const char *path, const char *blacklist1, const char *blacklist2, const char *whitelist, int debug_level,
+    const char *mountinfo_path, const char *path_map) {
+    // 首次编译时读取失败的规则文件按空处理，这里要求全部可读，避免写出不完整的规则包
+    const char *files[3] = { blacklist1, blacklist2, whitelist };
+    for (int i = 0; i < 3; i++) {
+        if (files[i] && access(files[i], R_OK) != 0) {
+            fprintf(stderr, "%s: 无法读取规则文件 %s: %s\n", program_name, files[i], strerror(errno));
+            return EXIT_FAILURE;
+        }
+    }
+    CleanOptions options;
+    clean_options_init(&options);
+    options.debug_level = debug_level;
+    // 规则包记录生效的路径映射，与运行时使用相同的挂载表和映射才能被采用
+    options.mountinfo_path = mountinfo_path;
+    options.path_map = path_map;
+    CleanContext *ctx = clean_create(&options);
+    int ok = ctx && clean_compile_rules(ctx, blacklist1, blacklist2, whitelist) == 0 &&
+        clean_write_rule_bundle(ctx, path) == 0;
+    if (ok) {
+        int bl1 = 0, bl2 = 0;
+        clean_rule_counts(ctx, &bl1, &bl2);
+        printf("已写入规则包 %s（-1 规则 %d 条，-2 规则 %d 条）\n", path, bl1, bl2);
+    } else {
+        fprintf(stderr, "%s: 无法写入规则包 %s: %s\n", program_name, path, strerror(errno));
+    }
+    clean_destroy(ctx);
+    return ok ? EXIT_SUCCESS : EXIT_FAILURE;
 }
 
 int main(int argc, char *argv[]) {
@@ -574,14 +408,37 @@ int main(int argc, char *argv[]) {
         {"help", no_argument, 0, 'h'},
         {"uid", required_argument, 0, 'u'},
         {"gid", required_argument, 0, 'g'},
+        {"watch", no_argument, 0, 'W'},
+        {"threads", required_argument, 0, 't'},
+        {"backend", required_argument, 0, 'b'},
+        {"stats", required_argument, 0, 'S'},
+        {"cache", required_argument, 0, 'I'},
+        {"rate", required_argument, 0, 'R'},
+        {"psi", required_argument, 0, 'P'},
+        {"ioclass", required_argument, 0, 'i'},
+        {"trash", no_argument, 0, 'T'},
+        {"chunk", required_argument, 0, 'k'},
+        {"unlink-batch", required_argument, 0, 'U'},
+        {"profile", required_argument, 0, 'p'},
+        {"mountinfo", required_argument, 0, 'M'},
+        {"path-map", required_argument, 0, 'm'},
+        {"bundle", required_argument, 0, 'B'},
+        {"compile-rules", required_argument, 0, OPT_COMPILE_RULES},
+        {"control", required_argument, 0, 'C'},
+        {"ctl", required_argument, 0, 'c'},
         {0, 0, 0, 0}
     };
 
-    int opt, seconds = 0, days = 0;
+    int opt, seconds = 0, days = 0, watch = 0, threads = 1, backend = CLEAN_BACKEND_SYNC;
+    int max_rate = 0, io_idle = 1, trash = 0, chunk_mb = 0, unlink_batch = 0, profile_top = 0;
+    char *stats_path = "stats.jsonl", *psi_path = "/proc/pressure/io";
+    char *control_path = "clean.sock", *ctl_cmd = NULL, *cache_path = "scan.cache";
+    char *bundle_path = "rules.bundle", *compile_path = NULL;
+    char *mountinfo_path = "/proc/self/mountinfo", *path_map = DEFAULT_PATH_MAP;
     char *uid_str = NULL, *gid_str = NULL, *blacklist1_file = NULL, *blacklist2_file = NULL, *whitelist_file = NULL;
     char time_str[100];
 
-    while ((opt = getopt_long(argc, argv, "1:2:w:D:s:d:hu:g:", long_options, NULL)) != -1) {
+    while ((opt = getopt_long(argc, argv, "1:2:w:D:s:d:hu:g:Wt:b:S:I:R:P:i:Tk:U:p:M:m:B:C:c:", long_options, NULL)) != -1) {
         switch (opt) {
             case '1': 
                 blacklist1_file = optarg; 
@@ -622,6 +479,94 @@ int main(int argc, char *argv[]) {
             case 'g':
                 gid_str = optarg;
                 break;
+            case 'W':
+                watch = 1;
+                break;
+            case 'S':
+                stats_path = optarg;
+                break;
+            case 'I':
+                cache_path = optarg;
+                break;
+            case 'p':
+                profile_top = atoi(optarg);
+                if (profile_top < 0) {
+                    fprintf(stderr, "%s: 错误: 无效的规则数 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'M':
+                mountinfo_path = optarg;
+                break;
+            case 'm':
+                path_map = optarg;
+                break;
+            case 'B':
+                bundle_path = optarg;
+                break;
+            case OPT_COMPILE_RULES:
+                compile_path = optarg;
+                break;
+            case 'R':
+                max_rate = atoi(optarg);
+                if (max_rate < 0) {
+                    fprintf(stderr, "%s: 错误: 无效的删除速率 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'P':
+                psi_path = optarg;
+                break;
+            case 'i':
+                if (strcmp(optarg, "idle") == 0)
+                    io_idle = 1;
+                else if (strcmp(optarg, "be") == 0)
+                    io_idle = 0;
+                else {
+                    fprintf(stderr, "%s: 错误: 无效的 I/O 调度类 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'T':
+                trash = 1;
+                break;
+            case 'k':
+                chunk_mb = atoi(optarg);
+                if (chunk_mb < 0) {
+                    fprintf(stderr, "%s: 错误: 无效的截断大小 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'U':
+                unlink_batch = atoi(optarg);
+                if (unlink_batch < 0) {
+                    fprintf(stderr, "%s: 错误: 无效的批量大小 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 'C':
+                control_path = optarg;
+                break;
+            case 'c':
+                ctl_cmd = optarg;
+                break;
+            case 'b':
+                if (strcmp(optarg, "sync") == 0)
+                    backend = CLEAN_BACKEND_SYNC;
+                else if (strcmp(optarg, "uring") == 0)
+                    backend = CLEAN_BACKEND_URING;
+                else {
+                    fprintf(stderr, "%s: 错误: 无效的 I/O 后端 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
+            case 't':
+                threads = atoi(optarg);
+                if (threads < 1 || threads > 256) {
+                    fprintf(stderr, "%s: 错误: 无效的线程数 '%s'\n", program_name, optarg);
+                    return EXIT_FAILURE;
+                }
+                break;
             default:
                 fprintf(stderr, "%s: 错误: 未知选项 '-%c'\n", program_name, optopt);
                 print_help(program_name);
@@ -629,6 +574,9 @@ int main(int argc, char *argv[]) {
         }
     }
 
+    if (ctl_cmd)
+        return control_client(control_path, ctl_cmd);
+
     if (uid_str) {
         struct passwd *pwd = getpwnam(uid_str);
         if (pwd)
@@ -656,8 +604,7 @@ int main(int argc, char *argv[]) {
         }
     }
 
-    log_file = fopen("run.log", "a");
-    if (!log_file) {
+    if (clean_log_open("run.log", debug_level) != 0) {
         perror("无法打开日志文件");
         return EXIT_FAILURE;
     }
@@ -665,7 +612,7 @@ int main(int argc, char *argv[]) {
     if (target_gid != -1 && setgid(target_gid) != 0) {
         fprintf(stderr, "%s: 设置 GID (%u) 失败: %s\n", program_name,
                 (unsigned int)target_gid, strerror(errno));
-        fclose(log_file);
+        clean_log_close();
         return EXIT_FAILURE;
     }
     log_message(2, "已设置 GID: %u\n", (unsigned int)target_gid);
@@ -673,7 +620,7 @@ int main(int argc, char *argv[]) {
     if (target_uid != -1 && setuid(target_uid) != 0) {
         fprintf(stderr, "%s: 设置 UID (%u) 失败: %s\n", program_name,
                 (unsigned int)target_uid, strerror(errno));
-        fclose(log_file);
+        clean_log_close();
         return EXIT_FAILURE;
     }
     log_message(2, "已设置 UID: %u\n", (unsigned int)target_uid);
@@ -682,54 +629,129 @@ int main(int argc, char *argv[]) {
     strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&start_time));
     log_message(1, "\n程序启动时间: %s\n", time_str);
 
-    log_message(2, "参数信息: blacklist1=%s, blacklist2=%s, whitelist=%s, days=%d, seconds=%d, debug=%d\n",
-                blacklist1_file, blacklist2_file, whitelist_file, days, seconds, debug_level);
+    // 监听模式下 -s 为完整对账间隔，未指定时默认每小时一次
+    if (watch && seconds == 0)
+        seconds = 3600;
+
+    log_message(2, "参数信息: blacklist1=%s, blacklist2=%s, whitelist=%s, days=%d, seconds=%d, debug=%d, watch=%d, threads=%d\n",
+                blacklist1_file, blacklist2_file, whitelist_file, days, seconds, debug_level, watch, threads);
 
     if (!blacklist1_file || !whitelist_file) {
         log_message(1, "%s: 错误: 必须同时指定 -1 <blacklist1> 和 -w <whitelist> 文件路径。\n", program_name);
         print_help(program_name);
-        fclose(log_file);
+        clean_log_close();
         return EXIT_FAILURE;
     }
     if (blacklist2_file && days <= 0) {
         log_message(1, "%s: 错误: 使用 -2 时必须同时设置 -D 且天数必须为正数。\n", program_name);
         print_help(program_name);
-        fclose(log_file);
+        clean_log_close();
+        return EXIT_FAILURE;
+    }
+
+    if (compile_path) {
+        int ret = compile_rules(compile_path, blacklist1_file, blacklist2_file, whitelist_file, debug_level,
+            mountinfo_path, path_map);
+        clean_log_close();
+        return ret;
+    }
+
+    // 统计文件、扫描状态缓存与 run.log 一样相对当前目录写入，指定空串时不写
+    Daemon daemon = {
+        .blacklist1 = blacklist1_file,
+        .blacklist2 = blacklist2_file,
+        .whitelist = whitelist_file,
+        .seconds = seconds,
+        .watch = watch,
+        .listen_fd = -1,
+        .timer_fd = -1,
+        .started = start_time,
+    };
+    int epoll_fd = -1;
+    if (seconds > 0 && (epoll_fd = daemon_setup(&daemon, control_path)) < 0)
+        log_message(1, "无法创建控制事件描述符: %s\n", strerror(errno));
+
+    CleanOptions options;
+    clean_options_init(&options);
+    options.debug_level = debug_level;
+    options.days = days;
+    options.threads = threads;
+    options.backend = backend;
+    options.watch = watch;
+    options.stats_path = stats_path;
+    options.cycle = on_cycle;
+    options.user = &daemon;
+    options.wake_fd = epoll_fd;
+    options.scan_cache_path = blacklist2_file ? cache_path : NULL;
+    options.max_rate = max_rate;
+    options.psi_path = psi_path;
+    options.io_idle = io_idle;
+    options.trash = trash;
+    options.trash_chunk = (uint64_t)chunk_mb << 20;
+    options.rule_bundle = bundle_path;
+    options.mountinfo_path = mountinfo_path;
+    options.path_map = path_map;
+    options.unlink_batch = unlink_batch;
+    options.profile_top = profile_top;
+    CleanContext *ctx = clean_create(&options);
+    if (!ctx) {
+        log_message(1, "内存分配失败: context\n");
+        clean_log_close();
         return EXIT_FAILURE;
     }
 
-    do {
-        time_t loop_start = time(NULL);
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&loop_start));
-        log_message(1, "\n【循环开始】时间: %s\n", time_str);
-
-        char **blacklist1 = NULL, **blacklist2 = NULL, **whitelist = NULL;
-        int bl1_count = read_file_to_array(blacklist1_file, &blacklist1);
-        int bl2_count = blacklist2_file ? read_file_to_array(blacklist2_file, &blacklist2) : 0;
-        int wl_count = read_file_to_array(whitelist_file, &whitelist);
-
-        process_blacklist(blacklist1, bl1_count, whitelist, wl_count, 0, 0);
-        if (blacklist2_file)
-            process_blacklist(blacklist2, bl2_count, whitelist, wl_count, 1, days);
-
-        free_array(blacklist1, bl1_count);
-        free_array(blacklist2, bl2_count);
-        free_array(whitelist, wl_count);
-
-        time_t end_time = time(NULL);
-        strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&end_time));
-        log_message(1, "%s 已删除文件数: %d\n", time_str, total_files_deleted);
-        log_message(1, "%s 已删除目录数: %d\n", time_str, total_dirs_deleted);
-
-        total_files_deleted = total_dirs_deleted = 0;
-        if (seconds > 0) {
-            log_message(1, "等待 %d 秒后继续下一次循环...\n", seconds);
-            sleep(seconds);
-        } else {
-            log_message(1, "执行完成，程序退出。\n");
+    daemon.ctx = ctx;
+
+    for (;;) {
+        if (!daemon.paused && now_ms() >= daemon.next_full) {
+            time_t loop_start = time(NULL);
+            strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&loop_start));
+            log_message(1, "\n【循环开始】时间: %s\n", time_str);
+
+            // 编译后的规则常驻内存，规则文件未变化时不再重新读取
+            if (clean_rules_changed(ctx))
+                clean_compile_rules(ctx, blacklist1_file, blacklist2_file, whitelist_file);
+            clean_run_cycle(ctx, NULL);
+            daemon.next_full = now_ms() + (int64_t)seconds * 1000;
+            if (seconds == 0) {
+                log_message(1, "执行完成，程序退出。\n");
+                break;
+            }
+            if (!watch)
+                log_message(1, "等待 %d 秒后继续下一次循环...\n", seconds);
         }
-    } while (seconds > 0);
+        // 在两轮完整扫描之间只重新处理已到期的过期目标
+        time_t due = clean_next_deadline(ctx);
+        if (!daemon.paused && due && due <= time(NULL))
+            clean_run_due(ctx, NULL);
+        daemon_arm_timer(&daemon);
+
+        // 监听模式等待文件事件，被信号或控制命令唤醒时返回 1；监听集合不可用时按间隔等待
+        int woken = 0;
+        if (watch && !daemon.paused) {
+            int64_t left = daemon.next_full - now_ms();
+            int ret = clean_watch(ctx, left > 0 ? (int)((left + 999) / 1000) : 0);
+            if (ret == 0)
+                daemon.next_full = 0;
+            woken = ret >= 0;
+        }
+        if (!woken) {
+            int64_t left = daemon.next_full - now_ms();
+            struct pollfd pfd = { .fd = epoll_fd, .events = POLLIN };
+            if (!daemon.paused && left <= 0)
+                continue;
+            // 超过 poll 的 int 毫秒上限（约 24.8 天）时分段等待，醒来后循环重新计算剩余时间
+            poll(&pfd, epoll_fd >= 0, daemon.paused ? -1 : left > INT_MAX ? INT_MAX : (int)left);
+        }
+        daemon_reload(&daemon);
+        control_serve(&daemon);
+    }
 
-    fclose(log_file);
+    if (daemon.listen_fd >= 0) {
+        close(daemon.listen_fd);
+        unlink(control_path);
+    }
+    clean_destroy(ctx);
+    clean_log_close();
     return EXIT_SUCCESS;
 }
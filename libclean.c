@@ -0,0 +1,6483 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <ctype.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+#include <errno.h>
+#include <limits.h>
+#include <regex.h>
+#include <fnmatch.h>
+#include <stdarg.h>
+#include <stdint.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include <sys/fanotify.h>
+#include <sys/statfs.h>
+#include <sys/mman.h>
+#include <sys/file.h>
+#include <sys/resource.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <signal.h>
+#include <sched.h>
+
+#ifndef STATX_TYPE
+#include <linux/stat.h>
+#endif
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "libclean.h"
+
+// 未绑定上下文时（如命令行解析阶段）日志文件使用的级别
+static int debug_level = 1;
+static int log_fd = -1;
+
+#define MAX_LOG_SIZE (256 * 1024)
+
+// 删除计数：调用线程累加到上下文的计数；工作线程累加到各自的计数，在每轮结束时合并
+typedef struct {
+    int files;
+    int dirs;
+    long long bytes;
+    long long scanned;
+} DeleteStats;
+
+static __thread DeleteStats *thread_stats = NULL;
+
+// 规则开销计数的各项（见 profile_switch）
+enum {
+    PROF_WALL,          // 线程墙钟时间（纳秒），多线程时为各线程之和
+    PROF_CPU,           // 线程 CPU 时间（纳秒）
+    PROF_VISITED,       // 读取的目录项
+    PROF_STATS,         // stat 调用（含批量提交的 statx）
+    PROF_MATCHES,       // 命中规则的目标
+    PROF_FILES,
+    PROF_DIRS,
+    PROF_BYTES,
+    PROF_WHITELIST,     // 因白名单跳过的条目
+    PROF_COUNT
+};
+
+// 一个规则组的开销计数，由各线程在切换计费范围时原子累加
+typedef struct {
+    atomic_llong v[PROF_COUNT];
+    int list;           // 1、2 为 -1、-2 规则组，0 为多个规则组共用的前缀目录
+    const char *rule;   // 组内第一条规则的原始行
+    uint32_t rules;     // 组内规则条数
+} RuleProfile;
+
+// 当前线程中不来自删除计数的开销计数（stat、命中、白名单），切换计费范围时取增量
+static __thread long long prof_counts[PROF_COUNT];
+
+typedef struct WatchSet WatchSet;
+typedef struct ThreadPool ThreadPool;
+typedef struct CleanRules CleanRules;
+typedef struct ScanCache ScanCache;
+typedef struct DeadlineRoot DeadlineRoot;
+
+// 删除限速的令牌桶，见 throttle_acquire
+typedef struct {
+    int enabled;
+    pthread_mutex_t lock;
+    char *psi_path;                 // 为空表示不按 I/O 压力调整
+    int max_rate;                   // 配置的上限，0 表示没有压力时不限速
+    _Atomic int rate;               // 当前速率（次/秒），0 表示不限速
+    _Atomic int64_t next_sample;    // 下次读取压力的单调时钟纳秒数
+    atomic_llong ops;               // 自上次采样以来的删除次数
+    double tokens;                  // 为负表示已被预支，调用方需休眠偿还
+    int64_t refill;                 // 上次补充令牌的时间
+    int64_t sample_start;
+    atomic_llong wait_ns;           // 本轮累计的限速等待
+} Throttle;
+
+// 规则路径前缀映射中的一项（见 path_map_detect）
+typedef struct {
+    char *from;
+    char *to;
+    size_t from_len;
+    int active;                     // from 当前位于 FUSE 挂载上，规则改写为 to
+} PathMapEntry;
+
+typedef struct {
+    PathMapEntry *items;
+    uint32_t count, cap;
+} PathMap;
+
+#define TRASH_MAX_DEVS 16
+
+// 一个文件系统上的回收目录，fd 为 -1 表示该文件系统上无法建立（直接删除）
+typedef struct {
+    dev_t dev;
+    int fd;
+} TrashDir;
+
+// 回收目录与后台删除线程，见 trash_move
+typedef struct {
+    int enabled;
+    uint64_t chunk;                 // 大文件分段截断的字节数，0 表示不截断
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    pthread_t thread;
+    int started, stop, pending;
+    TrashDir dirs[TRASH_MAX_DEVS];  // 只追加，已登记的项不再修改
+    int count;
+    atomic_uint seq;                // 回收目录中的唯一名称
+} Trash;
+
+// 引擎上下文：一个清理任务的全部状态，由 clean_create 创建
+struct CleanContext {
+    CleanOptions opt;
+    char *stats_file;               // 按周期追加写入的统计文件（JSON lines），为空表示不写
+    char *bundle_file;              // 规则包，为空表示每次从规则文件编译
+    char *mountinfo_file;           // 判断映射前缀是否位于 FUSE 上的挂载表，为空表示不改写规则
+    PathMap path_map;
+    unsigned int stats_stat_mask;   // 需要统计释放空间时为 STATX_BLOCKS：过期判断的 statx 顺带获取块数，-1 规则的文件删除前单独获取
+    int io_backend;
+    DeleteStats totals;
+    ThreadPool *pool;
+    WatchSet *watch;                // 非空时，遍历过程中把经过的规则目录登记到该集合
+    CleanRules *rules;
+    char *rule_files[3];            // blacklist1、blacklist2、whitelist
+    struct stat rule_snap[3];
+    int watch_woken;                // 上次 clean_watch 因 wake_fd 返回
+    ScanCache *scan_cache;          // -2 规则的扫描状态缓存，为空表示不使用
+    pthread_mutex_t deadline_lock;  // 多线程完整扫描时各工作线程同时登记目标
+    int deadline_collect;           // 完整扫描期间登记到期调度目标
+    DeadlineRoot **deadlines;       // 扫描期间按登记顺序，扫描结束后为按到期时间的最小堆
+    uint32_t deadline_count, deadline_cap;
+    Throttle throttle;
+    Trash trash;
+    RuleProfile *profile;           // 规则开销计数：下标 0 为共用前缀目录，其后依次为 -1、-2 规则组；为空表示不剖析
+    uint32_t profile_count;
+};
+
+// 当前线程正在服务的上下文：由接口函数在入口绑定，工作线程启动时绑定所属线程池的上下文
+static __thread CleanContext *engine = NULL;
+
+#define MAX_STATS_SIZE (1024 * 1024)
+
+// 绑定上下文并把删除计数指向它，返回之前绑定的上下文供恢复
+static CleanContext *engine_bind(CleanContext *ctx) {
+    CleanContext *prev = engine;
+    engine = ctx;
+    thread_stats = ctx ? &ctx->totals : NULL;
+    return prev;
+}
+
+// 累加释放字节数与扫描条目数
+static void stats_add(long long bytes, long long scanned) {
+    if (thread_stats) {
+        thread_stats->bytes += bytes;
+        thread_stats->scanned += scanned;
+    }
+}
+
+// 用于描述特殊规则的结构体，同时保存路径、方括号内的模式和转换后的正则表达式
+typedef struct {
+    char path[PATH_MAX];
+    char pattern[PATH_MAX];
+    regex_t regex;
+    int regex_valid;
+} SpecialRule;
+
+/*
+   异步日志：log_message 只把格式化后的消息追加到内存环形缓冲区（无锁，多线程以 CAS 预留空间），
+   由后台线程在一批消息到达约 100ms 后整块写出，不再逐条 stat、fflush。
+   文件大小在内存中累计，超过 MAX_LOG_SIZE 时滚动；缓冲区满时由生产者直接写出。
+   收到终止信号或崩溃时在信号处理函数中写出缓冲区剩余内容
+*/
+#define LOG_RING_SIZE (256 * 1024)  // 必须为 2 的幂
+#define LOG_LINE_MAX 8192
+#define LOG_FLUSH_DELAY_NS (100 * 1000000L)
+
+// 每条记录以 8 字节对齐的头部（长度 + 就绪标志）开始，已写出的区域清零以便复用
+typedef struct {
+    _Atomic uint64_t head;      // 生产者已预留到的位置
+    _Atomic uint64_t tail;      // 已写出到的位置
+    char data[LOG_RING_SIZE] __attribute__((aligned(8)));
+} LogRing;
+
+static LogRing log_ring;
+static char log_path[PATH_MAX];
+static off_t log_size = 0;
+static pthread_mutex_t log_flush_lock = PTHREAD_MUTEX_INITIALIZER;
+static atomic_int log_draining = 0;     // 正在取出记录；信号处理函数不能加锁，以此避免与写出线程同时取出
+static pthread_mutex_t log_wait_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t log_wait_cond = PTHREAD_COND_INITIALIZER;
+static atomic_int log_flusher_sleeping = 0;
+static int log_flusher_stop = 0;
+static int log_flusher_started = 0;
+static pthread_t log_flusher;
+
+static uint32_t log_record_size(uint32_t len) {
+    return (8 + len + 7) & ~7u;
+}
+
+// 日志文件尺寸超过上限时进行滚动处理：重命名为 <日志>.old 后重新创建日志文件
+void rotate_log_file() {
+    char old_path[PATH_MAX + 4];
+    snprintf(old_path, sizeof(old_path), "%s.old", log_path);
+    close(log_fd);
+    if (rename(log_path, old_path) == 0) {
+        if (debug_level >= 1)
+            fprintf(stderr, "日志文件已重命名为 %s\n", old_path);
+    } else {
+        fprintf(stderr, "日志文件重命名失败: %s\n", strerror(errno));
+    }
+    log_fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0) {
+        perror("无法打开新的日志文件");
+        exit(EXIT_FAILURE);
+    }
+    log_size = 0;
+    if (debug_level >= 1) {
+        static const char msg[] = "已打开新的日志文件，程序继续运行。\n";
+        if (write(log_fd, msg, sizeof(msg) - 1) > 0)
+            log_size = sizeof(msg) - 1;
+    }
+}
+
+// 将 len 字节完整写入日志文件
+static void log_write_all(const char *buf, size_t len) {
+    while (len > 0 && log_fd >= 0) {
+        ssize_t n = write(log_fd, buf, len);
+        if (n < 0) {
+            if (errno == EINTR)
+                continue;
+            return;
+        }
+        buf += n;
+        len -= (size_t)n;
+        log_size += n;
+    }
+}
+
+/*
+   按顺序取出已就绪的记录，拼接到 out 中整块写出；单条记录超过 cap 时直接从环形缓冲区写出。
+   rotate 为 0 时（信号处理函数中）不做滚动，只调用 write，保证异步信号安全。
+   调用方须持有 log_draining
+*/
+static void log_drain(char *out, size_t cap, int rotate) {
+    size_t n = 0;
+    uint64_t tail = atomic_load(&log_ring.tail);
+    for (;;) {
+        uint32_t *hdr = (uint32_t *)(log_ring.data + (tail & (LOG_RING_SIZE - 1)));
+        if (!__atomic_load_n(&hdr[1], __ATOMIC_ACQUIRE))
+            break;
+        uint32_t len = hdr[0];
+        if (n + len > cap || (rotate && log_size + (off_t)n > MAX_LOG_SIZE)) {
+            log_write_all(out, n);
+            n = 0;
+            if (rotate && log_size > MAX_LOG_SIZE)
+                rotate_log_file();
+        }
+        uint32_t size = log_record_size(len);
+        size_t pos = (tail + 8) & (LOG_RING_SIZE - 1);
+        size_t first = len < LOG_RING_SIZE - pos ? len : LOG_RING_SIZE - pos;
+        if (len > cap) {
+            log_write_all(log_ring.data + pos, first);
+            log_write_all(log_ring.data, len - first);
+        } else {
+            memcpy(out + n, log_ring.data + pos, first);
+            memcpy(out + n + first, log_ring.data, len - first);
+            n += len;
+        }
+        // 清零已取出的区域，新记录的头部必须从零开始
+        size_t start = tail & (LOG_RING_SIZE - 1);
+        size_t zero = size < LOG_RING_SIZE - start ? size : LOG_RING_SIZE - start;
+        memset(log_ring.data + start, 0, zero);
+        memset(log_ring.data, 0, size - zero);
+        tail += size;
+        atomic_store(&log_ring.tail, tail);
+    }
+    log_write_all(out, n);
+}
+
+// 写出环形缓冲区中已就绪的全部日志
+static void log_flush(void) {
+    static char out[64 * 1024];
+    pthread_mutex_lock(&log_flush_lock);
+    // 信号处理函数正在取出时跳过，进程随后即终止
+    if (!atomic_exchange(&log_draining, 1)) {
+        log_drain(out, sizeof(out), 1);
+        atomic_store(&log_draining, 0);
+    }
+    pthread_mutex_unlock(&log_flush_lock);
+}
+
+// 把一条消息放入环形缓冲区；空间不足时先由当前线程写出
+static void log_ring_put(const char *msg, uint32_t len) {
+    uint32_t size = log_record_size(len);
+    uint64_t head;
+    for (;;) {
+        head = atomic_load(&log_ring.head);
+        if (head + size - atomic_load(&log_ring.tail) > LOG_RING_SIZE) {
+            log_flush();
+            sched_yield();
+            continue;
+        }
+        if (atomic_compare_exchange_weak(&log_ring.head, &head, head + size))
+            break;
+    }
+    size_t pos = (head + 8) & (LOG_RING_SIZE - 1);
+    size_t first = len < LOG_RING_SIZE - pos ? len : LOG_RING_SIZE - pos;
+    memcpy(log_ring.data + pos, msg, first);
+    memcpy(log_ring.data, msg + first, len - first);
+    uint32_t *hdr = (uint32_t *)(log_ring.data + (head & (LOG_RING_SIZE - 1)));
+    hdr[0] = len;
+    __atomic_store_n(&hdr[1], 1, __ATOMIC_RELEASE);
+    // 后台线程空闲时唤醒它
+    if (atomic_load(&log_flusher_sleeping) && atomic_exchange(&log_flusher_sleeping, 0)) {
+        pthread_mutex_lock(&log_wait_lock);
+        pthread_cond_signal(&log_wait_cond);
+        pthread_mutex_unlock(&log_wait_lock);
+    }
+}
+
+// 后台写出线程：有新消息时等待一小段时间以合并成批，再整块写出；空闲时不唤醒
+static void *log_flusher_main(void *arg) {
+    (void)arg;
+    for (;;) {
+        pthread_mutex_lock(&log_wait_lock);
+        while (!log_flusher_stop && atomic_load(&log_ring.head) == atomic_load(&log_ring.tail)) {
+            atomic_store(&log_flusher_sleeping, 1);
+            pthread_cond_wait(&log_wait_cond, &log_wait_lock);
+        }
+        atomic_store(&log_flusher_sleeping, 0);
+        // 攒批等待；退出请求会提前结束等待，避免程序退出时白等一个周期
+        struct timespec deadline;
+        clock_gettime(CLOCK_REALTIME, &deadline);
+        deadline.tv_nsec += LOG_FLUSH_DELAY_NS;
+        if (deadline.tv_nsec >= 1000000000L) {
+            deadline.tv_sec++;
+            deadline.tv_nsec -= 1000000000L;
+        }
+        while (!log_flusher_stop &&
+               pthread_cond_timedwait(&log_wait_cond, &log_wait_lock, &deadline) != ETIMEDOUT) {
+        }
+        int stop = log_flusher_stop;
+        pthread_mutex_unlock(&log_wait_lock);
+        if (stop)
+            break;
+        log_flush();
+    }
+    log_flush();
+    return NULL;
+}
+
+// 信号处理：写出剩余日志后按默认方式处理该信号（终止或产生 core）
+static void log_signal_handler(int sig) {
+    char out[LOG_LINE_MAX];
+    // 写出线程（或被信号打断的本线程）正在取出时不再重复取出，避免重复写出或清零其正在复制的记录
+    if (!atomic_exchange(&log_draining, 1)) {
+        log_drain(out, sizeof(out), 0);
+        atomic_store(&log_draining, 0);
+    }
+    signal(sig, SIG_DFL);
+    raise(sig);
+}
+
+// 打开日志文件、启动后台写出线程并安装信号处理；失败返回 -1
+int clean_log_open(const char *path, int level) {
+    snprintf(log_path, sizeof(log_path), "%s", path);
+    debug_level = level;
+    log_fd = open(log_path, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (log_fd < 0)
+        return -1;
+    struct stat st;
+    log_size = fstat(log_fd, &st) == 0 ? st.st_size : 0;
+    log_flusher_started = pthread_create(&log_flusher, NULL, log_flusher_main, NULL) == 0;
+    static const int signals[] = { SIGTERM, SIGINT, SIGQUIT, SIGSEGV, SIGBUS, SIGFPE, SIGILL, SIGABRT };
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = log_signal_handler;
+    sa.sa_flags = SA_RESETHAND;
+    sigemptyset(&sa.sa_mask);
+    for (size_t i = 0; i < sizeof(signals) / sizeof(signals[0]); i++)
+        sigaction(signals[i], &sa, NULL);
+    return 0;
+}
+
+// 停止后台线程，写出剩余日志并关闭日志文件
+void clean_log_close(void) {
+    if (log_flusher_started) {
+        pthread_mutex_lock(&log_wait_lock);
+        log_flusher_stop = 1;
+        pthread_cond_signal(&log_wait_cond);
+        pthread_mutex_unlock(&log_wait_lock);
+        pthread_join(log_flusher, NULL);
+        log_flusher_started = 0;
+    }
+    log_flush();
+    if (log_fd >= 0)
+        close(log_fd);
+    log_fd = -1;
+}
+
+// 根据调试级别记录日志信息，支持 printf 格式化输出；上下文设置了日志回调时交给回调
+void log_message(int level, const char *format, ...) {
+    if ((engine ? engine->opt.debug_level : debug_level) < level)
+        return;
+    char buf[LOG_LINE_MAX];
+    va_list args;
+    va_start(args, format);
+    int len = vsnprintf(buf, sizeof(buf), format, args);
+    va_end(args);
+    if (len < 0)
+        return;
+    if (engine && engine->opt.log) {
+        engine->opt.log(engine->opt.user, level, buf);
+        return;
+    }
+    if (log_fd < 0)
+        return;
+    log_ring_put(buf, len < (int)sizeof(buf) ? (uint32_t)len : (uint32_t)sizeof(buf) - 1);
+}
+
+// 记录删除结果并更新计数，err 为 0 表示成功；同步删除与批量后端共用
+static void note_delete_result(const char *path, int is_dir, int is_link, int err) {
+    if (err == 0) {
+        if (is_dir) {
+            thread_stats->dirs++;
+            log_message(2, "已删除目录: %s\n", path);
+        } else {
+            thread_stats->files++;
+            log_message(2, "已删除%s: %s\n", is_link ? "符号链接" : "文件", path);
+        }
+    } else {
+        log_message(1, "删除%s失败: %s, 错误: %s\n", 
+            is_dir ? "目录" : "文件/链接", path, strerror(err));
+    }
+    if (engine->opt.visit)
+        engine->opt.visit(engine->opt.user, path, is_dir, err);
+}
+
+// 询问上下文的决策回调是否允许删除，未设置回调时总是允许
+static int delete_allowed(const char *path, int is_dir) {
+    if (!engine->opt.decide || engine->opt.decide(engine->opt.user, path, is_dir))
+        return 1;
+    log_message(2, "回调保留: %s\n", path);
+    return 0;
+}
+
+/*
+   删除限速：令牌桶限制每秒 unlinkat/rmdir 的次数，避免成批删除长时间占满存储队列、
+   前台应用的读写排在后面造成卡顿。速率按 I/O 压力（PSI 的 some avg10，即最近 10 秒内
+   有任务等待 I/O 的时间占比）每秒调整一次：
+     压力 >= THROTTLE_PSI_HIGH  速率减半（未限速时从上一秒的实际删除速率开始），最低 THROTTLE_MIN_RATE
+     压力 <  THROTTLE_PSI_LOW   速率翻倍，直到回到 max_rate；未设上限时实际速率已不到限速的一半即解除限速
+   令牌不足时调用线程先预支再休眠偿还，多线程共享同一个桶；批量后端的批次也随速率缩小
+   （throttle_batch），每批提交前按批次条目数取令牌，批次之间让出存储队列
+*/
+#define THROTTLE_SAMPLE_NS 1000000000LL     // 内核每 2 秒更新一次 avg10
+#define THROTTLE_PSI_LOW 2.0
+#define THROTTLE_PSI_HIGH 10.0
+#define THROTTLE_MIN_RATE 20
+
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_IDLE (3 << 13)   // IOPRIO_CLASS_IDLE，idle 类不区分级别
+
+static int64_t monotonic_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+// 读取 PSI 文件中的 some avg10（百分比），失败返回 -1。每次重新打开，测试时可直接替换该文件
+static double psi_read(const char *path) {
+    char buf[256];
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return -1;
+    ssize_t n = read(fd, buf, sizeof(buf) - 1);
+    close(fd);
+    if (n <= 0)
+        return -1;
+    buf[n] = '\0';
+    double avg10;
+    const char *p = strstr(buf, "some avg10=");
+    if (!p || sscanf(p + 11, "%lf", &avg10) != 1)
+        return -1;
+    return avg10;
+}
+
+static void throttle_init(Throttle *t, const CleanOptions *opt) {
+    pthread_mutex_init(&t->lock, NULL);
+    t->max_rate = opt->max_rate > 0 ? opt->max_rate : 0;
+    if (opt->psi_path && opt->psi_path[0]) {
+        if (psi_read(opt->psi_path) < 0)
+            log_message(1, "无法读取 I/O 压力: %s，不按压力调整删除速率\n", opt->psi_path);
+        else
+            t->psi_path = strdup(opt->psi_path);
+    }
+    t->enabled = t->max_rate || t->psi_path;
+    atomic_store(&t->rate, t->max_rate);
+    t->refill = t->sample_start = monotonic_ns();
+    atomic_store(&t->next_sample, t->sample_start + THROTTLE_SAMPLE_NS);
+}
+
+static void throttle_free(Throttle *t) {
+    free(t->psi_path);
+    pthread_mutex_destroy(&t->lock);
+}
+
+// 按 I/O 压力调整速率，持有 t->lock 时调用
+static void throttle_sample(Throttle *t, int64_t now) {
+    atomic_store(&t->next_sample, now + THROTTLE_SAMPLE_NS);
+    long long ops = atomic_exchange(&t->ops, 0);
+    int64_t elapsed = now - t->sample_start;
+    t->sample_start = now;
+    if (!t->psi_path)
+        return;
+    double pressure = psi_read(t->psi_path);
+    if (pressure < 0)
+        return;
+    long long actual = elapsed > 0 ? ops * 1000000000LL / elapsed : 0;
+    int rate = atomic_load(&t->rate), next = rate;
+    if (pressure >= THROTTLE_PSI_HIGH) {
+        long long base = rate ? rate : actual;
+        next = base / 2 > THROTTLE_MIN_RATE ? (int)(base / 2 < INT_MAX ? base / 2 : INT_MAX) : THROTTLE_MIN_RATE;
+    } else if (pressure < THROTTLE_PSI_LOW && rate) {
+        if (t->max_rate)
+            next = rate >= t->max_rate / 2 ? t->max_rate : rate * 2;
+        else
+            next = rate / 2 > actual ? 0 : rate * 2;
+    }
+    if (next == rate)
+        return;
+    if (!rate)
+        t->tokens = 0;
+    atomic_store(&t->rate, next);
+    if (next)
+        log_message(2, "I/O 压力 %.2f%%，删除速率限制为每秒 %d 次\n", pressure, next);
+    else
+        log_message(2, "I/O 压力 %.2f%%，解除删除限速\n", pressure);
+}
+
+// 为 n 次删除取令牌，令牌不足时休眠；未限速时只计数
+static void throttle_acquire(int n) {
+    Throttle *t = &engine->throttle;
+    if (!t->enabled)
+        return;
+    atomic_fetch_add_explicit(&t->ops, n, memory_order_relaxed);
+    int64_t now = monotonic_ns();
+    if (!atomic_load_explicit(&t->rate, memory_order_relaxed) &&
+        now < atomic_load_explicit(&t->next_sample, memory_order_relaxed))
+        return;
+    int64_t wait = 0;
+    pthread_mutex_lock(&t->lock);
+    if (now >= atomic_load(&t->next_sample))
+        throttle_sample(t, now);
+    int rate = atomic_load(&t->rate);
+    if (rate) {
+        // 最多积攒 100 毫秒的令牌，空闲之后不会突发一大批删除
+        double burst = rate / 10.0 > 1 ? rate / 10.0 : 1;
+        t->tokens += (double)(now - t->refill) * rate / 1e9;
+        if (t->tokens > burst)
+            t->tokens = burst;
+        t->tokens -= n;
+        if (t->tokens < 0)
+            wait = (int64_t)(-t->tokens * 1e9 / rate);
+    }
+    t->refill = now;
+    pthread_mutex_unlock(&t->lock);
+    if (wait > 0) {
+        atomic_fetch_add_explicit(&t->wait_ns, wait, memory_order_relaxed);
+        struct timespec ts = { wait / 1000000000LL, wait % 1000000000LL };
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR)
+            ;
+    }
+}
+
+// 批量后端的批次上限：限速时约为 50 毫秒的配额，避免一次提交整批删除
+static uint32_t throttle_batch(uint32_t max) {
+    int rate = engine->throttle.enabled ? atomic_load_explicit(&engine->throttle.rate, memory_order_relaxed) : 0;
+    if (!rate || (uint32_t)rate / 20 >= max)
+        return max;
+    return rate >= 40 ? (uint32_t)rate / 20 : 1;
+}
+
+// 直接删除目录项并记录结果，不再询问决策回调；成功返回 1
+static int unlink_item_at(int dir_fd, const char *name, const char *path, int is_dir, int is_link) {
+    throttle_acquire(1);
+    int err = unlinkat(dir_fd, name, is_dir ? AT_REMOVEDIR : 0) == 0 ? 0 : errno;
+    note_delete_result(path, is_dir, is_link, err);
+    return err == 0;
+}
+
+// 相对于父目录 fd 删除文件或目录项，并记录相关操作日志；path 仅用于日志，成功返回 1
+static int delete_item_at(int dir_fd, const char *name, const char *path, int is_dir, int is_link) {
+    if (!name || !path || !delete_allowed(path, is_dir))
+        return 0;
+    return unlink_item_at(dir_fd, name, path, is_dir, is_link);
+}
+
+// 相对于父目录 fd 打开子目录，不跟随符号链接，避免内核重新解析完整路径
+static int open_dir_at(int parent_fd, const char *name) {
+    return openat(parent_fd, name, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+}
+
+#ifndef RESOLVE_NO_XDEV
+#define RESOLVE_NO_XDEV 0x01
+#endif
+
+// openat2 的参数（linux/openat2.h 中的 struct open_how），旧的 NDK 头文件中没有
+typedef struct {
+    uint64_t flags;
+    uint64_t mode;
+    uint64_t resolve;
+} OpenHow;
+
+static atomic_int openat2_missing;
+
+/*
+   打开删除子树内部的子目录：与 open_dir_at 相同，但不跨越挂载点（相当于 rm --one-file-system），
+   子目录是其他文件系统或绑定挂载的挂载点时失败，errno 为 EXDEV。规则前缀本身可以跨越挂载点（/ 到 /data），
+   只有规则目标之下的内容限定在目标所在的文件系统上。内核不支持 openat2（5.6 之前）时退回比较 st_dev，
+   此时识别不了同一文件系统的绑定挂载
+*/
+static int open_subdir_at(int parent_fd, const char *name) {
+#ifdef SYS_openat2
+    if (!atomic_load_explicit(&openat2_missing, memory_order_relaxed)) {
+        OpenHow how = { O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC, 0, RESOLVE_NO_XDEV };
+        int fd = (int)syscall(SYS_openat2, parent_fd, name, &how, sizeof(how));
+        if (fd >= 0 || errno != ENOSYS)
+            return fd;
+        atomic_store_explicit(&openat2_missing, 1, memory_order_relaxed);
+    }
+#endif
+    int fd = open_dir_at(parent_fd, name);
+    struct stat parent, st;
+    if (fd >= 0 && fstat(parent_fd, &parent) == 0 && fstat(fd, &st) == 0 && st.st_dev != parent.st_dev) {
+        close(fd);
+        errno = EXDEV;
+        return -1;
+    }
+    return fd;
+}
+
+// 删除子树中的子目录打不开时记录日志：挂载点是有意跳过的，只在详细日志中记录
+static void log_subdir_error(const char *path) {
+    if (errno == EXDEV)
+        log_message(2, "跳过挂载点: %s\n", path);
+    else
+        log_message(1, "无法打开目录: %s, 错误: %s\n", path, strerror(errno));
+}
+
+// 在共享路径缓冲区（PATH_MAX）末尾原地追加 "/name"，返回新长度；超长时返回 0 且不修改缓冲区
+static size_t path_push(char *path, size_t len, const char *name) {
+    size_t name_len = strlen(name);
+    if (len + 1 + name_len >= PATH_MAX)
+        return 0;
+    path[len] = '/';
+    memcpy(path + len + 1, name, name_len + 1);
+    return len + 1 + name_len;
+}
+
+// getdents64 每批读取的缓冲区大小，一次系统调用可取回数百个目录项
+#define DIR_BATCH_SIZE (32 * 1024)
+
+// 内核 getdents64 返回的原始目录项格式
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+// 批量目录读取器：持有目录 fd 与 getdents64 批缓冲区
+typedef struct {
+    int fd;
+    char *buf;
+    size_t pos;
+    size_t len;
+    int64_t off;        // 最近取出的条目的 d_off，lseek 到这里可从其后继续读取
+    long long entries;  // 已读取的条目数，关闭时计入扫描统计
+} DirReader;
+
+/*
+   单个目录项及按需获取的元数据。
+   类型优先取自 d_type，只有 DT_UNKNOWN 或确实需要 mtime 时才调用 statx，
+   同一条目的匹配、过期判断和日志均复用这一次 stat 结果
+*/
+typedef struct {
+    const char *name;
+    ino_t ino;
+    unsigned char type;
+    unsigned int stat_mask;
+    time_t mtime;
+    uint64_t blocks;    // 占用的 512 字节块数，仅在写统计文件时获取
+} DirEntry;
+
+static int statx_unsupported = 0;
+
+// 初始化目录读取器，读取器接管 fd 的所有权；失败时关闭 fd 并返回 0
+static int dir_reader_open(DirReader *r, int fd) {
+    r->fd = fd;
+    r->pos = r->len = 0;
+    r->off = 0;
+    r->entries = 0;
+    r->buf = fd >= 0 ? malloc(DIR_BATCH_SIZE) : NULL;
+    if (!r->buf) {
+        if (fd >= 0)
+            close(fd);
+        r->fd = -1;
+        return 0;
+    }
+    return 1;
+}
+
+// 关闭目录读取器并释放批缓冲区
+static void dir_reader_close(DirReader *r) {
+    stats_add(0, r->entries);
+    r->entries = 0;
+    free(r->buf);
+    r->buf = NULL;
+    if (r->fd >= 0)
+        close(r->fd);
+    r->fd = -1;
+}
+
+// 取下一个目录项（跳过 "." 与 ".."），返回 1 表示取到，0 表示读完，-1 表示出错
+static int dir_reader_next(DirReader *r, DirEntry *e) {
+    for (;;) {
+        if (r->pos >= r->len) {
+            long n = syscall(SYS_getdents64, r->fd, r->buf, DIR_BATCH_SIZE);
+            if (n <= 0)
+                return n < 0 ? -1 : 0;
+            r->len = (size_t)n;
+            r->pos = 0;
+        }
+        struct linux_dirent64 *d = (struct linux_dirent64 *)(r->buf + r->pos);
+        r->pos += d->d_reclen;
+        r->off = d->d_off;
+        if (d->d_name[0] == '.' && (d->d_name[1] == '\0' || (d->d_name[1] == '.' && d->d_name[2] == '\0')))
+            continue;
+        e->name = d->d_name;
+        e->ino = (ino_t)d->d_ino;
+        e->type = d->d_type;
+        e->stat_mask = 0;
+        e->mtime = 0;
+        e->blocks = 0;
+        r->entries++;
+        return 1;
+    }
+}
+
+// 将 st_mode 中的文件类型转换为 DT_* 取值
+static unsigned char mode_to_dtype(mode_t mode) {
+    if (S_ISDIR(mode)) return DT_DIR;
+    if (S_ISLNK(mode)) return DT_LNK;
+    if (S_ISFIFO(mode)) return DT_FIFO;
+    if (S_ISSOCK(mode)) return DT_SOCK;
+    if (S_ISCHR(mode)) return DT_CHR;
+    if (S_ISBLK(mode)) return DT_BLK;
+    return DT_REG;
+}
+
+/*
+   按需获取目录项元数据，mask 为所需的 STATX_* 字段；已获取过的字段不会重复查询。
+   优先使用 statx 并只请求所需字段，内核不支持时回退到 fstatat
+*/
+static int entry_stat(int dir_fd, DirEntry *e, unsigned int mask) {
+    if ((e->stat_mask & mask) == mask)
+        return 0;
+    prof_counts[PROF_STATS]++;
+#ifdef SYS_statx
+    if (!statx_unsupported) {
+        struct statx stx;
+        if (syscall(SYS_statx, dir_fd, e->name, AT_SYMLINK_NOFOLLOW, mask, &stx) == 0) {
+            if (stx.stx_mask & STATX_TYPE)
+                e->type = mode_to_dtype(stx.stx_mode);
+            if (stx.stx_mask & STATX_MTIME)
+                e->mtime = (time_t)stx.stx_mtime.tv_sec;
+            if (stx.stx_mask & STATX_BLOCKS)
+                e->blocks = stx.stx_blocks;
+            e->stat_mask |= stx.stx_mask & (STATX_TYPE | STATX_MTIME | STATX_BLOCKS);
+            return 0;
+        }
+        if (errno != ENOSYS)
+            return -1;
+        statx_unsupported = 1;
+    }
+#endif
+    struct stat st;
+    if (fstatat(dir_fd, e->name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return -1;
+    e->type = mode_to_dtype(st.st_mode);
+    e->mtime = st.st_mtime;
+    e->blocks = (uint64_t)st.st_blocks;
+    e->stat_mask |= STATX_TYPE | STATX_MTIME | STATX_BLOCKS;
+    return 0;
+}
+
+// 判断目录项是否为目录（不跟随符号链接），d_type 未知时才触发 stat；出错返回 -1
+static int entry_is_dir(int dir_fd, DirEntry *e) {
+    if (e->type == DT_UNKNOWN && entry_stat(dir_fd, e, STATX_TYPE) != 0)
+        return -1;
+    return e->type == DT_DIR;
+}
+
+/*
+   将单个通配符模式转换为扩展正则表达式主体（不含首尾锚点），写入 out 并返回写入末尾。
+   支持 '*', '?', 字符类（含 "[!...]" 取反）、花括号候选 "{a,b}" 与 '|' 候选，
+   其余正则元字符按字面量转义；out 至少需要 strlen(wildcard) * 2 + 1 字节
+*/
+static char *append_wildcard_regex(char *out, const char *wildcard) {
+    char *p = out;
+    int brace_depth = 0;
+    for (const char *w = wildcard; *w; w++) {
+        switch (*w) {
+            case '*': *p++ = '.'; *p++ = '*'; break;
+            case '?': *p++ = '.'; break;
+            case '[': {
+                // 字符类原样复制到对应的 ']'，找不到结束符时按字面量处理
+                const char *end = w + 1;
+                if (*end == '!' || *end == '^') end++;
+                if (*end == ']') end++;
+                while (*end && *end != ']') end++;
+                if (!*end) { *p++ = '\\'; *p++ = '['; break; }
+                *p++ = '[';
+                w++;
+                if (*w == '!' || *w == '^') { *p++ = '^'; w++; }
+                while (w < end) *p++ = *w++;
+                *p++ = ']';
+                break;
+            }
+            case '{': *p++ = '('; brace_depth++; break;
+            case '}':
+                if (brace_depth > 0) { *p++ = ')'; brace_depth--; }
+                else { *p++ = '\\'; *p++ = '}'; }
+                break;
+            case ',':
+                *p++ = brace_depth > 0 ? '|' : ',';
+                break;
+            case '|': *p++ = '|'; break;
+            case '\\':
+                if (w[1]) w++;
+                /* fall through */
+            default:
+                if (strchr(".+()^$|\\{}[]*?", *w))
+                    *p++ = '\\';
+                *p++ = *w;
+        }
+    }
+    *p = '\0';
+    return p;
+}
+
+// 将通配符模式转换为正则表达式（支持 '*', '?', 字符类、花括号与 '|' 候选）
+char *wildcard_to_regex(const char *wildcard) {
+    if (!wildcard)
+        return NULL;
+    size_t len = strlen(wildcard);
+    char *regex_str = malloc(len * 2 + 5); // 分配足够空间以容纳转换后的表达式
+    if (!regex_str)
+        return NULL;
+    char *p = regex_str;
+    *p++ = '^'; // 从头开始匹配
+    *p++ = '(';
+    p = append_wildcard_regex(p, wildcard);
+    *p++ = ')';
+    *p++ = '$'; // 结束匹配
+    *p = '\0';
+    return regex_str;
+}
+
+/*
+   判断规则是否为方括号特殊规则，如 /tmp/cache/[*.tmp|*.log]：
+   最后一级组件整体由方括号包裹，且其中含有 '|'、'*' 或 '?'，以区别于普通字符类
+*/
+static int is_special_rule(const char *rule_str) {
+    const char *last = strrchr(rule_str, '/');
+    last = last ? last + 1 : rule_str;
+    size_t len = strlen(last);
+    return len >= 3 && last[0] == '[' && last[len - 1] == ']' && strpbrk(last, "|*?") != NULL;
+}
+
+// 解析特殊规则字符串，提取路径和规则模式，转换为正则表达式
+static int parse_special_rule(const char *rule_str, SpecialRule *rule) {
+    if (!rule_str || !rule)
+        return 0;
+    memset(rule, 0, sizeof(SpecialRule));
+    // 规则模式从最后一级组件开头的 '[' 开始
+    const char *path_end = strrchr(rule_str, '/');
+    path_end = path_end ? path_end + 1 : rule_str;
+    const char *p = path_end;
+    if (*p != '[')
+        return 0;
+    size_t path_len = path_end - rule_str;
+    if (path_len >= PATH_MAX)
+        return 0;
+    strncpy(rule->path, rule_str, path_len);
+    rule->path[path_len] = '\0';
+    p++;  // 跳过 '['
+    const char *regex_start = p;
+    const char *regex_end = NULL;
+    // 查找对应的 ']' 结束标记
+    while (*p) {
+        if (*p == '\\') { 
+            p++; 
+            if (*p) p++; 
+        }
+        else if (*p == ']') { 
+            regex_end = p; 
+            break; 
+        }
+        else { 
+            p++; 
+        }
+    }
+    if (!regex_end)
+        return 0;
+    size_t regex_len = regex_end - regex_start;
+    if (regex_len >= sizeof(rule->pattern))
+        return 0;
+    strncpy(rule->pattern, regex_start, regex_len);
+    rule->pattern[regex_len] = '\0';
+    char *final_regex = wildcard_to_regex(rule->pattern);
+    if (!final_regex) {
+        log_message(1, "通配符转换为正则表达式失败\n");
+        return 0;
+    }
+    if (regcomp(&rule->regex, final_regex, REG_EXTENDED | REG_NOSUB) != 0) {
+        log_message(1, "正则表达式编译失败: %s\n", final_regex);
+        free(final_regex);
+        return 0;
+    }
+    free(final_regex);
+    rule->regex_valid = 1;
+    return 1;
+}
+
+// 释放特殊规则中分配的正则表达式资源
+void free_special_rule(SpecialRule *rule) {
+    if (rule && rule->regex_valid) {
+        regfree(&rule->regex);
+        rule->regex_valid = 0;
+    }
+}
+
+/*
+   白名单索引：每次加载时将全部白名单规则编译为按路径组件划分的前缀树。
+   字面量组件通过 (父节点, 组件名) 哈希表定位子节点，通配符组件挂在每个节点的小链表上，
+   因此"是否受保护"与"其下是否存在受保护项"的查询代价只与路径深度相关，与规则条数无关。
+   节点之间以下标而非指针关联，下标 0 保留表示"无"
+*/
+typedef struct {
+    uint32_t name_off;   // 组件名在字符串池中的偏移
+    uint32_t first_glob; // 第一个通配符子节点
+    uint32_t next_glob;  // 同一父节点下的下一个通配符兄弟节点
+    uint8_t is_glob;
+    uint8_t terminal;    // 有白名单规则在此节点结束
+    uint8_t has_children;
+} WlNode;
+
+// 字面量子节点哈希表项，child 为 0 表示空槽
+typedef struct {
+    uint32_t parent;
+    uint32_t child;
+    uint32_t hash;
+} WlEdge;
+
+typedef struct {
+    WlNode *nodes;
+    uint32_t node_count, node_cap;
+    WlEdge *edges;
+    uint32_t edge_count, edge_cap;
+    char *strings;
+    uint32_t str_len, str_cap;
+} Whitelist;
+
+#define WL_ABS_ROOT 1        // 绝对路径规则的根节点
+#define WL_REL_ROOT 2        // 相对路径规则的根节点
+#define WL_PROTECTED 1       // 路径本身或其祖先命中白名单
+#define WL_HAS_PROTECTED 2   // 路径之下仍可能存在白名单项
+#define WL_MAX_STATES 64
+
+// 遍历时某一目录在前缀树中的活动节点集合；count 为 0 表示其下不可能再命中白名单
+typedef struct {
+    uint32_t count;
+    int overflow;
+    uint32_t nodes[WL_MAX_STATES];
+} WlState;
+
+// 计算组件名的 FNV-1a 哈希
+static uint32_t wl_name_hash(const char *name, size_t len) {
+    uint32_t h = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        h ^= (unsigned char)name[i];
+        h *= 16777619u;
+    }
+    return h;
+}
+
+// 将父节点下标混入组件名哈希，得到字面量边的哈希值
+static uint32_t wl_edge_hash(uint32_t parent, uint32_t name_hash) {
+    uint32_t h = name_hash ^ (parent * 0x9E3779B1u);
+    return h ? h : 1;
+}
+
+// 判断规则组件是否包含通配符
+static int component_is_glob(const char *name, size_t len) {
+    for (size_t i = 0; i < len; i++) {
+        if (name[i] == '*' || name[i] == '?' || name[i] == '[')
+            return 1;
+    }
+    return 0;
+}
+
+// 在字面量哈希表中查找 parent 下名为 name 的子节点，找不到返回 0
+static uint32_t wl_find_literal(const Whitelist *wl, uint32_t parent, const char *name, size_t len, uint32_t name_hash) {
+    if (!wl->edge_cap)
+        return 0;
+    uint32_t h = wl_edge_hash(parent, name_hash);
+    uint32_t mask = wl->edge_cap - 1;
+    for (uint32_t i = h & mask; wl->edges[i].child; i = (i + 1) & mask) {
+        const WlEdge *e = &wl->edges[i];
+        if (e->hash == h && e->parent == parent) {
+            const char *s = wl->strings + wl->nodes[e->child].name_off;
+            if (strncmp(s, name, len) == 0 && s[len] == '\0')
+                return e->child;
+        }
+    }
+    return 0;
+}
+
+// 将边插入哈希表（调用方保证容量足够）
+static void wl_insert_edge(WlEdge *edges, uint32_t cap, uint32_t parent, uint32_t child, uint32_t h) {
+    uint32_t mask = cap - 1;
+    uint32_t i = h & mask;
+    while (edges[i].child)
+        i = (i + 1) & mask;
+    edges[i].parent = parent;
+    edges[i].child = child;
+    edges[i].hash = h;
+}
+
+// 负载超过一半时将字面量哈希表扩容一倍
+static int wl_reserve_edge(Whitelist *wl) {
+    if ((wl->edge_count + 1) * 2 <= wl->edge_cap)
+        return 1;
+    uint32_t cap = wl->edge_cap ? wl->edge_cap * 2 : 64;
+    WlEdge *edges = calloc(cap, sizeof(WlEdge));
+    if (!edges)
+        return 0;
+    for (uint32_t i = 0; i < wl->edge_cap; i++) {
+        if (wl->edges[i].child)
+            wl_insert_edge(edges, cap, wl->edges[i].parent, wl->edges[i].child, wl->edges[i].hash);
+    }
+    free(wl->edges);
+    wl->edges = edges;
+    wl->edge_cap = cap;
+    return 1;
+}
+
+// 新建节点并把组件名存入字符串池，返回节点下标，失败返回 0
+static uint32_t wl_new_node(Whitelist *wl, const char *name, size_t len, int is_glob) {
+    if (wl->node_count == wl->node_cap) {
+        uint32_t cap = wl->node_cap ? wl->node_cap * 2 : 64;
+        WlNode *nodes = realloc(wl->nodes, cap * sizeof(WlNode));
+        if (!nodes)
+            return 0;
+        wl->nodes = nodes;
+        wl->node_cap = cap;
+    }
+    if (wl->str_len + len + 1 > wl->str_cap) {
+        uint32_t cap = wl->str_cap ? wl->str_cap : 1024;
+        while (wl->str_len + len + 1 > cap)
+            cap *= 2;
+        char *strings = realloc(wl->strings, cap);
+        if (!strings)
+            return 0;
+        wl->strings = strings;
+        wl->str_cap = cap;
+    }
+    uint32_t id = wl->node_count++;
+    WlNode *node = &wl->nodes[id];
+    memset(node, 0, sizeof(*node));
+    node->name_off = wl->str_len;
+    node->is_glob = (uint8_t)is_glob;
+    memcpy(wl->strings + wl->str_len, name, len);
+    wl->strings[wl->str_len + len] = '\0';
+    wl->str_len += len + 1;
+    return id;
+}
+
+// 取得 parent 下名为 name 的子节点，不存在时创建，失败返回 0
+static uint32_t wl_get_child(Whitelist *wl, uint32_t parent, const char *name, size_t len) {
+    uint32_t child;
+    if (component_is_glob(name, len)) {
+        for (child = wl->nodes[parent].first_glob; child; child = wl->nodes[child].next_glob) {
+            const char *s = wl->strings + wl->nodes[child].name_off;
+            if (strncmp(s, name, len) == 0 && s[len] == '\0')
+                return child;
+        }
+        if (!(child = wl_new_node(wl, name, len, 1)))
+            return 0;
+        wl->nodes[child].next_glob = wl->nodes[parent].first_glob;
+        wl->nodes[parent].first_glob = child;
+    } else {
+        uint32_t name_hash = wl_name_hash(name, len);
+        if ((child = wl_find_literal(wl, parent, name, len, name_hash)))
+            return child;
+        if (!wl_reserve_edge(wl) || !(child = wl_new_node(wl, name, len, 0)))
+            return 0;
+        wl_insert_edge(wl->edges, wl->edge_cap, parent, child, wl_edge_hash(parent, name_hash));
+        wl->edge_count++;
+    }
+    wl->nodes[parent].has_children = 1;
+    return child;
+}
+
+// 释放白名单索引
+void whitelist_free(Whitelist *wl) {
+    if (!wl)
+        return;
+    free(wl->nodes);
+    free(wl->edges);
+    free(wl->strings);
+    memset(wl, 0, sizeof(*wl));
+}
+
+// 将白名单规则数组编译为前缀树索引，返回收录的规则数，内存不足时返回 -1
+int whitelist_compile(char **lines, int count, Whitelist *wl) {
+    memset(wl, 0, sizeof(*wl));
+    // 依次创建保留节点 0 以及绝对、相对路径两个根节点
+    wl_new_node(wl, "", 0, 0);
+    if (wl->node_count != 1 || wl_new_node(wl, "/", 1, 0) != WL_ABS_ROOT ||
+        wl_new_node(wl, ".", 1, 0) != WL_REL_ROOT) {
+        whitelist_free(wl);
+        return -1;
+    }
+    int added = 0;
+    for (int i = 0; i < count; i++) {
+        const char *p = lines[i];
+        if (!p || !*p)
+            continue;
+        uint32_t node = (*p == '/') ? WL_ABS_ROOT : WL_REL_ROOT;
+        while (*p) {
+            while (*p == '/')
+                p++;
+            if (!*p)
+                break;
+            const char *end = strchr(p, '/');
+            size_t len = end ? (size_t)(end - p) : strlen(p);
+            if (!(node = wl_get_child(wl, node, p, len))) {
+                whitelist_free(wl);
+                return -1;
+            }
+            p += len;
+        }
+        wl->nodes[node].terminal = 1;
+        added++;
+    }
+    return added;
+}
+
+// 将节点加入活动集合（去重），集合溢出时记录标志
+static void wl_state_add(WlState *state, uint32_t node) {
+    for (uint32_t i = 0; i < state->count; i++) {
+        if (state->nodes[i] == node)
+            return;
+    }
+    if (state->count < WL_MAX_STATES)
+        state->nodes[state->count++] = node;
+    else
+        state->overflow = 1;
+}
+
+/*
+   由父目录的活动集合推进到名为 name 的子项，返回子项的 WL_* 标志并填充其活动集合。
+   返回 0 且 out->count 为 0 时，该子项及其整棵子树都无需再查询白名单
+*/
+int whitelist_step(const Whitelist *wl, const WlState *in, const char *name, WlState *out) {
+    out->count = 0;
+    out->overflow = in->overflow;
+    size_t len = strlen(name);
+    uint32_t name_hash = wl_name_hash(name, len);
+    for (uint32_t i = 0; i < in->count; i++) {
+        uint32_t parent = in->nodes[i];
+        uint32_t child = wl_find_literal(wl, parent, name, len, name_hash);
+        if (child)
+            wl_state_add(out, child);
+        for (child = wl->nodes[parent].first_glob; child; child = wl->nodes[child].next_glob) {
+            if (fnmatch(wl->strings + wl->nodes[child].name_off, name, 0) == 0)
+                wl_state_add(out, child);
+        }
+    }
+    // 活动集合溢出时保守地视为受保护
+    if (out->overflow)
+        return WL_PROTECTED;
+    int flags = 0;
+    for (uint32_t i = 0; i < out->count; i++) {
+        if (wl->nodes[out->nodes[i]].terminal)
+            flags |= WL_PROTECTED;
+        if (wl->nodes[out->nodes[i]].has_children)
+            flags |= WL_HAS_PROTECTED;
+    }
+    return flags;
+}
+
+// 按路径逐级推进，得到该路径的 WL_* 标志及活动集合；一旦某级祖先受保护即返回
+int whitelist_state_init(const Whitelist *wl, const char *path, WlState *state) {
+    state->count = 0;
+    state->overflow = 0;
+    if (!wl || !wl->nodes || !path)
+        return 0;
+    WlState next;
+    state->nodes[state->count++] = (*path == '/') ? WL_ABS_ROOT : WL_REL_ROOT;
+    int flags = wl->nodes[state->nodes[0]].has_children ? WL_HAS_PROTECTED : 0;
+    const char *p = path;
+    char name[NAME_MAX + 1];
+    while (*p) {
+        while (*p == '/')
+            p++;
+        if (!*p)
+            break;
+        const char *end = strchr(p, '/');
+        size_t len = end ? (size_t)(end - p) : strlen(p);
+        size_t copy_len = len > NAME_MAX ? NAME_MAX : len;
+        memcpy(name, p, copy_len);
+        name[copy_len] = '\0';
+        flags = whitelist_step(wl, state, name, &next);
+        *state = next;
+        if (flags & WL_PROTECTED)
+            return flags;
+        if (!state->count)
+            return 0;
+        p += len;
+    }
+    return flags;
+}
+
+/* 
+   白名单判断函数：路径本身或其祖先命中白名单，或者其子路径在白名单中，
+   都视为受保护，不进行删除处理 
+*/
+int is_in_whitelist(const char *path, const Whitelist *wl) {
+    WlState state;
+    return path && whitelist_state_init(wl, path, &state) != 0;
+}
+
+/* 
+   将配置文件内容按行读取，忽略空行和以 '#' 开头的注释行，
+   每行代表一条规则并存入数组中；返回规则条数，无法读取或内存不足时返回 -1
+*/
+int read_file_to_array(const char *filename, char ***array) {
+    if (!filename || !array)
+        return -1;
+    FILE *file = fopen(filename, "r");
+    if (!file) {
+        log_message(1, "无法打开文件: %s, 错误: %s\n", filename, strerror(errno));
+        return -1;
+    }
+    char *line = NULL;
+    size_t line_len = 0;
+    ssize_t read;
+    int count = 0, capacity = 10;
+    char **temp_array = malloc(sizeof(char*) * capacity);
+    if (!temp_array) {
+        log_message(1, "内存分配失败: temp_array\n");
+        fclose(file);
+        return -1;
+    }
+    while ((read = getline(&line, &line_len, file)) != -1) {
+        if (read > 0 && line[read - 1] == '\n')
+            line[read - 1] = '\0';
+        if (line[0] == '#' || line[0] == '\0')
+            continue;
+        if (count >= capacity) {
+            capacity *= 2;
+            char **new_array = realloc(temp_array, sizeof(char*) * capacity);
+            if (!new_array) {
+                log_message(1, "内存重分配失败: new_array\n");
+                for (int j = 0; j < count; j++)
+                    free(temp_array[j]);
+                free(temp_array); 
+                free(line); 
+                fclose(file);
+                return -1;
+            }
+            temp_array = new_array;
+        }
+        temp_array[count] = strdup(line);
+        if (!temp_array[count]) {
+            log_message(1, "内存分配失败: temp_array[%d]\n", count);
+            for (int j = 0; j < count; j++)
+                free(temp_array[j]);
+            free(temp_array);
+            free(line);
+            fclose(file);
+            return -1;
+        }
+        count++;
+    }
+    free(line);
+    fclose(file);
+    *array = temp_array;
+    log_message(2, "成功从 %s 中读取 %d 条规则\n", filename, count);
+    return count;
+}
+
+// 释放保存规则的字符串数组
+void free_array(char **array, int count) {
+    if (!array)
+        return;
+    for (int i = 0; i < count; i++)
+        free(array[i]);
+    free(array);
+}
+
+/*
+   FUSE 绕行：安卓的 /sdcard、/storage/emulated 由 FUSE 守护进程提供，经过它的每次 lstat、unlink
+   都要在内核与守护进程之间往返一次，是逐个删除文件时最大的单项开销。路径映射给出这些前缀对应的
+   下层文件系统路径（/data/media），每次编译规则时按挂载表确认前缀当前确实位于 FUSE（或旧系统的
+   sdcardfs）上，再把三个规则文件中以其开头的规则改写为下层路径后编译；前缀不在 FUSE 上（尚未挂载、
+   非安卓系统）或下层目录不存在时该项不生效，规则保持原样。
+   规则原始行不变，按单条规则执行与开销报告仍使用规则文件中的写法
+*/
+static void path_map_free(PathMap *m) {
+    for (uint32_t i = 0; i < m->count; i++) {
+        free(m->items[i].from);
+        free(m->items[i].to);
+    }
+    free(m->items);
+    memset(m, 0, sizeof(*m));
+}
+
+static int grow_array(void **array, uint32_t *cap, size_t elem_size, uint32_t need);
+
+// 解析 "前缀=下层路径,..." 形式的映射，去除末尾斜杠；格式错误的项记录日志后忽略。内存不足时返回 -1
+static int path_map_parse(PathMap *m, const char *spec) {
+    memset(m, 0, sizeof(*m));
+    char *copy = strdup(spec ? spec : "");
+    if (!copy)
+        return -1;
+    char *save = NULL;
+    for (char *item = strtok_r(copy, ",", &save); item; item = strtok_r(NULL, ",", &save)) {
+        char *to = strchr(item, '=');
+        if (to)
+            *to++ = '\0';
+        size_t from_len = strlen(item), to_len = to ? strlen(to) : 0;
+        while (from_len > 1 && item[from_len - 1] == '/')
+            item[--from_len] = '\0';
+        while (to_len > 1 && to[to_len - 1] == '/')
+            to[--to_len] = '\0';
+        if (!to || item[0] != '/' || to[0] != '/' || from_len < 2) {
+            log_message(1, "无效的路径映射，已忽略: %s\n", item);
+            continue;
+        }
+        if (!grow_array((void **)&m->items, &m->cap, sizeof(PathMapEntry), m->count + 1)) {
+            free(copy);
+            path_map_free(m);
+            return -1;
+        }
+        PathMapEntry *e = &m->items[m->count];
+        e->from = strdup(item);
+        e->to = strdup(to);
+        e->from_len = from_len;
+        e->active = 0;
+        if (!e->from || !e->to) {
+            free(e->from);
+            free(e->to);
+            free(copy);
+            path_map_free(m);
+            return -1;
+        }
+        m->count++;
+    }
+    free(copy);
+    return 0;
+}
+
+// 路径 prefix（长度 len）是否等于 path 或是它的上级目录
+static int path_has_prefix(const char *path, const char *prefix, size_t len) {
+    return strncmp(path, prefix, len) == 0 && (path[len] == '\0' || path[len] == '/' || (len == 1 && *prefix == '/'));
+}
+
+// 挂载表中的路径以 \ooo 八进制转义空白与反斜杠，原地还原
+static void mountinfo_unescape(char *s) {
+    char *out = s;
+    while (*s) {
+        if (s[0] == '\\' && s[1] >= '0' && s[1] <= '3' && s[2] >= '0' && s[2] <= '7' && s[3] >= '0' && s[3] <= '7') {
+            *out++ = (char)((s[1] - '0') << 6 | (s[2] - '0') << 3 | (s[3] - '0'));
+            s += 4;
+        } else {
+            *out++ = *s++;
+        }
+    }
+    *out = '\0';
+}
+
+/*
+   按挂载表（/proc/self/mountinfo 格式）重新确定各映射项是否生效：前缀解析符号链接后
+   （/sdcard 通常指向 /storage/emulated/0）取最长匹配的挂载点，同一挂载点出现多次时以后出现的（上层）为准，
+   其文件系统类型为 fuse、fuse.* 或 sdcardfs 且下层路径是目录时生效。
+   返回生效项的哈希，没有生效项或挂载表无法读取时返回 0；规则包只在哈希相同时沿用
+*/
+static uint32_t path_map_detect(PathMap *m, const char *mountinfo) {
+    if (!m->count)
+        return 0;
+    FILE *file = fopen(mountinfo, "r");
+    if (!file) {
+        log_message(1, "无法读取挂载表: %s, 错误: %s\n", mountinfo, strerror(errno));
+        for (uint32_t i = 0; i < m->count; i++)
+            m->items[i].active = 0;
+        return 0;
+    }
+    char **resolved = calloc(m->count, sizeof(char *));
+    size_t *best = calloc(m->count, sizeof(size_t));
+    int *fuse = calloc(m->count, sizeof(int));
+    for (uint32_t i = 0; resolved && i < m->count; i++)
+        resolved[i] = realpath(m->items[i].from, NULL);
+    char *line = NULL;
+    size_t line_len = 0;
+    while (resolved && best && fuse && getline(&line, &line_len, file) != -1) {
+        // 挂载 ID、父 ID、设备号、根、挂载点、选项、可选字段... " - " 文件系统类型、来源、超级块选项
+        char *sep = strstr(line, " - ");
+        char *save = NULL, *mount_point = NULL;
+        char *tok = strtok_r(line, " ", &save);
+        for (int field = 1; tok && field < 5; field++)
+            tok = strtok_r(NULL, " ", &save);
+        mount_point = tok;
+        if (!sep || !mount_point || mount_point > sep)
+            continue;
+        char *fstype = strtok_r(sep + 3, " \n", &save);
+        if (!fstype)
+            continue;
+        mountinfo_unescape(mount_point);
+        size_t mp_len = strlen(mount_point);
+        int is_fuse = strcmp(fstype, "fuse") == 0 || strncmp(fstype, "fuse.", 5) == 0 || strcmp(fstype, "sdcardfs") == 0;
+        for (uint32_t i = 0; i < m->count; i++) {
+            const char *path = resolved[i] ? resolved[i] : m->items[i].from;
+            if (mp_len >= best[i] && path_has_prefix(path, mount_point, mp_len)) {
+                best[i] = mp_len;
+                fuse[i] = is_fuse;
+            }
+        }
+    }
+    free(line);
+    fclose(file);
+    uint32_t hash = 0;
+    int any = 0;
+    for (uint32_t i = 0; i < m->count; i++) {
+        PathMapEntry *e = &m->items[i];
+        struct stat st;
+        e->active = fuse && fuse[i] && stat(e->to, &st) == 0 && S_ISDIR(st.st_mode);
+        if (e->active) {
+            any = 1;
+            hash = (hash * 16777619u) ^ wl_name_hash(e->from, e->from_len) ^ (wl_name_hash(e->to, strlen(e->to)) << 1);
+            log_message(2, "%s 位于 FUSE 上，规则改写为 %s\n", e->from, e->to);
+        }
+    }
+    if (resolved) {
+        for (uint32_t i = 0; i < m->count; i++)
+            free(resolved[i]);
+    }
+    free(resolved);
+    free(best);
+    free(fuse);
+    return any && !hash ? 1 : hash;
+}
+
+// 按生效的映射改写一条规则（取最长的匹配前缀），返回新分配的字符串；无需改写或内存不足时返回 NULL
+static char *path_map_apply(const PathMap *m, const char *line) {
+    const PathMapEntry *match = NULL;
+    for (uint32_t i = 0; i < m->count; i++) {
+        const PathMapEntry *e = &m->items[i];
+        if (e->active && (!match || e->from_len > match->from_len) &&
+            strncmp(line, e->from, e->from_len) == 0 && (line[e->from_len] == '\0' || line[e->from_len] == '/'))
+            match = e;
+    }
+    if (!match)
+        return NULL;
+    size_t to_len = strlen(match->to), rest = strlen(line + match->from_len);
+    char *out = malloc(to_len + rest + 1);
+    if (out) {
+        memcpy(out, match->to, to_len);
+        memcpy(out + to_len, line + match->from_len, rest + 1);
+    }
+    return out;
+}
+
+/*
+   改写一组规则供编译使用：返回的数组中未改写的项与 lines 共用字符串，没有生效的映射时直接返回 lines。
+   内存不足时返回 NULL
+*/
+static char **path_map_lines(const PathMap *m, char **lines, int count) {
+    int any = 0;
+    for (uint32_t i = 0; i < m->count; i++)
+        any |= m->items[i].active;
+    if (!any || !count)
+        return lines;
+    char **out = malloc(sizeof(char *) * count);
+    if (!out)
+        return NULL;
+    for (int i = 0; i < count; i++) {
+        char *mapped = lines[i] ? path_map_apply(m, lines[i]) : NULL;
+        out[i] = mapped ? mapped : lines[i];
+    }
+    return out;
+}
+
+static void path_map_lines_free(char **mapped, char **lines, int count) {
+    if (!mapped || mapped == lines)
+        return;
+    for (int i = 0; i < count; i++) {
+        if (mapped[i] != lines[i])
+            free(mapped[i]);
+    }
+    free(mapped);
+}
+
+// 根据已获取的修改时间检查文件或目录自上次修改后的时间间隔是否超过指定天数
+int is_expired(time_t mtime, int days) {
+    if (days < 0)
+        return 0;
+    time_t current_time = time(NULL);
+    if (current_time == (time_t)-1) {
+        log_message(1, "警告：获取当前时间失败\n");
+        return 0;
+    }
+    double diff_time = difftime(current_time, mtime);
+    return (diff_time > (double)days * 24 * 3600);
+}
+
+// 判断目录项是否已过期，仅在此时才按需获取 mtime；获取失败视为未过期，path 仅用于日志
+static int entry_is_expired(int dir_fd, DirEntry *e, const char *path, int days) {
+    // 需要统计释放空间时顺带取回块数，避免再次 statx
+    if (entry_stat(dir_fd, e, STATX_MTIME | engine->stats_stat_mask) != 0) {
+        log_message(1, "无法获取文件信息: %s, 错误: %s\n", path, strerror(errno));
+        return 0;
+    }
+    return is_expired(e->mtime, days);
+}
+
+/*
+   黑名单名称匹配器：把作用于同一目录的全部文件名模式合并成一个自动机，
+   每个文件名只需扫描一遍，开销不随规则条数增长。
+   常见形态走无需正则的快速路径：纯字面量（哈希表）、前缀 "abc*"（正向字符前缀树）、
+   后缀 "*.log"（反向字符前缀树）、"*"（直接命中）；其余通用模式合并为一条正则表达式，
+   只在其命中后才逐条确认具体是哪条规则。所有结构均以下标关联
+*/
+typedef struct {
+    uint32_t first_child;
+    uint32_t next_sibling;
+    int32_t rule;        // 在此结束的规则编号，-1 表示无
+    unsigned char ch;
+} CharNode;
+
+typedef struct {
+    uint32_t hash;
+    uint32_t name_off;
+    int32_t rule;        // -1 表示空槽
+} NameLiteral;
+
+typedef struct {
+    uint32_t pattern_off;
+    int32_t rule;
+} NameGlob;
+
+typedef struct {
+    NameLiteral *literals;
+    uint32_t lit_count, lit_cap;
+    CharNode *prefix;
+    uint32_t prefix_count, prefix_cap;
+    CharNode *suffix;
+    uint32_t suffix_count, suffix_cap;
+    NameGlob *globs;
+    uint32_t glob_count, glob_cap;
+    int32_t any_rule;
+    regex_t glob_regex;
+    int glob_regex_valid;
+    char *strings;
+    uint32_t str_len, str_cap;
+} NameSet;
+
+// 名称模式的快速路径分类
+enum { PAT_LITERAL, PAT_PREFIX, PAT_SUFFIX, PAT_ANY, PAT_GLOB };
+
+// 按需扩容数组，保证至少能容纳 need 个元素
+static int grow_array(void **array, uint32_t *cap, size_t elem_size, uint32_t need) {
+    if (need <= *cap)
+        return 1;
+    uint32_t new_cap = *cap ? *cap : 16;
+    while (new_cap < need)
+        new_cap *= 2;
+    void *p = realloc(*array, (size_t)new_cap * elem_size);
+    if (!p)
+        return 0;
+    *array = p;
+    *cap = new_cap;
+    return 1;
+}
+
+// 将字符串存入字符串池，返回偏移；失败返回 UINT32_MAX
+static uint32_t pool_add_string(char **strings, uint32_t *len, uint32_t *cap, const char *s, size_t n) {
+    if (!grow_array((void **)strings, cap, 1, *len + (uint32_t)n + 1))
+        return UINT32_MAX;
+    uint32_t off = *len;
+    memcpy(*strings + off, s, n);
+    (*strings)[off + n] = '\0';
+    *len += (uint32_t)n + 1;
+    return off;
+}
+
+// 对模式分类，并给出快速路径所需的字面量部分
+static int classify_pattern(const char *pat, const char **text, size_t *text_len) {
+    size_t len = strlen(pat);
+    *text = pat;
+    *text_len = len;
+    if (strpbrk(pat, "\\[") != NULL)
+        return PAT_GLOB;
+    const char *star = strchr(pat, '*');
+    if (!strchr(pat, '?')) {
+        if (!star)
+            return PAT_LITERAL;
+        if (len == 1)
+            return PAT_ANY;
+        if (star == pat && !strchr(pat + 1, '*')) {
+            *text = pat + 1;
+            *text_len = len - 1;
+            return PAT_SUFFIX;
+        }
+        if (star == pat + len - 1) {
+            *text_len = len - 1;
+            return PAT_PREFIX;
+        }
+    }
+    return PAT_GLOB;
+}
+
+// 初始化名称匹配器
+static void nameset_init(NameSet *ns) {
+    memset(ns, 0, sizeof(*ns));
+    ns->any_rule = -1;
+}
+
+// 释放名称匹配器
+static void nameset_free(NameSet *ns) {
+    free(ns->literals);
+    free(ns->prefix);
+    free(ns->suffix);
+    free(ns->globs);
+    free(ns->strings);
+    if (ns->glob_regex_valid)
+        regfree(&ns->glob_regex);
+    nameset_init(ns);
+}
+
+// 向字符前缀树插入一个串（reverse 为真时从末尾倒序插入），保留最先插入的规则编号
+static int chartrie_insert(CharNode **nodes, uint32_t *count, uint32_t *cap,
+    const char *s, size_t len, int reverse, int32_t rule) {
+    if (*count == 0) {
+        if (!grow_array((void **)nodes, cap, sizeof(CharNode), 1))
+            return 0;
+        memset(&(*nodes)[0], 0, sizeof(CharNode));
+        (*nodes)[0].rule = -1;
+        *count = 1;
+    }
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        unsigned char ch = (unsigned char)s[reverse ? len - 1 - i : i];
+        uint32_t child = (*nodes)[node].first_child;
+        while (child && (*nodes)[child].ch != ch)
+            child = (*nodes)[child].next_sibling;
+        if (!child) {
+            if (!grow_array((void **)nodes, cap, sizeof(CharNode), *count + 1))
+                return 0;
+            child = (*count)++;
+            CharNode *c = &(*nodes)[child];
+            c->ch = ch;
+            c->rule = -1;
+            c->first_child = 0;
+            c->next_sibling = (*nodes)[node].first_child;
+            (*nodes)[node].first_child = child;
+        }
+        node = child;
+    }
+    if ((*nodes)[node].rule < 0)
+        (*nodes)[node].rule = rule;
+    return 1;
+}
+
+// 沿字符前缀树匹配名称，返回途经的第一个规则编号，未命中返回 -1
+static int32_t chartrie_match(const CharNode *nodes, uint32_t count, const char *s, size_t len, int reverse) {
+    if (!count)
+        return -1;
+    uint32_t node = 0;
+    for (size_t i = 0; i < len; i++) {
+        if (nodes[node].rule >= 0)
+            return nodes[node].rule;
+        unsigned char ch = (unsigned char)s[reverse ? len - 1 - i : i];
+        uint32_t child = nodes[node].first_child;
+        while (child && nodes[child].ch != ch)
+            child = nodes[child].next_sibling;
+        if (!child)
+            return -1;
+        node = child;
+    }
+    return nodes[node].rule;
+}
+
+// 在字面量哈希表中查找名称
+static int32_t nameset_find_literal(const NameSet *ns, const char *name, size_t len, uint32_t hash) {
+    if (!ns->lit_cap)
+        return -1;
+    uint32_t mask = ns->lit_cap - 1;
+    for (uint32_t i = hash & mask; ns->literals[i].rule >= 0; i = (i + 1) & mask) {
+        const NameLiteral *l = &ns->literals[i];
+        if (l->hash == hash && strncmp(ns->strings + l->name_off, name, len) == 0 &&
+            ns->strings[l->name_off + len] == '\0')
+            return l->rule;
+    }
+    return -1;
+}
+
+// 向字面量哈希表加入名称，负载超过一半时扩容
+static int nameset_add_literal(NameSet *ns, const char *name, size_t len, int32_t rule) {
+    uint32_t hash = wl_name_hash(name, len);
+    if (nameset_find_literal(ns, name, len, hash) >= 0)
+        return 1;
+    if ((ns->lit_count + 1) * 2 > ns->lit_cap) {
+        uint32_t cap = ns->lit_cap ? ns->lit_cap * 2 : 16;
+        NameLiteral *table = malloc(cap * sizeof(NameLiteral));
+        if (!table)
+            return 0;
+        for (uint32_t i = 0; i < cap; i++)
+            table[i].rule = -1;
+        for (uint32_t i = 0; i < ns->lit_cap; i++) {
+            if (ns->literals[i].rule < 0)
+                continue;
+            uint32_t j = ns->literals[i].hash & (cap - 1);
+            while (table[j].rule >= 0)
+                j = (j + 1) & (cap - 1);
+            table[j] = ns->literals[i];
+        }
+        free(ns->literals);
+        ns->literals = table;
+        ns->lit_cap = cap;
+    }
+    uint32_t off = pool_add_string(&ns->strings, &ns->str_len, &ns->str_cap, name, len);
+    if (off == UINT32_MAX)
+        return 0;
+    uint32_t i = hash & (ns->lit_cap - 1);
+    while (ns->literals[i].rule >= 0)
+        i = (i + 1) & (ns->lit_cap - 1);
+    ns->literals[i].hash = hash;
+    ns->literals[i].name_off = off;
+    ns->literals[i].rule = rule;
+    ns->lit_count++;
+    return 1;
+}
+
+// 向名称匹配器加入一个（已展开花括号的）模式
+static int nameset_add_pattern(NameSet *ns, const char *pat, int32_t rule) {
+    const char *text;
+    size_t len;
+    switch (classify_pattern(pat, &text, &len)) {
+        case PAT_LITERAL:
+            return nameset_add_literal(ns, text, len, rule);
+        case PAT_ANY:
+            if (ns->any_rule < 0)
+                ns->any_rule = rule;
+            return 1;
+        case PAT_PREFIX:
+            return chartrie_insert(&ns->prefix, &ns->prefix_count, &ns->prefix_cap, text, len, 0, rule);
+        case PAT_SUFFIX:
+            return chartrie_insert(&ns->suffix, &ns->suffix_count, &ns->suffix_cap, text, len, 1, rule);
+        default: {
+            if (!grow_array((void **)&ns->globs, &ns->glob_cap, sizeof(NameGlob), ns->glob_count + 1))
+                return 0;
+            uint32_t off = pool_add_string(&ns->strings, &ns->str_len, &ns->str_cap, pat, strlen(pat));
+            if (off == UINT32_MAX)
+                return 0;
+            ns->globs[ns->glob_count].pattern_off = off;
+            ns->globs[ns->glob_count].rule = rule;
+            ns->glob_count++;
+            return 1;
+        }
+    }
+}
+
+/*
+   展开模式中的第一组花括号候选并递归加入，如 "*.{log,tmp}" 展开为 "*.log" 与 "*.tmp"；
+   depth 用于限制嵌套展开的层数
+*/
+static int nameset_add_expanded(NameSet *ns, const char *pat, int32_t rule, int depth) {
+    const char *open = NULL;
+    for (const char *p = pat; *p; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        } else if (*p == '{') {
+            open = p;
+            break;
+        }
+    }
+    const char *close = NULL;
+    int level = 0;
+    if (open) {
+        for (const char *p = open; *p; p++) {
+            if (*p == '\\' && p[1]) p++;
+            else if (*p == '{') level++;
+            else if (*p == '}' && --level == 0) { close = p; break; }
+        }
+    }
+    if (!open || !close || depth > 8)
+        return nameset_add_pattern(ns, pat, rule);
+    size_t head = open - pat;
+    size_t tail = strlen(close + 1);
+    const char *alt = open + 1;
+    level = 0;
+    for (const char *p = alt; p <= close; p++) {
+        if (*p == '\\' && p[1]) { p++; continue; }
+        if (*p == '{') level++;
+        else if (*p == '}' && level > 0) { level--; continue; }
+        if ((*p == ',' && level == 0) || p == close) {
+            size_t alt_len = p - alt;
+            char *expanded = malloc(head + alt_len + tail + 1);
+            if (!expanded)
+                return 0;
+            memcpy(expanded, pat, head);
+            memcpy(expanded + head, alt, alt_len);
+            memcpy(expanded + head + alt_len, close + 1, tail + 1);
+            int ok = nameset_add_expanded(ns, expanded, rule, depth + 1);
+            free(expanded);
+            if (!ok)
+                return 0;
+            alt = p + 1;
+        }
+    }
+    return 1;
+}
+
+// 将名称模式文本（可含 '|' 分隔的多个候选）加入匹配器
+static int nameset_add(NameSet *ns, const char *text, int32_t rule) {
+    char *copy = strdup(text);
+    if (!copy)
+        return 0;
+    int ok = 1;
+    char *start = copy;
+    for (char *p = copy; ok; p++) {
+        if (*p == '\\' && p[1]) {
+            p++;
+        } else if (*p == '|' || *p == '\0') {
+            int last = (*p == '\0');
+            *p = '\0';
+            if (*start)
+                ok = nameset_add_expanded(ns, start, rule, 0);
+            if (last)
+                break;
+            start = p + 1;
+        }
+    }
+    free(copy);
+    return ok;
+}
+
+// 所有模式加入后，把通用模式合并编译为一条正则表达式
+static int nameset_finalize(NameSet *ns) {
+    if (!ns->glob_count)
+        return 1;
+    size_t size = 1;
+    for (uint32_t i = 0; i < ns->glob_count; i++)
+        size += strlen(ns->strings + ns->globs[i].pattern_off) * 2 + 6;
+    char *regex_str = malloc(size);
+    if (!regex_str)
+        return 0;
+    char *p = regex_str;
+    for (uint32_t i = 0; i < ns->glob_count; i++) {
+        if (i)
+            *p++ = '|';
+        *p++ = '^';
+        *p++ = '(';
+        p = append_wildcard_regex(p, ns->strings + ns->globs[i].pattern_off);
+        *p++ = ')';
+        *p++ = '$';
+    }
+    *p = '\0';
+    int ok = regcomp(&ns->glob_regex, regex_str, REG_EXTENDED | REG_NOSUB) == 0;
+    if (!ok)
+        log_message(1, "正则表达式编译失败: %s\n", regex_str);
+    ns->glob_regex_valid = ok;
+    free(regex_str);
+    return ok;
+}
+
+// 匹配文件名，返回命中的规则编号，未命中返回 -1
+static int32_t nameset_match(const NameSet *ns, const char *name) {
+    if (ns->any_rule >= 0)
+        return ns->any_rule;
+    size_t len = strlen(name);
+    int32_t rule;
+    if (ns->lit_count && (rule = nameset_find_literal(ns, name, len, wl_name_hash(name, len))) >= 0)
+        return rule;
+    if ((rule = chartrie_match(ns->suffix, ns->suffix_count, name, len, 1)) >= 0)
+        return rule;
+    if ((rule = chartrie_match(ns->prefix, ns->prefix_count, name, len, 0)) >= 0)
+        return rule;
+    if (ns->glob_regex_valid && regexec(&ns->glob_regex, name, 0, NULL, 0) == 0) {
+        // 合并正则命中后再逐条确认具体规则，未命中的名称不会走到这里
+        for (uint32_t i = 0; i < ns->glob_count; i++) {
+            if (fnmatch(ns->strings + ns->globs[i].pattern_off, name, 0) == 0)
+                return ns->globs[i].rule;
+        }
+        return ns->globs[0].rule;
+    }
+    return -1;
+}
+
+/* 
+   黑名单规则编译结果：每条规则在加载时拆分为不含通配符的根目录、
+   中间各级目录模式与叶子名称模式。根目录、中间模式和匹配方式都相同的规则归为一组，
+   组内所有叶子模式合并进同一个名称匹配器，每个目录只扫描一次
+*/
+enum {
+    RULE_ONCE,       // 叶子只匹配基目录下的直接子项，如 /a/*.log
+    RULE_ANY_DEPTH,  // "**" 规则：叶子匹配基目录下任意深度的子项，如 /a/**/*.log
+    RULE_FILTER,     // 方括号规则：只删除基目录下任意深度内名称匹配的文件，如 /a/[*.tmp|*.log]
+    RULE_QUOTA       // 配额规则：命中的目录保持在配额以内，超出时从最旧的文件开始删除，如 /a/cache @200M
+};
+
+typedef struct {
+    char *root;          // 规则开头不含通配符的目录部分
+    char **middle;       // 根目录与叶子之间的各级目录模式
+    int middle_count;
+    int mode;
+    int literal_only;    // 叶子全为字面量：按名称直接探测，无需扫描目录
+    uint64_t quota;      // RULE_QUOTA 的字节配额
+    NameSet names;
+    RuleProfile *prof;   // 本组的开销计数，不剖析时为空
+} RuleGroup;
+
+typedef struct {
+    RuleGroup *groups;
+    uint32_t group_count, group_cap;
+    int rule_count;
+} Blacklist;
+
+// 释放黑名单规则组
+void blacklist_free(Blacklist *bl) {
+    if (!bl)
+        return;
+    for (uint32_t i = 0; i < bl->group_count; i++) {
+        RuleGroup *g = &bl->groups[i];
+        free(g->root);
+        free_array(g->middle, g->middle_count);
+        nameset_free(&g->names);
+    }
+    free(bl->groups);
+    memset(bl, 0, sizeof(*bl));
+}
+
+// 查找或新建与给定根目录、中间模式和匹配方式一致的规则组
+static RuleGroup *blacklist_get_group(Blacklist *bl, const char *root, char **middle, int middle_count, int mode, uint64_t quota) {
+    for (uint32_t i = 0; i < bl->group_count; i++) {
+        RuleGroup *g = &bl->groups[i];
+        if (g->mode != mode || g->quota != quota || g->middle_count != middle_count || strcmp(g->root, root) != 0)
+            continue;
+        int same = 1;
+        for (int j = 0; j < middle_count && same; j++)
+            same = strcmp(g->middle[j], middle[j]) == 0;
+        if (same)
+            return g;
+    }
+    if (!grow_array((void **)&bl->groups, &bl->group_cap, sizeof(RuleGroup), bl->group_count + 1))
+        return NULL;
+    RuleGroup *g = &bl->groups[bl->group_count];
+    memset(g, 0, sizeof(*g));
+    nameset_init(&g->names);
+    g->mode = mode;
+    g->quota = quota;
+    g->literal_only = (mode == RULE_ONCE || mode == RULE_QUOTA);
+    g->root = strdup(root);
+    g->middle = middle_count ? calloc(middle_count, sizeof(char *)) : NULL;
+    if (!g->root || (middle_count && !g->middle)) {
+        free(g->root);
+        free(g->middle);
+        return NULL;
+    }
+    g->middle_count = middle_count;
+    for (int j = 0; j < middle_count; j++) {
+        if (!(g->middle[j] = strdup(middle[j]))) {
+            free(g->root);
+            free_array(g->middle, j);
+            return NULL;
+        }
+    }
+    bl->group_count++;
+    return g;
+}
+
+/*
+   解析并去掉规则末尾的配额后缀 " @<数值>[K|M|G][B]"，如 "/a/cache @200M"。
+   只有空白之后的最后一段完整符合该格式（不含 '/'）时才是配额，否则 '@' 属于路径本身
+   （如 "/x/a @2x/cache"）。返回 1 表示带配额，0 表示没有配额后缀，-1 表示数值超出范围
+*/
+static int parse_quota_suffix(char *line, uint64_t *quota) {
+    char *at = strrchr(line, '@');
+    if (!at || at == line || (at[-1] != ' ' && at[-1] != '\t') || strchr(at, '/') || !isdigit((unsigned char)at[1]))
+        return 0;
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(at + 1, &end, 10);
+    int shift = 0;
+    switch (toupper((unsigned char)*end)) {
+        case 'K': shift = 10; end++; break;
+        case 'M': shift = 20; end++; break;
+        case 'G': shift = 30; end++; break;
+    }
+    if (toupper((unsigned char)*end) == 'B')
+        end++;
+    while (*end == ' ' || *end == '\t')
+        end++;
+    if (*end)
+        return 0;
+    if (errno == ERANGE || value > (UINT64_MAX >> shift))
+        return -1;
+    *quota = (uint64_t)value << shift;
+    while (at > line && (at[-1] == ' ' || at[-1] == '\t'))
+        at--;
+    *at = '\0';
+    return 1;
+}
+
+/*
+   编译单条黑名单规则并加入对应规则组。返回 1 表示成功，0 表示规则被忽略，-1 表示内存不足。
+   "**" 只支持作为最后一级或倒数第二级组件出现；配额后缀只能用于普通规则
+*/
+static int blacklist_add_rule(Blacklist *bl, const char *line, int32_t rule_id) {
+    char *copy = strdup(line);
+    if (!copy)
+        return -1;
+    uint64_t quota = 0;
+    int has_quota = parse_quota_suffix(copy, &quota);
+    if (has_quota < 0) {
+        log_message(1, "无效的配额规则，已忽略: %s\n", line);
+        free(copy);
+        return 0;
+    }
+    // 去除路径末尾的斜杠
+    size_t len = strlen(copy);
+    while (len > 0 && copy[len-1] == '/')
+        copy[--len] = '\0';
+    SpecialRule special;
+    const char *leaf_text = NULL;
+    char *path = copy;
+    int mode = RULE_ONCE;
+    if (is_special_rule(copy)) {
+        if (!parse_special_rule(copy, &special)) {
+            log_message(1, "无效的方括号规则，已忽略: %s\n", line);
+            free(copy);
+            return 0;
+        }
+        free_special_rule(&special);
+        path = special.path;
+        leaf_text = special.pattern;
+        mode = RULE_FILTER;
+    }
+    int absolute = (*path == '/');
+    char *components[PATH_MAX / 2];
+    int n = 0;
+    char *save = NULL;
+    for (char *tok = strtok_r(path, "/", &save); tok && n < (int)(sizeof(components) / sizeof(components[0]));
+         tok = strtok_r(NULL, "/", &save))
+        components[n++] = tok;
+    int leaf_index = n;
+    if (mode != RULE_FILTER) {
+        if (n == 0) {
+            free(copy);
+            return 0;
+        }
+        leaf_index = n - 1;
+        leaf_text = components[leaf_index];
+        if (strcmp(components[n - 1], "**") == 0) {
+            mode = RULE_ANY_DEPTH;
+            leaf_text = "*";
+        } else if (n >= 2 && strcmp(components[n - 2], "**") == 0) {
+            mode = RULE_ANY_DEPTH;
+            leaf_index = n - 2;
+        }
+        for (int i = 0; i < leaf_index; i++) {
+            if (strstr(components[i], "**")) {
+                log_message(1, "不支持的递归规则（\"**\" 只能位于最后两级），已忽略: %s\n", line);
+                free(copy);
+                return 0;
+            }
+        }
+    }
+    if (has_quota) {
+        if (mode != RULE_ONCE) {
+            log_message(1, "配额不能用于方括号或 \"**\" 规则，已忽略: %s\n", line);
+            free(copy);
+            return 0;
+        }
+        mode = RULE_QUOTA;
+    }
+    // 根目录取开头连续的字面量组件
+    int root_count = 0;
+    while (root_count < leaf_index && !component_is_glob(components[root_count], strlen(components[root_count])))
+        root_count++;
+    char root[PATH_MAX];
+    size_t root_len = 0;
+    root[0] = '\0';
+    if (!absolute && root_count == 0)
+        root_len = (size_t)snprintf(root, sizeof(root), ".");
+    for (int i = 0; i < root_count && root_len < sizeof(root); i++)
+        root_len += (size_t)snprintf(root + root_len, sizeof(root) - root_len, "%s%s",
+            (i == 0 && !absolute) ? "" : "/", components[i]);
+    if (absolute && root_count == 0)
+        snprintf(root, sizeof(root), "/");
+    RuleGroup *g = blacklist_get_group(bl, root, components + root_count, leaf_index - root_count, mode, quota);
+    int ok = g && (mode == RULE_FILTER ? nameset_add(&g->names, leaf_text, rule_id)
+                                       : nameset_add_expanded(&g->names, leaf_text, rule_id, 0));
+    if (ok && g->literal_only) {
+        const char *text;
+        size_t text_len;
+        g->literal_only = classify_pattern(leaf_text, &text, &text_len) == PAT_LITERAL && !strchr(leaf_text, '{');
+    }
+    free(copy);
+    return ok ? 1 : -1;
+}
+
+// 将黑名单规则数组编译为规则组，返回成功编译的规则数，内存不足时返回 -1
+int blacklist_compile(char **lines, int count, Blacklist *bl) {
+    memset(bl, 0, sizeof(*bl));
+    for (int i = 0; i < count; i++) {
+        if (!lines[i])
+            continue;
+        int ret = blacklist_add_rule(bl, lines[i], i);
+        if (ret < 0) {
+            blacklist_free(bl);
+            return -1;
+        }
+        bl->rule_count += ret;
+    }
+    for (uint32_t i = 0; i < bl->group_count; i++)
+        nameset_finalize(&bl->groups[i].names);
+    return bl->rule_count;
+}
+
+/*
+   遍历计划：把 -1 与 -2 的全部规则组按根目录合并成一棵目录前缀树，节点记录从该目录开始展开的规则组。
+   完整扫描从前缀树顶端出发，每个目录只打开、读取一次，同一次扫描中对各子项求出所有适用规则的结果，
+   根目录重叠的规则不再各自遍历；规则增多只增加名称匹配的开销，不增加目录 I/O
+*/
+typedef struct {
+    const RuleGroup *group;
+    int level;           // 已展开到的中间模式层级，等于 middle_count 表示位于基目录
+    int check_expiry;    // 来自 -2 规则，删除前判断过期
+} Role;
+
+typedef struct {
+    char *name;
+    uint32_t first_child;
+    uint32_t next_sibling;
+    Role *roles;         // 根目录为该节点的规则组
+    uint32_t role_count, role_cap;
+} PlanNode;
+
+#define PLAN_ABS_ROOT 1  // 绝对路径规则的顶端 "/"
+#define PLAN_REL_ROOT 2  // 相对路径规则的顶端（当前目录）
+
+typedef struct {
+    PlanNode *nodes;     // 下标 0 保留表示"无"
+    uint32_t node_count, node_cap;
+} Plan;
+
+void plan_free(Plan *plan) {
+    for (uint32_t i = 0; i < plan->node_count; i++) {
+        free(plan->nodes[i].name);
+        free(plan->nodes[i].roles);
+    }
+    free(plan->nodes);
+    memset(plan, 0, sizeof(*plan));
+}
+
+// 查找前缀树节点 node 下名为 name 的子节点，不存在时返回 0
+static uint32_t plan_find_child(const Plan *plan, uint32_t node, const char *name) {
+    if (!node)
+        return 0;
+    for (uint32_t c = plan->nodes[node].first_child; c; c = plan->nodes[c].next_sibling) {
+        if (strcmp(plan->nodes[c].name, name) == 0)
+            return c;
+    }
+    return 0;
+}
+
+// 查找或新建子节点，内存不足时返回 0
+static uint32_t plan_get_child(Plan *plan, uint32_t node, const char *name, size_t len) {
+    for (uint32_t c = plan->nodes[node].first_child; c; c = plan->nodes[c].next_sibling) {
+        if (strncmp(plan->nodes[c].name, name, len) == 0 && plan->nodes[c].name[len] == '\0')
+            return c;
+    }
+    if (!grow_array((void **)&plan->nodes, &plan->node_cap, sizeof(PlanNode), plan->node_count + 1))
+        return 0;
+    uint32_t c = plan->node_count;
+    PlanNode *n = &plan->nodes[c];
+    memset(n, 0, sizeof(*n));
+    if (!(n->name = strndup(name, len)))
+        return 0;
+    plan->node_count++;
+    n->next_sibling = plan->nodes[node].first_child;
+    plan->nodes[node].first_child = c;
+    return c;
+}
+
+// 把一个黑名单的全部规则组挂到各自根目录对应的节点上
+static int plan_add_blacklist(Plan *plan, const Blacklist *bl, int check_expiry) {
+    for (uint32_t i = 0; i < bl->group_count; i++) {
+        const RuleGroup *g = &bl->groups[i];
+        const char *p = g->root;
+        uint32_t node = (*p == '/') ? PLAN_ABS_ROOT : PLAN_REL_ROOT;
+        while (*p && node) {
+            while (*p == '/')
+                p++;
+            if (!*p)
+                break;
+            const char *end = strchr(p, '/');
+            size_t len = end ? (size_t)(end - p) : strlen(p);
+            node = plan_get_child(plan, node, p, len);
+            p += len;
+        }
+        PlanNode *n = &plan->nodes[node];
+        if (!node || !grow_array((void **)&n->roles, &n->role_cap, sizeof(Role), n->role_count + 1))
+            return -1;
+        n->roles[n->role_count++] = (Role){ g, 0, check_expiry };
+    }
+    return 0;
+}
+
+// 由 -1（不检查过期）与 -2（检查过期）规则组建立遍历计划，内存不足时返回 -1
+int plan_compile(Plan *plan, const Blacklist *bl1, const Blacklist *bl2) {
+    memset(plan, 0, sizeof(*plan));
+    if (!grow_array((void **)&plan->nodes, &plan->node_cap, sizeof(PlanNode), 3))
+        return -1;
+    memset(plan->nodes, 0, 3 * sizeof(PlanNode));
+    plan->node_count = 3;
+    if ((bl1 && plan_add_blacklist(plan, bl1, 0) < 0) || (bl2 && plan_add_blacklist(plan, bl2, 1) < 0)) {
+        plan_free(plan);
+        return -1;
+    }
+    return 0;
+}
+
+/*
+   规则开销剖析：每个线程有一个当前计费范围（一个规则组，或遍历中多个规则组共同展开的目录），
+   进入规则目标、遍历计划目录、执行删除任务时切换，并在切换时把自上次切换以来的增量
+   （删除计数、stat 与白名单计数、墙钟与 CPU 时间）记入之前的范围，嵌套的范围不重复计入外层。
+   多个规则组共同展开的目录按组数平分，前缀树上没有规则展开的目录记入共用行。
+   热路径上只累加线程局部计数，原子操作只发生在切换时；单个文件目标只切换计数不读时钟，
+   其耗时留在所在目录的范围中
+*/
+typedef struct {
+    RuleProfile *row;
+    const Role *roles;   // row 为空时按这些规则组平分
+    uint32_t role_count;
+} ProfileScope;
+
+static __thread struct {
+    ProfileScope scope;
+    int64_t wall, cpu;   // 计时起点，wall 为 0 表示当前范围没有待计入的时间
+    DeleteStats base;    // 切换时 thread_stats 与 prof_counts 的取值
+    long long counts[PROF_COUNT];
+} prof_cur;
+
+static int64_t clock_ns(clockid_t clock) {
+    struct timespec ts;
+    clock_gettime(clock, &ts);
+    return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static int profile_active(ProfileScope s) {
+    return s.row || s.role_count;
+}
+
+// 单个规则组的计费范围，row 为空时不计费
+static ProfileScope profile_row(RuleProfile *row) {
+    return (ProfileScope){ row, NULL, 0 };
+}
+
+// 目录中活动规则组的计费范围：单个组直接计入，没有时计入共用行
+static ProfileScope profile_roles(const Role *roles, uint32_t count) {
+    if (!engine->profile)
+        return profile_row(NULL);
+    if (!count)
+        return profile_row(&engine->profile[0]);
+    if (count == 1)
+        return profile_row(roles[0].group->prof);
+    return (ProfileScope){ NULL, roles, count };
+}
+
+static void profile_add(RuleProfile *row, const long long *d, long long div, int first) {
+    for (int i = 0; i < PROF_COUNT; i++) {
+        long long v = d[i] / div + (first ? d[i] % div : 0);
+        if (v)
+            atomic_fetch_add_explicit(&row->v[i], v, memory_order_relaxed);
+    }
+}
+
+/*
+   切换当前线程的计费范围，返回之前的范围供恢复。timed 为 0 时只结算计数、不读时钟，
+   期间的耗时仍计入外层范围
+*/
+static ProfileScope profile_switch(ProfileScope next, int timed) {
+    ProfileScope prev = prof_cur.scope;
+    if (prev.row == next.row && prev.roles == next.roles)
+        return prev;
+    int64_t wall = 0, cpu = 0;
+    if (timed) {
+        wall = clock_ns(CLOCK_MONOTONIC);
+        cpu = clock_ns(CLOCK_THREAD_CPUTIME_ID);
+    }
+    DeleteStats *s = thread_stats;
+    if (profile_active(prev) && s) {
+        long long d[PROF_COUNT];
+        for (int i = 0; i < PROF_COUNT; i++)
+            d[i] = prof_counts[i] - prof_cur.counts[i];
+        d[PROF_WALL] = timed && prof_cur.wall ? wall - prof_cur.wall : 0;
+        d[PROF_CPU] = timed && prof_cur.wall ? cpu - prof_cur.cpu : 0;
+        d[PROF_VISITED] = s->scanned - prof_cur.base.scanned;
+        d[PROF_FILES] = s->files - prof_cur.base.files;
+        d[PROF_DIRS] = s->dirs - prof_cur.base.dirs;
+        d[PROF_BYTES] = s->bytes - prof_cur.base.bytes;
+        if (prev.row) {
+            profile_add(prev.row, d, 1, 1);
+        } else {
+            for (uint32_t i = 0; i < prev.role_count; i++)
+                profile_add(prev.roles[i].group->prof, d, prev.role_count, i == 0);
+        }
+    }
+    prof_cur.scope = next;
+    if (!profile_active(next) || !s)
+        return prev;
+    if (timed) {
+        prof_cur.wall = wall;
+        prof_cur.cpu = cpu;
+    } else if (!profile_active(prev)) {
+        prof_cur.wall = 0;
+    }
+    prof_cur.base = *s;
+    memcpy(prof_cur.counts, prof_counts, sizeof(prof_counts));
+    return prev;
+}
+
+/*
+   目录扫描中保留下来的子项：数量为 0 时目录可直接删除；oldest 为保留文件中最旧的 mtime，
+   非文件或 mtime 未知的保留项记为 0，供扫描状态缓存判断目录下是否可能出现过期文件
+*/
+typedef struct {
+    int count;
+    int64_t oldest;
+} Kept;
+
+#define KEPT_INIT { 0, INT64_MAX }
+
+static void kept_add(Kept *k, int64_t mtime) {
+    k->count++;
+    if (mtime < k->oldest)
+        k->oldest = mtime;
+}
+
+/*
+   到期调度：完整扫描时为每个 -2 规则目标（按过期删除的目录或文件、带过期检查的方括号规则基目录）
+   记录其中未过期文件最早的到期时间，扫描结束后按到期时间建成最小堆。常驻进程据此在最早的
+   到期时间醒来，只重新处理已到期的目标（clean_run_due），不必等下一轮完整扫描
+*/
+struct DeadlineRoot {
+    const RuleGroup *filter;    // 方括号规则的基目录，为空表示目标本身按过期规则删除
+    RuleProfile *prof;          // 所属规则组的开销计数
+    _Atomic int64_t due;        // 最早的到期时间（秒），INT64_MAX 表示没有未过期的文件
+    char path[];
+};
+
+// 当前线程正在处理的目标，遍历中遇到的未过期文件计入其到期时间；删除任务继承提交时的目标
+static __thread DeadlineRoot *walk_root = NULL;
+
+// 记录一个未过期文件：mtime 超过 days 天后的下一秒到期
+static void deadline_note(DeadlineRoot *root, time_t mtime, int days) {
+    if (!root)
+        return;
+    int64_t due = (int64_t)mtime + (int64_t)days * 24 * 3600 + 1;
+    int64_t cur = atomic_load_explicit(&root->due, memory_order_relaxed);
+    while (due < cur && !atomic_compare_exchange_weak_explicit(&root->due, &cur, due,
+                                                               memory_order_relaxed, memory_order_relaxed))
+        ;
+}
+
+// 完整扫描中登记一个目标，返回供遍历计入的记录；未在收集或内存不足时返回 NULL
+static DeadlineRoot *deadline_root_add(const char *path, const RuleGroup *filter) {
+    if (!engine->deadline_collect)
+        return NULL;
+    size_t len = strlen(path);
+    DeadlineRoot *root = malloc(sizeof(DeadlineRoot) + len + 1);
+    if (!root)
+        return NULL;
+    root->filter = filter;
+    root->prof = prof_cur.scope.row;
+    atomic_init(&root->due, INT64_MAX);
+    memcpy(root->path, path, len + 1);
+    pthread_mutex_lock(&engine->deadline_lock);
+    int ok = grow_array((void **)&engine->deadlines, &engine->deadline_cap, sizeof(DeadlineRoot *),
+                        engine->deadline_count + 1);
+    if (ok)
+        engine->deadlines[engine->deadline_count++] = root;
+    pthread_mutex_unlock(&engine->deadline_lock);
+    if (!ok)
+        free(root);
+    return ok ? root : NULL;
+}
+
+static void deadline_clear(CleanContext *ctx) {
+    for (uint32_t i = 0; i < ctx->deadline_count; i++)
+        free(ctx->deadlines[i]);
+    ctx->deadline_count = 0;
+}
+
+static int64_t deadline_due(const DeadlineRoot *root) {
+    return atomic_load_explicit(&root->due, memory_order_relaxed);
+}
+
+static void deadline_sift_down(DeadlineRoot **heap, uint32_t count, uint32_t i) {
+    for (;;) {
+        uint32_t min = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && deadline_due(heap[l]) < deadline_due(heap[min]))
+            min = l;
+        if (r < count && deadline_due(heap[r]) < deadline_due(heap[min]))
+            min = r;
+        if (min == i)
+            return;
+        DeadlineRoot *tmp = heap[i];
+        heap[i] = heap[min];
+        heap[min] = tmp;
+        i = min;
+    }
+}
+
+// 放回一个目标（数组已有空间）
+static void deadline_push(CleanContext *ctx, DeadlineRoot *root) {
+    DeadlineRoot **heap = ctx->deadlines;
+    uint32_t i = ctx->deadline_count++;
+    heap[i] = root;
+    while (i && deadline_due(heap[(i - 1) / 2]) > deadline_due(heap[i])) {
+        DeadlineRoot *tmp = heap[i];
+        heap[i] = heap[(i - 1) / 2];
+        heap[(i - 1) / 2] = tmp;
+        i = (i - 1) / 2;
+    }
+}
+
+static DeadlineRoot *deadline_pop(CleanContext *ctx) {
+    DeadlineRoot *top = ctx->deadlines[0];
+    ctx->deadlines[0] = ctx->deadlines[--ctx->deadline_count];
+    deadline_sift_down(ctx->deadlines, ctx->deadline_count, 0);
+    return top;
+}
+
+static int compare_deadline_roots(const void *a, const void *b) {
+    const DeadlineRoot *x = *(DeadlineRoot *const *)a, *y = *(DeadlineRoot *const *)b;
+    int c = strcmp(x->path, y->path);
+    if (c)
+        return c;
+    return x->filter == y->filter ? 0 : (uintptr_t)x->filter < (uintptr_t)y->filter ? -1 : 1;
+}
+
+// 扫描结束后合并同一目标的重复登记、丢弃没有未过期文件的目标，再建成最小堆
+static void deadline_finish(CleanContext *ctx) {
+    DeadlineRoot **a = ctx->deadlines;
+    uint32_t n = 0;
+    qsort(a, ctx->deadline_count, sizeof(DeadlineRoot *), compare_deadline_roots);
+    for (uint32_t i = 0; i < ctx->deadline_count; i++) {
+        if (n && compare_deadline_roots(&a[n - 1], &a[i]) == 0) {
+            if (deadline_due(a[i]) < deadline_due(a[n - 1]))
+                atomic_store(&a[n - 1]->due, deadline_due(a[i]));
+            free(a[i]);
+        } else if (deadline_due(a[i]) == INT64_MAX) {
+            free(a[i]);
+        } else {
+            a[n++] = a[i];
+        }
+    }
+    ctx->deadline_count = n;
+    for (uint32_t i = n / 2; i-- > 0;)
+        deadline_sift_down(a, n, i);
+}
+
+/*
+   按 inode 顺序删除：删除目录时待删除的文件先收集到当前线程的排序批次中，攒满 unlink_batch 个
+   或到达批量后端的提交点（目录处理结束、进入子目录前等）时，按 d_ino 排序后再逐个判断过期并删除。
+   ext4、f2fs 的 readdir 顺序是文件名哈希顺序，与 inode 在 inode 表中的位置无关；按 inode 顺序处理时
+   stat 与 unlink 依次访问相邻的 inode 表块（f2fs 为节点页），日志与缓存的局部性更好。
+   子目录与白名单判断仍按读取顺序处理，只有文件的过期判断与删除被推迟
+*/
+typedef struct {
+    DirEntry e;             // e.name 在提交时指向 pool 中的副本
+    int dir_fd;
+    uint32_t name_off;
+    uint32_t path_off;
+    int check_expiry;
+    int days;
+    Kept *kept;
+    DeadlineRoot *root;
+    RuleProfile *prof;
+} OrderItem;
+
+typedef struct {
+    OrderItem *items;
+    uint32_t count, cap;
+    char *pool;
+    uint32_t pool_len, pool_cap;
+    int flushing;           // 提交中，批量后端在其中触发的提交不再重入
+} OrderBatch;
+
+static __thread OrderBatch *thread_order = NULL;
+
+static void delete_file_entry(int dir_fd, DirEntry *e, const char *path, int check_expiry, int days, Kept *kept);
+
+static void order_release(void) {
+    OrderBatch *b = thread_order;
+    if (!b)
+        return;
+    free(b->items);
+    free(b->pool);
+    free(b);
+    thread_order = NULL;
+}
+
+static int compare_order_items(const void *a, const void *b) {
+    ino_t x = ((const OrderItem *)a)->e.ino, y = ((const OrderItem *)b)->e.ino;
+    return (x > y) - (x < y);
+}
+
+// 按 inode 顺序处理当前线程排序批次中的文件；dir_fd 与 kept 须保持有效直到这里
+static void order_flush(void) {
+    OrderBatch *b = thread_order;
+    if (!b || !b->count || b->flushing)
+        return;
+    b->flushing = 1;
+    qsort(b->items, b->count, sizeof(OrderItem), compare_order_items);
+    DeadlineRoot *prev_root = walk_root;
+    ProfileScope prof_prev = prof_cur.scope;
+    for (uint32_t i = 0; i < b->count; i++) {
+        OrderItem *it = &b->items[i];
+        it->e.name = b->pool + it->name_off;
+        walk_root = it->root;
+        profile_switch(profile_row(it->prof), 0);
+        delete_file_entry(it->dir_fd, &it->e, b->pool + it->path_off, it->check_expiry, it->days, it->kept);
+    }
+    walk_root = prev_root;
+    profile_switch(prof_prev, 0);
+    b->count = 0;
+    b->pool_len = 0;
+    b->flushing = 0;
+}
+
+// 删除文件：启用 inode 排序时放入排序批次，否则（或内存不足时）直接交给 delete_file_entry
+static void delete_file_ordered(int dir_fd, DirEntry *e, const char *path, int check_expiry, int days, Kept *kept) {
+    uint32_t batch = engine->opt.unlink_batch > 1 ? (uint32_t)engine->opt.unlink_batch : 0;
+    OrderBatch *b = thread_order;
+    if (batch && !b && (b = thread_order = calloc(1, sizeof(OrderBatch))) == NULL)
+        batch = 0;
+    if (!batch) {
+        delete_file_entry(dir_fd, e, path, check_expiry, days, kept);
+        return;
+    }
+    if (b->count >= batch)
+        order_flush();
+    size_t name_len = strlen(e->name), path_len = strlen(path);
+    if (!grow_array((void **)&b->items, &b->cap, sizeof(OrderItem), b->count + 1) ||
+        !grow_array((void **)&b->pool, &b->pool_cap, 1, b->pool_len + (uint32_t)(name_len + path_len + 2))) {
+        delete_file_entry(dir_fd, e, path, check_expiry, days, kept);
+        return;
+    }
+    OrderItem *it = &b->items[b->count++];
+    it->e = *e;
+    it->dir_fd = dir_fd;
+    it->check_expiry = check_expiry;
+    it->days = days;
+    it->kept = kept;
+    it->root = walk_root;
+    it->prof = prof_cur.scope.row;
+    it->name_off = b->pool_len;
+    memcpy(b->pool + b->pool_len, e->name, name_len + 1);
+    b->pool_len += (uint32_t)name_len + 1;
+    it->path_off = b->pool_len;
+    memcpy(b->pool + b->pool_len, path, path_len + 1);
+    b->pool_len += (uint32_t)path_len + 1;
+}
+
+/*
+   io_uring 批量后端（内核 5.11 起支持 IORING_OP_UNLINKAT，5.6 起支持 IORING_OP_STATX）。
+   待删除文件先收集到当前线程的批次中，目录处理结束或批次满时一次提交：
+   需要判断过期的先批量 statx，过期的再批量 unlinkat，每一步只需一次 io_uring_enter。
+   通过 -b uring 启用，运行时探测内核支持，不可用时（含 seccomp/SELinux 禁止）退回逐个阻塞调用。
+   unlinkat 在内核中由 io-wq 线程执行，tmpfs 等纯内存文件系统上反而慢于同步调用，因此默认不启用。
+   直接使用系统调用，不依赖 liburing
+*/
+#if defined(__NR_io_uring_setup) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#define HAVE_IO_URING 1
+#endif
+#endif
+
+#ifdef HAVE_IO_URING
+#define URING_BATCH 64
+
+// 批次中的一个文件：名称与完整路径存放在字符串池中，提交时再取指针
+typedef struct {
+    int dir_fd;
+    uint32_t name_off;
+    uint32_t path_off;
+    int is_link;
+    int check_expiry;
+    int days;
+    int need_stat;      // 需要 statx 取 mtime（过期判断）或块数（统计释放空间）
+    Kept *kept;         // 文件最终保留时计入的所在目录，可为空
+    DeadlineRoot *root; // 加入批次时所属的到期调度目标，可为空
+    RuleProfile *prof;  // 加入批次时所属的规则组开销计数，可为空
+    uint64_t blocks;
+    struct statx stx;
+} BatchItem;
+
+typedef struct {
+    int fd;
+    unsigned *sq_head, *sq_tail, *sq_mask, *sq_array;
+    unsigned *cq_head, *cq_tail, *cq_mask;
+    struct io_uring_sqe *sqes;
+    struct io_uring_cqe *cqes;
+    void *sq_map, *cq_map;
+    size_t sq_map_len, cq_map_len, sqes_len;
+    BatchItem items[URING_BATCH];
+    uint32_t count;
+    char *pool;
+    uint32_t pool_len, pool_cap;
+} IoRing;
+
+static __thread IoRing *thread_ring = NULL;
+static __thread int thread_ring_failed = 0;
+
+// 释放当前线程的 io_uring 实例
+static void uring_release(void) {
+    IoRing *r = thread_ring;
+    if (!r)
+        return;
+    if (r->sqes)
+        munmap(r->sqes, r->sqes_len);
+    if (r->cq_map && r->cq_map != r->sq_map)
+        munmap(r->cq_map, r->cq_map_len);
+    if (r->sq_map)
+        munmap(r->sq_map, r->sq_map_len);
+    if (r->fd >= 0)
+        close(r->fd);
+    free(r->pool);
+    free(r);
+    thread_ring = NULL;
+}
+
+// 创建 io_uring 实例并映射提交/完成队列，失败返回 NULL
+static IoRing *uring_create(void) {
+    IoRing *r = calloc(1, sizeof(IoRing));
+    if (!r)
+        return NULL;
+    struct io_uring_params p;
+    memset(&p, 0, sizeof(p));
+    r->fd = (int)syscall(__NR_io_uring_setup, URING_BATCH, &p);
+    thread_ring = r;
+    if (r->fd < 0)
+        goto fail;
+    r->sq_map_len = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+    r->cq_map_len = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        if (r->cq_map_len > r->sq_map_len)
+            r->sq_map_len = r->cq_map_len;
+        r->cq_map_len = r->sq_map_len;
+    }
+    r->sq_map = mmap(NULL, r->sq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQ_RING);
+    if (r->sq_map == MAP_FAILED) {
+        r->sq_map = NULL;
+        goto fail;
+    }
+    if (p.features & IORING_FEAT_SINGLE_MMAP) {
+        r->cq_map = r->sq_map;
+    } else {
+        r->cq_map = mmap(NULL, r->cq_map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_CQ_RING);
+        if (r->cq_map == MAP_FAILED) {
+            r->cq_map = NULL;
+            goto fail;
+        }
+    }
+    r->sqes_len = p.sq_entries * sizeof(struct io_uring_sqe);
+    r->sqes = mmap(NULL, r->sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, r->fd, IORING_OFF_SQES);
+    if (r->sqes == MAP_FAILED) {
+        r->sqes = NULL;
+        goto fail;
+    }
+    char *sq = r->sq_map, *cq = r->cq_map;
+    r->sq_head = (unsigned *)(sq + p.sq_off.head);
+    r->sq_tail = (unsigned *)(sq + p.sq_off.tail);
+    r->sq_mask = (unsigned *)(sq + p.sq_off.ring_mask);
+    r->sq_array = (unsigned *)(sq + p.sq_off.array);
+    r->cq_head = (unsigned *)(cq + p.cq_off.head);
+    r->cq_tail = (unsigned *)(cq + p.cq_off.tail);
+    r->cq_mask = (unsigned *)(cq + p.cq_off.ring_mask);
+    r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+    return r;
+fail:
+    uring_release();
+    return NULL;
+}
+
+// 探测内核是否支持 io_uring 以及 STATX/UNLINKAT 操作
+static int uring_probe(void) {
+    IoRing *r = uring_create();
+    if (!r)
+        return 0;
+    size_t len = sizeof(struct io_uring_probe) + 256 * sizeof(struct io_uring_probe_op);
+    struct io_uring_probe *probe = calloc(1, len);
+    int ok = probe && syscall(__NR_io_uring_register, r->fd, IORING_REGISTER_PROBE, probe, 256) == 0 &&
+        probe->last_op >= IORING_OP_UNLINKAT &&
+        (probe->ops[IORING_OP_STATX].flags & IO_URING_OP_SUPPORTED) &&
+        (probe->ops[IORING_OP_UNLINKAT].flags & IO_URING_OP_SUPPORTED);
+    free(probe);
+    uring_release();
+    return ok;
+}
+
+// 取得当前线程的 io_uring 实例（首次使用时创建），未启用或创建失败时返回 NULL
+static IoRing *uring_get(void) {
+    if (engine->io_backend != CLEAN_BACKEND_URING || thread_ring_failed)
+        return NULL;
+    if (!thread_ring && !uring_create()) {
+        thread_ring_failed = 1;
+        return NULL;
+    }
+    return thread_ring;
+}
+
+// 提交已填入的 n 个请求并等待全部完成，完成结果按 user_data 写回 results
+static int uring_submit_wait(IoRing *r, unsigned n, int *results) {
+    unsigned submitted = 0, completed = 0;
+    while (completed < n) {
+        int ret = (int)syscall(__NR_io_uring_enter, r->fd, n - submitted, n - completed,
+            IORING_ENTER_GETEVENTS, NULL, 0);
+        if (ret < 0 && errno != EINTR)
+            return -1;
+        if (ret > 0)
+            submitted += (unsigned)ret;
+        unsigned head = *r->cq_head;
+        unsigned tail = __atomic_load_n(r->cq_tail, __ATOMIC_ACQUIRE);
+        for (; head != tail; head++) {
+            const struct io_uring_cqe *cqe = &r->cqes[head & *r->cq_mask];
+            results[cqe->user_data] = cqe->res;
+            completed++;
+        }
+        __atomic_store_n(r->cq_head, head, __ATOMIC_RELEASE);
+    }
+    return 0;
+}
+
+// 取下一个提交队列项并清零，调用方填好后再调用 uring_queue_commit
+static struct io_uring_sqe *uring_queue(IoRing *r, uint32_t index) {
+    unsigned tail = *r->sq_tail;
+    unsigned slot = tail & *r->sq_mask;
+    struct io_uring_sqe *sqe = &r->sqes[slot];
+    memset(sqe, 0, sizeof(*sqe));
+    sqe->user_data = index;
+    r->sq_array[slot] = slot;
+    __atomic_store_n(r->sq_tail, tail + 1, __ATOMIC_RELEASE);
+    return sqe;
+}
+
+// 提交当前线程批次中的文件：先批量 statx 判断过期，再批量 unlinkat
+static void file_batch_flush(void) {
+    // 排序批次中的文件先按 inode 顺序交给本批次
+    order_flush();
+    IoRing *r = thread_ring;
+    if (!r || !r->count)
+        return;
+    int results[URING_BATCH];
+    uint32_t keep[URING_BATCH], n = 0, stats = 0;
+    // 每个文件的计数记入其加入批次时的规则组，提交结束后恢复
+    ProfileScope prof_prev = prof_cur.scope;
+    for (uint32_t i = 0; i < r->count; i++) {
+        BatchItem *it = &r->items[i];
+        if (!it->need_stat)
+            continue;
+        struct io_uring_sqe *sqe = uring_queue(r, i);
+        sqe->opcode = IORING_OP_STATX;
+        sqe->fd = it->dir_fd;
+        sqe->addr = (uintptr_t)(r->pool + it->name_off);
+        sqe->len = STATX_MTIME | engine->stats_stat_mask;
+        sqe->off = (uintptr_t)&it->stx;
+        sqe->statx_flags = AT_SYMLINK_NOFOLLOW;
+        stats++;
+    }
+    if (stats && uring_submit_wait(r, stats, results) != 0) {
+        log_message(1, "io_uring 提交失败，改用逐个删除: %s\n", strerror(errno));
+        thread_ring_failed = 1;
+        stats = 0;
+        for (uint32_t i = 0; i < r->count; i++)
+            results[i] = -ENOSYS;
+    }
+    for (uint32_t i = 0; i < r->count; i++) {
+        BatchItem *it = &r->items[i];
+        const char *path = r->pool + it->path_off;
+        profile_switch(profile_row(it->prof), 0);
+        // 先按保留计数（mtime 未知），确认删除成功后再撤销
+        Kept *kept = it->kept;
+        Kept none = KEPT_INIT;
+        if (!kept)
+            kept = &none;
+        kept->count++;
+        if (it->need_stat) {
+            time_t mtime = (time_t)it->stx.stx_mtime.tv_sec;
+            uint64_t blocks = it->stx.stx_blocks;
+            prof_counts[PROF_STATS]++;
+            int err = results[i] < 0 ? -results[i] : 0;
+            if (err == ENOSYS) {
+                struct stat st;
+                if (fstatat(it->dir_fd, r->pool + it->name_off, &st, AT_SYMLINK_NOFOLLOW) == 0) {
+                    mtime = st.st_mtime;
+                    blocks = (uint64_t)st.st_blocks;
+                    err = 0;
+                } else {
+                    err = errno;
+                }
+            }
+            // 只为统计取块数的文件（-1 规则）取不到时照常删除，不计释放空间
+            if (err) {
+                if (it->check_expiry || err != ENOENT)
+                    log_message(1, "无法获取文件信息: %s, 错误: %s\n", path, strerror(err));
+                if (it->check_expiry) {
+                    kept->oldest = 0;
+                    continue;
+                }
+                blocks = 0;
+            }
+            if (it->check_expiry && !is_expired(mtime, it->days)) {
+                if (mtime < kept->oldest)
+                    kept->oldest = mtime;
+                deadline_note(it->root, mtime, it->days);
+                continue;
+            }
+            if (engine->stats_stat_mask)
+                it->blocks = blocks;
+        }
+        if (!delete_allowed(path, 0)) {
+            kept->oldest = 0;
+            continue;
+        }
+        keep[n++] = i;
+    }
+    if (n && !thread_ring_failed) {
+        throttle_acquire((int)n);
+        for (uint32_t k = 0; k < n; k++) {
+            struct io_uring_sqe *sqe = uring_queue(r, keep[k]);
+            sqe->opcode = IORING_OP_UNLINKAT;
+            sqe->fd = r->items[keep[k]].dir_fd;
+            sqe->addr = (uintptr_t)(r->pool + r->items[keep[k]].name_off);
+        }
+        if (uring_submit_wait(r, n, results) == 0) {
+            for (uint32_t k = 0; k < n; k++) {
+                BatchItem *it = &r->items[keep[k]];
+                profile_switch(profile_row(it->prof), 0);
+                note_delete_result(r->pool + it->path_off, 0, it->is_link, results[keep[k]] < 0 ? -results[keep[k]] : 0);
+                if (results[keep[k]] >= 0) {
+                    stats_add((long long)it->blocks * 512, 0);
+                    if (it->kept)
+                        it->kept->count--;
+                } else if (it->kept) {
+                    it->kept->oldest = 0;
+                }
+            }
+            n = 0;
+        } else {
+            log_message(1, "io_uring 提交失败，改用逐个删除: %s\n", strerror(errno));
+            thread_ring_failed = 1;
+        }
+    }
+    // 批量提交失败时逐个同步删除
+    for (uint32_t k = 0; k < n; k++) {
+        BatchItem *it = &r->items[keep[k]];
+        profile_switch(profile_row(it->prof), 0);
+        if (unlink_item_at(it->dir_fd, r->pool + it->name_off, r->pool + it->path_off, 0, it->is_link)) {
+            stats_add((long long)it->blocks * 512, 0);
+            if (it->kept)
+                it->kept->count--;
+        } else if (it->kept) {
+            it->kept->oldest = 0;
+        }
+    }
+    profile_switch(prof_prev, 0);
+    r->count = 0;
+    r->pool_len = 0;
+}
+
+/*
+   把待删除文件加入当前线程的批次，返回 0 表示未启用批量后端，由调用方同步处理。
+   已知 mtime 时当场判断过期；dir_fd 与 kept 须保持有效直到 file_batch_flush
+*/
+static int file_batch_add(int dir_fd, DirEntry *e, const char *path, int check_expiry, int days, Kept *kept) {
+    IoRing *r = uring_get();
+    if (!r)
+        return 0;
+    if (check_expiry && (e->stat_mask & STATX_MTIME)) {
+        if (!is_expired(e->mtime, days)) {
+            if (kept)
+                kept_add(kept, e->mtime);
+            deadline_note(walk_root, e->mtime, days);
+            return 1;
+        }
+        check_expiry = 0;
+    }
+    size_t name_len = strlen(e->name), path_len = strlen(path);
+    if (r->count >= throttle_batch(URING_BATCH))
+        file_batch_flush();
+    if (thread_ring_failed)
+        return 0;
+    if (!grow_array((void **)&r->pool, &r->pool_cap, 1, r->pool_len + name_len + path_len + 2))
+        return 0;
+    BatchItem *it = &r->items[r->count++];
+    it->dir_fd = dir_fd;
+    it->is_link = e->type == DT_LNK;
+    it->check_expiry = check_expiry;
+    it->days = days;
+    it->blocks = e->blocks;
+    // 统计释放空间时，块数未知的文件（-1 规则）同样在批量 statx 中取回
+    it->need_stat = check_expiry || (engine->stats_stat_mask && !(e->stat_mask & STATX_BLOCKS));
+    it->kept = kept;
+    it->root = walk_root;
+    it->prof = prof_cur.scope.row;
+    it->name_off = r->pool_len;
+    memcpy(r->pool + r->pool_len, e->name, name_len + 1);
+    r->pool_len += name_len + 1;
+    it->path_off = r->pool_len;
+    memcpy(r->pool + r->pool_len, path, path_len + 1);
+    r->pool_len += path_len + 1;
+    return 1;
+}
+#else
+static int uring_probe(void) {
+    return 0;
+}
+
+static void uring_release(void) {
+}
+
+static void file_batch_flush(void) {
+    order_flush();
+}
+
+static int file_batch_add(int dir_fd, DirEntry *e, const char *path, int check_expiry, int days, Kept *kept) {
+    (void)dir_fd; (void)e; (void)path; (void)check_expiry; (void)days; (void)kept;
+    return 0;
+}
+#endif
+
+/*
+   删除目录中的普通文件或符号链接：启用批量后端时加入批次，否则同步判断过期并删除。
+   kept 非空时，文件最终被保留（未过期、回调保留或删除失败）则计入 kept
+*/
+static void delete_file_entry(int dir_fd, DirEntry *e, const char *path, int check_expiry, int days, Kept *kept) {
+    if (file_batch_add(dir_fd, e, path, check_expiry, days, kept))
+        return;
+    if (check_expiry && !entry_is_expired(dir_fd, e, path, days)) {
+        if (e->stat_mask & STATX_MTIME)
+            deadline_note(walk_root, e->mtime, days);
+        if (kept)
+            kept_add(kept, (e->stat_mask & STATX_MTIME) ? e->mtime : 0);
+        return;
+    }
+    // -1 规则的文件没有经过过期判断，统计释放空间时删除前单独取回块数
+    if (engine->stats_stat_mask && !(e->stat_mask & STATX_BLOCKS))
+        entry_stat(dir_fd, e, engine->stats_stat_mask);
+    uint64_t blocks = (e->stat_mask & STATX_BLOCKS) ? e->blocks : 0;
+    if (delete_item_at(dir_fd, e->name, path, 0, e->type == DT_LNK))
+        stats_add((long long)blocks * 512, 0);
+    else if (kept)
+        kept_add(kept, 0);
+}
+
+/*
+   扫描状态缓存：按 (dev, inode) 记录 -2 规则下叶子目录（扫描时没有子目录）的 mtime
+   与其中保留文件最旧的 mtime，映射到磁盘文件，进程重启后仍然有效。
+   目录 mtime 未变说明没有增删条目，文件被修改只会让 mtime 变新，因此记录的最旧文件
+   尚未过期时目录中不可能有过期文件，下一轮无需打开目录、逐个 statx，直接跳过。
+   mtime 距当前不足 SCAN_CACHE_RACY_SEC 秒的目录不记录，避免同一时间戳粒度内新建的条目被漏掉；
+   记录超过 SCAN_CACHE_MAX_AGE 后重新扫描一次，兜住把文件 mtime 改回过去这类目录 mtime 不变的修改。
+   只用于不带方括号过滤的过期删除，表满时先淘汰已超期的记录，仍不够再扩容
+*/
+#define SCAN_CACHE_MAGIC 0x31534c43u    // "CLS1"
+#define SCAN_CACHE_MIN_CAP 4096         // 必须为 2 的幂
+#define SCAN_CACHE_MAX_AGE (24 * 3600)
+#define SCAN_CACHE_RACY_SEC 2
+
+typedef struct {
+    uint32_t magic;
+    uint32_t entry_size;
+    uint32_t cap;
+    uint32_t count;
+} ScanCacheHeader;
+
+typedef struct {
+    uint64_t dev;
+    uint64_t ino;           // 0 表示空槽
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    int64_t oldest;         // 保留文件中最旧的 mtime
+    int64_t checked;        // 记录时间
+} ScanCacheEntry;
+
+struct ScanCache {
+    pthread_mutex_t lock;   // 多线程删除任务可能同时查询与记录
+    int fd;
+    ScanCacheHeader *map;   // 为空表示映射失败，缓存停用
+    size_t map_size;
+    atomic_int skipped;     // 本轮跳过的目录数
+};
+
+// 扫描目录前取得的目录状态，valid 为 0 表示不使用缓存
+typedef struct {
+    int valid;
+    dev_t dev;
+    ino_t ino;
+    struct timespec mtime;
+} DirProbe;
+
+static ScanCacheEntry *scan_cache_slots(const ScanCache *c) {
+    return (ScanCacheEntry *)(c->map + 1);
+}
+
+// 按 cap 个槽位调整文件大小并重新映射；失败时停用缓存
+static int scan_cache_map(ScanCache *c, uint32_t cap) {
+    if (c->map)
+        munmap(c->map, c->map_size);
+    c->map = NULL;
+    size_t size = sizeof(ScanCacheHeader) + (size_t)cap * sizeof(ScanCacheEntry);
+    if (ftruncate(c->fd, (off_t)size) != 0)
+        return 0;
+    void *map = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, c->fd, 0);
+    if (map == MAP_FAILED)
+        return 0;
+    c->map = map;
+    c->map_size = size;
+    return 1;
+}
+
+// 打开（不存在时创建）缓存文件并加独占锁，内容无效时清空重建；失败返回 NULL
+static ScanCache *scan_cache_open(const char *path) {
+    ScanCache *c = calloc(1, sizeof(ScanCache));
+    if (!c)
+        return NULL;
+    c->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    if (c->fd < 0 || flock(c->fd, LOCK_EX | LOCK_NB) != 0) {
+        log_message(1, "无法使用扫描状态缓存: %s, 错误: %s\n", path, strerror(errno));
+        if (c->fd >= 0)
+            close(c->fd);
+        free(c);
+        return NULL;
+    }
+    pthread_mutex_init(&c->lock, NULL);
+    struct stat st;
+    ScanCacheHeader h = { 0 };
+    int valid = fstat(c->fd, &st) == 0 && pread(c->fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) &&
+        h.magic == SCAN_CACHE_MAGIC && h.entry_size == sizeof(ScanCacheEntry) &&
+        h.cap >= SCAN_CACHE_MIN_CAP && !(h.cap & (h.cap - 1)) && h.count < h.cap &&
+        (size_t)st.st_size == sizeof(h) + (size_t)h.cap * sizeof(ScanCacheEntry);
+    if (!valid) {
+        h.cap = SCAN_CACHE_MIN_CAP;
+        if (ftruncate(c->fd, 0) != 0)
+            log_message(1, "无法重建扫描状态缓存: %s\n", strerror(errno));
+    }
+    if (!scan_cache_map(c, h.cap)) {
+        log_message(1, "无法映射扫描状态缓存: %s, 错误: %s\n", path, strerror(errno));
+    } else if (!valid) {
+        *c->map = (ScanCacheHeader){ SCAN_CACHE_MAGIC, sizeof(ScanCacheEntry), h.cap, 0 };
+    } else {
+        log_message(2, "扫描状态缓存: %s，%u 条记录\n", path, c->map->count);
+    }
+    return c;
+}
+
+static void scan_cache_close(ScanCache *c) {
+    if (!c)
+        return;
+    if (c->map)
+        munmap(c->map, c->map_size);
+    close(c->fd);
+    pthread_mutex_destroy(&c->lock);
+    free(c);
+}
+
+// 查找 (dev, ino) 所在槽位，不存在时返回应插入的空槽
+static ScanCacheEntry *scan_cache_slot(const ScanCache *c, uint64_t dev, uint64_t ino) {
+    uint64_t h = (ino * 0x9E3779B97F4A7C15ull) ^ (dev * 0xC2B2AE3D27D4EB4Full);
+    h ^= h >> 29;
+    uint32_t mask = c->map->cap - 1;
+    ScanCacheEntry *slots = scan_cache_slots(c);
+    for (uint32_t i = (uint32_t)h & mask;; i = (i + 1) & mask) {
+        if (!slots[i].ino || (slots[i].ino == ino && slots[i].dev == dev))
+            return &slots[i];
+    }
+}
+
+// 淘汰超期记录后重新散列，仍超过 3/4 负载时容量加倍；失败时停用缓存
+static void scan_cache_rehash(ScanCache *c, int64_t now) {
+    uint32_t cap = c->map->cap, live = 0;
+    ScanCacheEntry *old = malloc((size_t)cap * sizeof(ScanCacheEntry));
+    if (!old) {
+        munmap(c->map, c->map_size);
+        c->map = NULL;
+        return;
+    }
+    ScanCacheEntry *slots = scan_cache_slots(c);
+    for (uint32_t i = 0; i < cap; i++) {
+        if (slots[i].ino && now - slots[i].checked <= SCAN_CACHE_MAX_AGE)
+            old[live++] = slots[i];
+    }
+    while ((uint64_t)(live + 1) * 4 > (uint64_t)cap * 3)
+        cap *= 2;
+    if (cap != c->map->cap && !scan_cache_map(c, cap)) {
+        log_message(1, "扫描状态缓存扩容失败，停用缓存: %s\n", strerror(errno));
+        free(old);
+        return;
+    }
+    *c->map = (ScanCacheHeader){ SCAN_CACHE_MAGIC, sizeof(ScanCacheEntry), cap, live };
+    memset(scan_cache_slots(c), 0, (size_t)cap * sizeof(ScanCacheEntry));
+    for (uint32_t i = 0; i < live; i++)
+        *scan_cache_slot(c, old[i].dev, old[i].ino) = old[i];
+    free(old);
+}
+
+/*
+   过期删除进入目录前调用：取得目录状态填入 probe，目录未变化且记录的最旧文件尚未过期时返回 1，
+   调用方跳过该目录（计为保留）
+*/
+static int scan_cache_skip(int parent_fd, const char *name, const char *path,
+    const RuleGroup *filter, int check_expiry, int days, DirProbe *probe) {
+    ScanCache *c = engine->scan_cache;
+    probe->valid = 0;
+    if (!c || !c->map || !check_expiry || filter)
+        return 0;
+    struct stat st;
+    prof_counts[PROF_STATS]++;
+    if (fstatat(parent_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISDIR(st.st_mode))
+        return 0;
+    *probe = (DirProbe){ 1, st.st_dev, st.st_ino, st.st_mtim };
+    int64_t now = (int64_t)time(NULL);
+    int fresh = 0;
+    int64_t oldest = 0;
+    pthread_mutex_lock(&c->lock);
+    if (c->map) {
+        const ScanCacheEntry *e = scan_cache_slot(c, (uint64_t)st.st_dev, (uint64_t)st.st_ino);
+        fresh = e->ino && e->mtime_sec == (int64_t)st.st_mtim.tv_sec && e->mtime_nsec == (int64_t)st.st_mtim.tv_nsec &&
+            now - e->checked <= SCAN_CACHE_MAX_AGE && !is_expired((time_t)e->oldest, days);
+        oldest = e->oldest;
+    }
+    pthread_mutex_unlock(&c->lock);
+    if (fresh) {
+        // 跳过的目录中最旧的文件仍决定所属目标的到期时间
+        deadline_note(walk_root, (time_t)oldest, days);
+        atomic_fetch_add(&c->skipped, 1);
+        log_message(2, "目录未变化且没有过期文件，跳过: %s\n", path);
+    }
+    return fresh;
+}
+
+// 目录扫描结束后记录其状态：只记录没有子目录、保留了文件且 mtime 不在竞争窗口内的目录
+static void scan_cache_record(const DirProbe *probe, const Kept *kept, int subdirs) {
+    ScanCache *c = engine->scan_cache;
+    int64_t now = (int64_t)time(NULL);
+    if (!c || !probe->valid || subdirs || !kept->count || !kept->oldest ||
+        (int64_t)probe->mtime.tv_sec > now - SCAN_CACHE_RACY_SEC)
+        return;
+    pthread_mutex_lock(&c->lock);
+    if (c->map) {
+        ScanCacheEntry *e = scan_cache_slot(c, (uint64_t)probe->dev, (uint64_t)probe->ino);
+        if (!e->ino && (uint64_t)(c->map->count + 1) * 4 > (uint64_t)c->map->cap * 3) {
+            scan_cache_rehash(c, now);
+            e = c->map ? scan_cache_slot(c, (uint64_t)probe->dev, (uint64_t)probe->ino) : NULL;
+        }
+        if (e) {
+            if (!e->ino)
+                c->map->count++;
+            *e = (ScanCacheEntry){ (uint64_t)probe->dev, (uint64_t)probe->ino, (int64_t)probe->mtime.tv_sec,
+                (int64_t)probe->mtime.tv_nsec, kept->oldest, now };
+        }
+    }
+    pthread_mutex_unlock(&c->lock);
+}
+
+/*
+   事件驱动模式下的监听目录集合。完整遍历时，规则解析到的中间目录、基目录以及
+   方括号规则下的各级子目录都会登记为监听目录，并记录它在哪个规则组的第几级。
+   事件只把目录标记为"脏"，随后仅重新处理这些目录；只关注新建与移入，
+   修改仅刷新 mtime，不会让文件变为过期，随时间推移才过期的文件由低频完整对账处理；
+   可用时优先使用 fanotify（按文件系统标记，一个标记覆盖整个分区），否则退回 inotify
+*/
+#define WATCH_MAX_DIRS 16384
+#define WATCH_SETTLE_MS 1000
+
+// 监听目录承担的角色：所属规则组、在该组中的层级以及是否检查过期
+typedef struct WatchRole {
+    const RuleGroup *group;
+    int level;
+    int check_expiry;
+    struct WatchRole *next;
+} WatchRole;
+
+typedef struct {
+    char *path;
+    dev_t dev;              // 登记时目录的设备与 inode，用于识别同路径下被重建的目录
+    ino_t ino;
+    int wd;                 // inotify 监听描述符，-1 表示未使用 inotify 或已失效
+    unsigned char *handle;  // fanotify 模式下的 fsid + 文件句柄，作为事件查找键
+    uint32_t handle_len;
+    uint32_t key_hash;
+    int dirty;
+    WatchRole *roles;
+} WatchDir;
+
+struct WatchSet {
+    pthread_mutex_t lock;   // 多线程完整扫描时各工作线程可能同时登记目录
+    int fan_fd;             // fanotify 实例，-1 表示不可用
+    int ino_fd;             // inotify 实例，按需创建
+    WatchDir *dirs;
+    uint32_t count, cap;
+    uint32_t *path_index;   // 路径哈希 -> dirs 下标 + 1
+    uint32_t *key_index;    // inotify wd 或 fanotify 句柄哈希 -> dirs 下标 + 1
+    uint32_t index_cap;
+    uint32_t key_used;      // key_index 已占用的槽位数（含失效键值）
+    uint32_t *dirty;
+    uint32_t dirty_count, dirty_cap;
+    dev_t fan_devs[32];     // 已加文件系统标记的设备
+    int fan_dev_count;
+    dev_t nofan_devs[32];   // 不支持 fanotify 文件系统标记、改用 inotify 的设备
+    int nofan_dev_count;
+    int incremental;        // 正在增量处理脏目录：已登记的子目录不再向下递归
+    int overflow;           // 事件队列溢出或监听数达到上限，需要完整对账
+    int limit_logged;
+};
+
+// 在路径索引中查找目录，找不到返回 NULL
+static WatchDir *watch_find_path(const WatchSet *ws, const char *path) {
+    if (!ws->index_cap)
+        return NULL;
+    uint32_t mask = ws->index_cap - 1;
+    for (uint32_t i = wl_name_hash(path, strlen(path)) & mask; ws->path_index[i]; i = (i + 1) & mask) {
+        WatchDir *d = &ws->dirs[ws->path_index[i] - 1];
+        if (strcmp(d->path, path) == 0)
+            return d;
+    }
+    return NULL;
+}
+
+// 向索引表插入 dirs 下标（调用方保证容量足够）
+static void watch_index_insert(uint32_t *index, uint32_t cap, uint32_t hash, uint32_t dir) {
+    uint32_t i = hash & (cap - 1);
+    while (index[i])
+        i = (i + 1) & (cap - 1);
+    index[i] = dir + 1;
+}
+
+/*
+   为新目录预留空间。两张索引表按目录数的四倍分配，key_index 中因目录重建而失效的
+   旧键值也占用槽位，负载超过一半时按当前目录重建（必要时扩容）
+*/
+static int watch_reserve(WatchSet *ws) {
+    if (!grow_array((void **)&ws->dirs, &ws->cap, sizeof(WatchDir), ws->count + 1))
+        return 0;
+    if ((ws->count + 1) * 2 <= ws->index_cap && (ws->key_used + 1) * 2 <= ws->index_cap)
+        return 1;
+    uint32_t cap = ws->index_cap ? ws->index_cap : 256;
+    while ((ws->count + 1) * 4 > cap)
+        cap *= 2;
+    uint32_t *path_index = calloc(cap, sizeof(uint32_t));
+    uint32_t *key_index = calloc(cap, sizeof(uint32_t));
+    if (!path_index || !key_index) {
+        free(path_index);
+        free(key_index);
+        return 0;
+    }
+    for (uint32_t i = 0; i < ws->count; i++) {
+        WatchDir *d = &ws->dirs[i];
+        watch_index_insert(path_index, cap, wl_name_hash(d->path, strlen(d->path)), i);
+        watch_index_insert(key_index, cap, d->key_hash, i);
+    }
+    free(ws->path_index);
+    free(ws->key_index);
+    ws->path_index = path_index;
+    ws->key_index = key_index;
+    ws->index_cap = cap;
+    ws->key_used = ws->count;
+    return 1;
+}
+
+// 判断设备是否在列表中
+static int dev_in_list(const dev_t *devs, int count, dev_t dev) {
+    for (int i = 0; i < count; i++) {
+        if (devs[i] == dev)
+            return 1;
+    }
+    return 0;
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+#define WATCH_FAN_MASK (FAN_CREATE | FAN_MOVED_TO | FAN_ONDIR)
+
+// 取得目录的 fsid + 文件句柄，用于与 fanotify 事件中的父目录标识比对；失败返回 0
+static uint32_t watch_dir_handle(int dir_fd, unsigned char *buf, uint32_t cap) {
+    struct statfs sfs;
+    struct {
+        struct file_handle fh;
+        unsigned char bytes[MAX_HANDLE_SZ];
+    } h;
+    int mount_id;
+    h.fh.handle_bytes = MAX_HANDLE_SZ;
+    if (fstatfs(dir_fd, &sfs) != 0 || name_to_handle_at(dir_fd, "", &h.fh, &mount_id, AT_EMPTY_PATH) != 0)
+        return 0;
+    uint32_t len = sizeof(sfs.f_fsid) + sizeof(int) + h.fh.handle_bytes;
+    if (len > cap)
+        return 0;
+    memcpy(buf, &sfs.f_fsid, sizeof(sfs.f_fsid));
+    memcpy(buf + sizeof(sfs.f_fsid), &h.fh.handle_type, sizeof(int));
+    memcpy(buf + sizeof(sfs.f_fsid) + sizeof(int), h.fh.f_handle, h.fh.handle_bytes);
+    return len;
+}
+
+// 确保目录所在文件系统已加 fanotify 标记，不支持时记录该设备并返回 0
+static int watch_fan_mark(WatchSet *ws, int dir_fd, dev_t dev) {
+    if (ws->fan_fd < 0 || dev_in_list(ws->nofan_devs, ws->nofan_dev_count, dev))
+        return 0;
+    if (dev_in_list(ws->fan_devs, ws->fan_dev_count, dev))
+        return 1;
+    if (ws->fan_dev_count < (int)(sizeof(ws->fan_devs) / sizeof(ws->fan_devs[0])) &&
+        fanotify_mark(ws->fan_fd, FAN_MARK_ADD | FAN_MARK_FILESYSTEM, WATCH_FAN_MASK, dir_fd, NULL) == 0) {
+        ws->fan_devs[ws->fan_dev_count++] = dev;
+        return 1;
+    }
+    log_message(2, "无法添加 fanotify 文件系统标记，该分区改用 inotify: %s\n", strerror(errno));
+    if (ws->nofan_dev_count < (int)(sizeof(ws->nofan_devs) / sizeof(ws->nofan_devs[0])))
+        ws->nofan_devs[ws->nofan_dev_count++] = dev;
+    return 0;
+}
+#endif
+
+// 为新登记的目录建立内核监听（fanotify 句柄或 inotify watch），返回 0 表示失败
+static int watch_attach(WatchSet *ws, int dir_fd, WatchDir *d) {
+#ifdef FAN_REPORT_DFID_NAME
+    unsigned char handle[sizeof(fsid_t) + sizeof(int) + MAX_HANDLE_SZ];
+    uint32_t handle_len;
+    if (watch_fan_mark(ws, dir_fd, d->dev) && (handle_len = watch_dir_handle(dir_fd, handle, sizeof(handle)))) {
+        if (!(d->handle = malloc(handle_len)))
+            return 0;
+        memcpy(d->handle, handle, handle_len);
+        d->handle_len = handle_len;
+        d->key_hash = wl_name_hash((const char *)handle, handle_len);
+        return 1;
+    }
+#endif
+    if (ws->ino_fd < 0 && (ws->ino_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) < 0)
+        return 0;
+    // 通过 /proc/self/fd 以目录 fd 添加监听，避免再次解析完整路径
+    char fd_path[64];
+    snprintf(fd_path, sizeof(fd_path), "/proc/self/fd/%d", dir_fd);
+    d->wd = inotify_add_watch(ws->ino_fd, fd_path,
+        IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (d->wd < 0)
+        d->wd = inotify_add_watch(ws->ino_fd, d->path,
+            IN_CREATE | IN_MOVED_TO | IN_ONLYDIR | IN_DONT_FOLLOW);
+    if (d->wd < 0)
+        return 0;
+    d->key_hash = (uint32_t)d->wd * 0x9E3779B1u;
+    return 1;
+}
+
+/*
+   登记遍历经过的规则目录及其角色（规则组 + 层级）。
+   同一目录只建立一次内核监听，角色按需追加；同路径的目录被删除重建后重新建立监听。
+   监听数达到上限后不再登记，由完整对账兜底
+*/
+static void watch_add_locked(WatchSet *ws, int dir_fd, const char *path, const RuleGroup *g, int level, int check_expiry) {
+    struct stat st;
+    if (fstat(dir_fd, &st) != 0)
+        return;
+    if (!path[0])
+        path = "/";
+    WatchDir *d = watch_find_path(ws, path);
+    if (d && (d->dev != st.st_dev || d->ino != st.st_ino)) {
+        // 旧目录已被替换：原有键值在索引中失效（查找时比对实际键值），重新建立监听
+        if (d->wd >= 0)
+            inotify_rm_watch(ws->ino_fd, d->wd);
+        free(d->handle);
+        d->handle = NULL;
+        d->handle_len = 0;
+        d->wd = -1;
+        d->dev = st.st_dev;
+        d->ino = 0;
+        uint32_t idx = (uint32_t)(d - ws->dirs);
+        if (!watch_reserve(ws))
+            return;
+        d = &ws->dirs[idx];
+        if (!watch_attach(ws, dir_fd, d))
+            return;
+        d->ino = st.st_ino;
+        watch_index_insert(ws->key_index, ws->index_cap, d->key_hash, idx);
+        ws->key_used++;
+    } else if (!d) {
+        if (ws->count >= WATCH_MAX_DIRS || !watch_reserve(ws)) {
+            if (!ws->limit_logged)
+                log_message(1, "监听目录数已达上限 %d，其余目录由定期完整扫描处理\n", WATCH_MAX_DIRS);
+            ws->limit_logged = 1;
+            return;
+        }
+        d = &ws->dirs[ws->count];
+        memset(d, 0, sizeof(*d));
+        d->wd = -1;
+        d->dev = st.st_dev;
+        d->ino = st.st_ino;
+        if (!(d->path = strdup(path)))
+            return;
+        if (!watch_attach(ws, dir_fd, d)) {
+            if (errno == ENOSPC && !ws->limit_logged) {
+                log_message(1, "inotify 监听数已达系统上限，其余目录由定期完整扫描处理\n");
+                ws->limit_logged = 1;
+            }
+            free(d->path);
+            free(d->handle);
+            return;
+        }
+        watch_index_insert(ws->path_index, ws->index_cap, wl_name_hash(d->path, strlen(d->path)), ws->count);
+        watch_index_insert(ws->key_index, ws->index_cap, d->key_hash, ws->count);
+        ws->key_used++;
+        ws->count++;
+    }
+    for (WatchRole *r = d->roles; r; r = r->next) {
+        if (r->group == g && r->level == level && r->check_expiry == check_expiry)
+            return;
+    }
+    WatchRole *role = malloc(sizeof(WatchRole));
+    if (!role)
+        return;
+    role->group = g;
+    role->level = level;
+    role->check_expiry = check_expiry;
+    role->next = d->roles;
+    d->roles = role;
+}
+
+static void watch_add(WatchSet *ws, int dir_fd, const char *path, const RuleGroup *g, int level, int check_expiry) {
+    pthread_mutex_lock(&ws->lock);
+    watch_add_locked(ws, dir_fd, path, g, level, check_expiry);
+    pthread_mutex_unlock(&ws->lock);
+}
+
+/*
+   遍历时判断是否需要进入 dir_fd 下的子目录 name：增量处理期间，已登记且未被重建的子目录
+   由其自身的事件驱动，不再递归；新出现的目录照常进入并在遍历中完成登记
+*/
+static int watch_should_descend(int dir_fd, const char *name, const char *path) {
+    const WatchSet *ws = engine->watch;
+    if (!ws || !ws->incremental)
+        return 1;
+    const WatchDir *d = watch_find_path(ws, path[0] ? path : "/");
+    struct stat st;
+    if (!d || fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0)
+        return 1;
+    return d->dev != st.st_dev || d->ino != st.st_ino;
+}
+
+/*
+   多线程遍历（--threads N）：目录作为任务放入各工作线程的双端队列，线程从自己队列的尾部取任务
+   （深度优先，目录 fd 与缓存局部性好），空闲时从其他线程队列的头部窃取较早入队、通常较大的子树。
+   删除任务按目录树维护引用计数：目录在自身扫描结束且所有子目录任务完成后，才检查是否为空并删除
+*/
+enum {
+    TASK_WALK,          // 按遍历计划处理一个目录（前缀树节点、中间目录、基目录及 "**" 子目录）
+    TASK_DELETE_DIR     // 删除目录内容（整体删除或方括号规则过滤），完成后删除空目录
+};
+
+typedef struct Task {
+    int kind;
+    struct Task *parent;        // 删除任务的父目录任务，为空时使用 parent_fd
+    int parent_fd;              // 无父任务时持有的父目录 fd 副本
+    int fd;                     // WALK: 待展开的目录 fd；DELETE_DIR: 扫描后保留的自身目录 fd
+    atomic_int pending;         // 1（自身扫描）+ 未完成的子目录任务数
+    Kept kept;                  // DELETE_DIR: 自身扫描中保留的子项（仅由执行任务的线程修改）
+    int subdirs;                // DELETE_DIR: 自身扫描中遇到的子目录数
+    DirProbe probe;             // DELETE_DIR: 扫描前的目录状态，供扫描状态缓存记录
+    DeadlineRoot *root;         // DELETE_DIR: 所属的到期调度目标
+    RuleProfile *prof;          // DELETE_DIR: 所属规则组的开销计数
+    atomic_int kept_children;   // DELETE_DIR: 未能删除的子目录任务数
+    uint32_t depth;             // DELETE_DIR: 父任务链的长度，链上每个任务都持有一个目录 fd
+    const Whitelist *wl;
+    WlState *wl_state;          // 入口目录的白名单活动集合副本，为空表示子树无需查询
+    const Plan *plan;           // WALK: 遍历计划及目录对应的节点（0 表示不在前缀树上）
+    uint32_t node;
+    Role *roles;                // WALK: 从父目录继承的规则组状态
+    uint32_t role_count;
+    const RuleGroup *group;     // DELETE_DIR: 方括号规则组（可为空）
+    int check_expiry;
+    int days;
+    int skip_root;
+    int nested;                 // DELETE_DIR: 位于删除子树内部（不是规则目标本身），打开时不跨越挂载点
+    size_t path_len;
+    char *name;                 // 指向 path 之后的存储区
+    char path[];
+} Task;
+
+// 工作线程的任务双端队列（环形缓冲），所有者在尾部存取，窃取者从头部取
+typedef struct {
+    pthread_mutex_t lock;
+    Task **items;
+    uint32_t head, count, cap;
+} TaskDeque;
+
+typedef struct {
+    pthread_t thread;
+    TaskDeque deque;
+    DeleteStats stats;
+    int index;
+    ThreadPool *pool;
+} Worker;
+
+struct ThreadPool {
+    CleanContext *ctx;          // 工作线程服务的上下文
+    Worker *workers;
+    int count;
+    int started;                // 已成功启动的线程数
+    pthread_mutex_t lock;
+    pthread_cond_t work_cond;   // 有新任务入队
+    pthread_cond_t done_cond;   // 全部任务完成
+    atomic_int queued;          // 队列中等待执行的任务数
+    atomic_int outstanding;     // 已创建但尚未完成的任务数
+    uint32_t next_inject;       // 主线程提交任务时轮流选择的队列
+    int stop;
+};
+
+static __thread Worker *current_worker = NULL;
+// 大于 0 时当前线程顺序处理，不提交任务（子树处理完后还要对其根目录执行动作）
+static __thread int walk_serial = 0;
+
+// 是否以任务方式并行处理；监听模式的增量处理在主线程内顺序完成
+static int pool_active(void) {
+    return engine->pool && !walk_serial && !(engine->watch && engine->watch->incremental);
+}
+
+static int deque_push(TaskDeque *q, Task *t) {
+    pthread_mutex_lock(&q->lock);
+    if (q->count == q->cap) {
+        uint32_t cap = q->cap ? q->cap * 2 : 64;
+        Task **items = malloc(cap * sizeof(Task *));
+        if (!items) {
+            pthread_mutex_unlock(&q->lock);
+            return 0;
+        }
+        for (uint32_t i = 0; i < q->count; i++)
+            items[i] = q->items[(q->head + i) % q->cap];
+        free(q->items);
+        q->items = items;
+        q->head = 0;
+        q->cap = cap;
+    }
+    q->items[(q->head + q->count++) % q->cap] = t;
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
+static Task *deque_pop(TaskDeque *q) {
+    Task *t = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->count)
+        t = q->items[(q->head + --q->count) % q->cap];
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+static Task *deque_steal(TaskDeque *q) {
+    Task *t = NULL;
+    pthread_mutex_lock(&q->lock);
+    if (q->count) {
+        t = q->items[q->head];
+        q->head = (q->head + 1) % q->cap;
+        q->count--;
+    }
+    pthread_mutex_unlock(&q->lock);
+    return t;
+}
+
+// 创建任务并复制路径与名称；wl_state 非空时保存副本
+static Task *task_new(int kind, const char *path, size_t path_len, const char *name, const WlState *wl_state) {
+    size_t name_len = strlen(name);
+    Task *t = calloc(1, sizeof(Task) + path_len + name_len + 2);
+    if (!t)
+        return NULL;
+    if (wl_state) {
+        if (!(t->wl_state = malloc(sizeof(WlState)))) {
+            free(t);
+            return NULL;
+        }
+        *t->wl_state = *wl_state;
+    }
+    t->kind = kind;
+    t->fd = t->parent_fd = -1;
+    t->kept = (Kept)KEPT_INIT;
+    atomic_init(&t->pending, 1);
+    memcpy(t->path, path, path_len);
+    t->path[path_len] = '\0';
+    t->path_len = path_len;
+    t->name = t->path + path_len + 1;
+    memcpy(t->name, name, name_len + 1);
+    return t;
+}
+
+// 释放任务本身；已关闭的 fd 为 -1
+static void task_free(Task *t) {
+    if (t->fd >= 0)
+        close(t->fd);
+    if (t->parent_fd >= 0)
+        close(t->parent_fd);
+    free(t->wl_state);
+    free(t->roles);
+    free(t);
+}
+
+// 任务入队：工作线程放入自己的队列，主线程轮流放入各线程队列；失败返回 0
+static int pool_push(Task *t) {
+    ThreadPool *p = engine->pool;
+    Worker *w = current_worker ? current_worker : &p->workers[p->next_inject++ % p->count];
+    atomic_fetch_add(&p->outstanding, 1);
+    if (!deque_push(&w->deque, t)) {
+        atomic_fetch_sub(&p->outstanding, 1);
+        return 0;
+    }
+    pthread_mutex_lock(&p->lock);
+    atomic_fetch_add(&p->queued, 1);
+    pthread_cond_signal(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+    return 1;
+}
+
+// 提交遍历任务，接管 dir_fd 并复制继承的规则组状态；失败返回 0，由调用方在当前线程继续处理
+static int pool_spawn_walk(int dir_fd, const char *path, size_t path_len, const Whitelist *wl, const WlState *wl_state,
+    const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count) {
+    Task *t = task_new(TASK_WALK, path, path_len, "", wl_state);
+    if (!t)
+        return 0;
+    if (role_count && !(t->roles = malloc(role_count * sizeof(Role)))) {
+        task_free(t);
+        return 0;
+    }
+    if (role_count)
+        memcpy(t->roles, roles, role_count * sizeof(Role));
+    t->role_count = role_count;
+    t->fd = dir_fd;
+    t->wl = wl;
+    t->plan = plan;
+    t->node = node;
+    if (!pool_push(t)) {
+        t->fd = -1;
+        task_free(t);
+        return 0;
+    }
+    return 1;
+}
+
+// 提交删除目录任务：parent 为空时复制 parent_fd 供任务使用；失败返回 0，由调用方顺序处理
+static int pool_spawn_delete(Task *parent, int parent_fd, const char *name, const char *path, size_t path_len,
+    const Whitelist *wl, const WlState *wl_state, const RuleGroup *filter, int check_expiry, int days, int skip_root,
+    int nested, const DirProbe *probe) {
+    Task *t = task_new(TASK_DELETE_DIR, path, path_len, name, wl_state);
+    if (!t)
+        return 0;
+    if (!parent && (t->parent_fd = fcntl(parent_fd, F_DUPFD_CLOEXEC, 0)) < 0) {
+        task_free(t);
+        return 0;
+    }
+    t->parent = parent;
+    t->depth = parent ? parent->depth + 1 : 0;
+    t->wl = wl;
+    t->group = filter;
+    t->check_expiry = check_expiry;
+    t->days = days;
+    t->skip_root = skip_root;
+    t->nested = nested;
+    t->probe = *probe;
+    t->root = walk_root;
+    t->prof = prof_cur.scope.row;
+    if (parent)
+        atomic_fetch_add(&parent->pending, 1);
+    if (!pool_push(t)) {
+        if (parent)
+            atomic_fetch_sub(&parent->pending, 1);
+        task_free(t);
+        return 0;
+    }
+    return 1;
+}
+
+// 检查子项是否受白名单保护；父目录活动集合为空时直接返回 0，无需任何查询
+static int child_in_whitelist(const Whitelist *wl, const WlState *wl_state, const char *name) {
+    WlState child_state;
+    return wl_state && whitelist_step(wl, wl_state, name, &child_state) != 0;
+}
+
+/*
+   处理待删除目录中的一个子项：受白名单保护的跳过，文件按方括号规则与过期规则删除。
+   返回 1 表示该子项是需要继续处理的子目录，由调用方递归或作为子任务提交；
+   其余情况下子项若被保留则计入 kept
+*/
+static int delete_directory_entry(int fd, DirEntry *entry, const char *path,
+    const Whitelist *wl, const WlState *wl_state, const RuleGroup *filter, int check_expiry, int days, Kept *kept) {
+    if (child_in_whitelist(wl, wl_state, entry->name)) {
+        log_message(2, "项目在白名单中，跳过: %s\n", path);
+        prof_counts[PROF_WHITELIST]++;
+        kept_add(kept, 0);
+        return 0;
+    }
+    int is_dir = entry_is_dir(fd, entry);
+    if (is_dir < 0) {
+        log_message(1, "无法获取文件信息: %s, 错误: %s\n", path, strerror(errno));
+        kept_add(kept, 0);
+    } else if (is_dir) {
+        if (!filter || watch_should_descend(fd, entry->name, path))
+            return 1;
+        kept_add(kept, 0);
+    } else if (!filter || nameset_match(&filter->names, entry->name) >= 0) {
+        if (filter)
+            prof_counts[PROF_MATCHES]++;
+        delete_file_ordered(fd, entry, path, check_expiry, days, kept);
+    } else {
+        kept_add(kept, 0);
+    }
+    return 0;
+}
+
+// 删除已确认清空的目录；清理期间目录中又出现新条目（ENOTEMPTY）时保留，不记为失败
+static int remove_empty_dir_at(int parent_fd, const char *name, const char *path) {
+    if (!delete_allowed(path, 1))
+        return 0;
+    throttle_acquire(1);
+    int err = unlinkat(parent_fd, name, AT_REMOVEDIR) == 0 ? 0 : errno;
+    if (err == ENOTEMPTY || err == EEXIST) {
+        log_message(2, "目录在清理期间出现新条目，保留: %s\n", path);
+        return 0;
+    }
+    note_delete_result(path, 1, 0, err);
+    return err == 0;
+}
+
+/*
+   显式栈的目录遍历：每层目录一个 WalkFrame，深度不受线程栈大小限制。
+   整条路径保存在一个按需增长的缓冲区中，逐层原地追加 "/name"、返回时截断，
+   内存只与深度和名称长度相关，路径超过 PATH_MAX 也能继续（全程相对目录 fd 操作）。
+   同时打开的目录最多 WALK_OPEN_MAX 个：超出时关闭最浅一层已打开的目录，
+   记下已处理到的目录项 d_off（cookie）与 (dev, inode)；回到该层时从刚处理完的子目录
+   openat("..") 重新打开，核对是同一个目录后 lseek 到 cookie 继续读取。
+   已关闭的总是栈底连续的若干层（open_base 之前），因此每次回退至多重新打开一层。
+   重新打开失败（目录在遍历期间被移走）时该层及其祖先不再继续处理，按有保留处理，不会误删
+*/
+#define WALK_OPEN_MAX 32
+
+typedef struct {
+    DirReader reader;   // 已关闭的层 reader.fd 为 -1
+    int64_t cookie;
+    dev_t dev;
+    ino_t ino;
+    size_t path_len;    // 本层目录的路径长度，子项路径在其后追加
+    Kept kept;          // 本层保留下来的子项
+    int subdirs;
+    DirProbe probe;
+} WalkFrame;
+
+typedef struct {
+    WalkFrame *frames;
+    uint32_t depth, cap;
+    uint32_t open_base;     // frames[open_base, depth) 处于打开状态
+    char *path;
+    size_t path_cap;
+    int any_fs;             // 为 1 时各层都可以跨越挂载点（规则前缀中的 "**" 目录）
+} DirWalk;
+
+static int dir_walk_init(DirWalk *w, const char *path, size_t path_len) {
+    memset(w, 0, sizeof(*w));
+    w->path_cap = path_len + 256;
+    if (!(w->path = malloc(w->path_cap)))
+        return 0;
+    memcpy(w->path, path, path_len);
+    w->path[path_len] = '\0';
+    return 1;
+}
+
+static void dir_walk_free(DirWalk *w) {
+    while (w->depth)
+        dir_reader_close(&w->frames[--w->depth].reader);
+    free(w->frames);
+    free(w->path);
+}
+
+// 在路径缓冲区末尾追加 "/name"，返回新长度；内存不足时返回 0
+static size_t dir_walk_path_push(DirWalk *w, size_t len, const char *name) {
+    size_t name_len = strlen(name);
+    if (len + name_len + 2 > w->path_cap) {
+        size_t cap = (len + name_len + 2) * 2;
+        char *path = realloc(w->path, cap);
+        if (!path)
+            return 0;
+        w->path = path;
+        w->path_cap = cap;
+    }
+    w->path[len] = '/';
+    memcpy(w->path + len + 1, name, name_len + 1);
+    return len + 1 + name_len;
+}
+
+// 打开 parent_fd 下的子目录 name 作为新的一层，路径已追加到 path_len；打不开时返回 0
+static int dir_walk_push(DirWalk *w, int parent_fd, const char *name, size_t path_len, const DirProbe *probe) {
+    // 批量后端中待提交的文件引用各层的目录 fd 与保留计数，移动或关闭层之前先提交
+    if (w->depth == w->cap) {
+        file_batch_flush();
+        if (!grow_array((void **)&w->frames, &w->cap, sizeof(WalkFrame), w->depth + 1))
+            return 0;
+    }
+    WalkFrame *f = &w->frames[w->depth];
+    // 入口目录是规则目标本身，其下各层不跨越挂载点
+    if (!dir_reader_open(&f->reader, w->depth && !w->any_fs ? open_subdir_at(parent_fd, name) : open_dir_at(parent_fd, name)))
+        return 0;
+    f->path_len = path_len;
+    f->kept = (Kept)KEPT_INIT;
+    f->subdirs = 0;
+    f->probe = *probe;
+    w->depth++;
+    if (w->depth - w->open_base > WALK_OPEN_MAX) {
+        WalkFrame *old = &w->frames[w->open_base++];
+        struct stat st;
+        file_batch_flush();
+        old->cookie = old->reader.off;
+        if (fstat(old->reader.fd, &st) == 0) {
+            old->dev = st.st_dev;
+            old->ino = st.st_ino;
+        } else {
+            old->ino = 0;
+        }
+        dir_reader_close(&old->reader);
+    }
+    return 1;
+}
+
+// 取当前层的下一个子项；该层无法重新打开时返回 -1
+static int dir_walk_next(DirWalk *w, DirEntry *e) {
+    WalkFrame *f = &w->frames[w->depth - 1];
+    return f->reader.fd >= 0 ? dir_reader_next(&f->reader, e) : -1;
+}
+
+/*
+   结束当前层并回到上一层，返回上一层的目录 fd（已回到顶层时返回 parent_fd），
+   供调用方删除刚结束的这一层；上一层无法重新打开时返回 -1
+*/
+static int dir_walk_pop(DirWalk *w, int parent_fd) {
+    WalkFrame *child = &w->frames[--w->depth];
+    int fd = parent_fd;
+    if (w->depth) {
+        WalkFrame *f = &w->frames[w->depth - 1];
+        if (w->depth - 1 < w->open_base) {
+            int dir_fd = child->reader.fd >= 0 ? openat(child->reader.fd, "..", O_RDONLY | O_DIRECTORY | O_CLOEXEC) : -1;
+            struct stat st;
+            if (dir_fd >= 0 && (fstat(dir_fd, &st) != 0 || st.st_dev != f->dev || st.st_ino != f->ino ||
+                                lseek(dir_fd, f->cookie, SEEK_SET) < 0)) {
+                close(dir_fd);
+                dir_fd = -1;
+            }
+            if (!dir_reader_open(&f->reader, dir_fd))
+                log_message(1, "无法重新打开目录: %.*s，跳过其余内容\n", (int)f->path_len, w->path);
+            w->open_base = w->depth - 1;
+        }
+        fd = f->reader.fd;
+    }
+    dir_reader_close(&child->reader);
+    return fd;
+}
+
+/*
+   删除目录及其内容：适用于删除符合条件的目录或文件。
+   目录通过 parent_fd + name 相对打开，子项均以 fstatat/unlinkat 相对当前目录 fd 操作，
+   完整路径只在 DirWalk 的路径缓冲区中原地追加/截断，用于白名单判断与日志。
+   filter 非空时只删除名称匹配该规则组的文件（方括号规则），监听模式下同时登记各级子目录。
+   调用方负责该目录本身的白名单检查；未受保护目录的子项活动集合必为空，
+   因此除入口目录外，整棵子树的删除都不再逐项查询白名单。
+   后序遍历：每层统计保留下来的子项数，为 0 时直接 rmdir，不再重新读取目录判断是否为空，
+   整棵子树的每个目录只读取一次（超出打开数上限而重新打开的层除外）。返回 1 表示目录本身已被删除。
+   过期删除时扫描状态缓存确认没有过期文件的目录直接跳过（返回 0）。
+   多线程模式下整个目录作为任务提交，由工作线程并行处理（此时返回 0）
+*/
+static int delete_directory_at(int parent_fd, const char *name, char *path, size_t path_len,
+    const Whitelist *wl, const WlState *wl_state, const RuleGroup *filter, int check_expiry, int days, int skip_root) {
+    if (!name || !path)
+        return 0;
+    DirProbe probe;
+    if (scan_cache_skip(parent_fd, name, path, filter, check_expiry, days, &probe))
+        return 0;
+    if (pool_active() &&
+        pool_spawn_delete(NULL, parent_fd, name, path, path_len, wl, wl_state, filter, check_expiry, days, skip_root, 0, &probe))
+        return 0;
+    DirWalk w;
+    if (!dir_walk_init(&w, path, path_len) || !dir_walk_push(&w, parent_fd, name, path_len, &probe)) {
+        log_message(1, "无法打开目录: %s, 错误: %s\n", path, strerror(errno));
+        dir_walk_free(&w);
+        return 0;
+    }
+    if (filter && engine->watch)
+        watch_add(engine->watch, w.frames[0].reader.fd, path, filter, filter->middle_count, check_expiry);
+    int removed = 0;
+    while (w.depth) {
+        WalkFrame *f = &w.frames[w.depth - 1];
+        // 只有入口目录的子项需要查询白名单
+        const WlState *state = w.depth == 1 ? wl_state : NULL;
+        DirEntry entry;
+        int ret, descended = 0;
+        while ((ret = dir_walk_next(&w, &entry)) > 0) {
+            int fd = f->reader.fd;
+            size_t len = dir_walk_path_push(&w, f->path_len, entry.name);
+            if (!len) {
+                log_message(1, "内存分配失败: %s/%s\n", w.path, entry.name);
+                kept_add(&f->kept, 0);
+                continue;
+            }
+            if (delete_directory_entry(fd, &entry, w.path, wl, state, filter, check_expiry, days, &f->kept)) {
+                DirProbe child_probe;
+                f->subdirs++;
+                if (scan_cache_skip(fd, entry.name, w.path, filter, check_expiry, days, &child_probe) ||
+                    (len < PATH_MAX && pool_active() &&
+                     pool_spawn_delete(NULL, fd, entry.name, w.path, len, wl, NULL, filter, check_expiry, days, 0, 1, &child_probe))) {
+                    kept_add(&f->kept, 0);
+                } else if (dir_walk_push(&w, fd, entry.name, len, &child_probe)) {
+                    f = &w.frames[w.depth - 1];
+                    if (filter && engine->watch)
+                        watch_add(engine->watch, f->reader.fd, w.path, filter, filter->middle_count, check_expiry);
+                    descended = 1;
+                    break;
+                } else {
+                    log_subdir_error(w.path);
+                    f = &w.frames[w.depth - 1];
+                    kept_add(&f->kept, 0);
+                }
+            }
+            w.path[f->path_len] = '\0';
+        }
+        if (descended)
+            continue;
+        // 读取目录出错时无法确认已清空
+        if (ret < 0)
+            kept_add(&f->kept, 0);
+        // 批量后端中本目录的文件须在统计保留数、关闭目录 fd 之前提交
+        file_batch_flush();
+        scan_cache_record(&f->probe, &f->kept, f->subdirs);
+        int empty = f->kept.count == 0;
+        size_t name_off = w.depth > 1 ? w.frames[w.depth - 2].path_len + 1 : 0;
+        int fd = dir_walk_pop(&w, parent_fd);
+        if (!w.depth) {
+            removed = !skip_root && empty && remove_empty_dir_at(parent_fd, name, w.path);
+            break;
+        }
+        f = &w.frames[w.depth - 1];
+        if (!empty || fd < 0 || !remove_empty_dir_at(fd, w.path + name_off, w.path))
+            kept_add(&f->kept, 0);
+        w.path[f->path_len] = '\0';
+    }
+    dir_walk_free(&w);
+    return removed;
+}
+
+/*
+   回收目录快速路径：不带通配符的 -1 目录目标不再就地递归删除，而是用 renameat2 原子地移入
+   所在文件系统挂载根下的 TRASH_NAME 目录，目标在一次系统调用内从原位置消失，应用不会
+   再往删了一半的目录树里写入新文件；真正的逐项删除由一个 nice 19、idle I/O 优先级的后台
+   线程完成，并同样受删除限速约束。较大的文件可以先分段截断再删除（trash_chunk），
+   避免一次 unlink 释放大量块时长时间占用文件系统日志。
+   移动失败（跨设备、目标本身是挂载点、无法建立回收目录等）时照常直接删除。
+   统计中移入回收目录的目标计为一个已删除目录，其中的文件由后台线程另行记录日志
+*/
+#define TRASH_NAME ".clean-trash"
+
+#ifndef RENAME_NOREPLACE
+#define RENAME_NOREPLACE 1
+#endif
+
+// 求设备号为 dev 的文件系统的挂载根：path 从 "/" 开始第一个设备号相同的前缀
+static int trash_mount_root(const char *path, dev_t dev, char *root) {
+    size_t len = strlen(path);
+    struct stat st;
+    if (path[0] != '/' || len >= PATH_MAX)
+        return 0;
+    if (stat("/", &st) == 0 && st.st_dev == dev) {
+        strcpy(root, "/");
+        return 1;
+    }
+    memcpy(root, path, len + 1);
+    for (size_t i = 1; i <= len; i++) {
+        if (root[i] != '/' && root[i] != '\0')
+            continue;
+        char c = root[i];
+        root[i] = '\0';
+        if (stat(root, &st) == 0 && st.st_dev == dev)
+            return 1;
+        root[i] = c;
+    }
+    return 0;
+}
+
+// 在挂载根下打开（必要时建立）回收目录，确认仍在同一文件系统上；失败返回 -1
+static int trash_open(const char *root, dev_t dev) {
+    char path[PATH_MAX];
+    struct stat st;
+    snprintf(path, sizeof(path), "%s%s" TRASH_NAME, root, strcmp(root, "/") == 0 ? "" : "/");
+    if (mkdir(path, 0700) != 0 && errno != EEXIST) {
+        log_message(1, "无法建立回收目录: %s, 错误: %s，改为直接删除\n", path, strerror(errno));
+        return -1;
+    }
+    int fd = open(path, O_RDONLY | O_DIRECTORY | O_NOFOLLOW | O_CLOEXEC);
+    if (fd < 0 || fstat(fd, &st) != 0 || st.st_dev != dev) {
+        log_message(1, "无法使用回收目录: %s，改为直接删除\n", path);
+        if (fd >= 0)
+            close(fd);
+        return -1;
+    }
+    log_message(2, "回收目录: %s\n", path);
+    return fd;
+}
+
+static void *trash_main(void *arg);
+
+// 通知后台线程处理回收目录，持有 t->lock 时调用；首次调用时启动线程
+static void trash_wake_locked(Trash *t) {
+    if (!t->started) {
+        if (pthread_create(&t->thread, NULL, trash_main, engine) != 0) {
+            log_message(1, "无法启动回收目录清理线程\n");
+            return;
+        }
+        t->started = 1;
+    }
+    t->pending = 1;
+    pthread_cond_signal(&t->cond);
+}
+
+// 取设备号为 dev 的文件系统的回收目录，第一次遇到该文件系统时建立，并顺带清理上次留下的内容
+static int trash_dir_fd(dev_t dev, const char *path) {
+    Trash *t = &engine->trash;
+    int fd = -1, i;
+    pthread_mutex_lock(&t->lock);
+    for (i = 0; i < t->count && t->dirs[i].dev != dev; i++)
+        ;
+    if (i < t->count) {
+        fd = t->dirs[i].fd;
+    } else if (i < TRASH_MAX_DEVS) {
+        char root[PATH_MAX];
+        if (trash_mount_root(path, dev, root))
+            fd = trash_open(root, dev);
+        t->dirs[i].dev = dev;
+        t->dirs[i].fd = fd;
+        t->count++;
+        if (fd >= 0)
+            trash_wake_locked(t);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return fd;
+}
+
+// 把目录目标移入回收目录，成功（或目标已不存在）返回 1；返回 0 时由调用方直接删除
+static int trash_move(int dir_fd, const char *name, const char *path) {
+    Trash *t = &engine->trash;
+    struct stat st;
+    if (path[0] != '/' || fstat(dir_fd, &st) != 0)
+        return 0;
+    int trash_fd = trash_dir_fd(st.st_dev, path);
+    if (trash_fd < 0)
+        return 0;
+    char trash_name[64];
+    snprintf(trash_name, sizeof(trash_name), "%lld.%d.%u", (long long)time(NULL), (int)getpid(),
+        atomic_fetch_add(&t->seq, 1));
+    throttle_acquire(1);
+    if (syscall(SYS_renameat2, dir_fd, name, trash_fd, trash_name, RENAME_NOREPLACE) != 0) {
+        if (errno == ENOENT)
+            return 1;
+        log_message(2, "无法移入回收目录: %s, 错误: %s，改为直接删除\n", path, strerror(errno));
+        return 0;
+    }
+    log_message(2, "已移入回收目录: %s -> %s\n", path, trash_name);
+    note_delete_result(path, 1, 0, 0);
+    pthread_mutex_lock(&t->lock);
+    trash_wake_locked(t);
+    pthread_mutex_unlock(&t->lock);
+    return 1;
+}
+
+// 分段截断只有一个链接的大文件，每段之后让出存储队列；失败时留给 unlink 处理
+static void trash_truncate(int dir_fd, const char *name) {
+    uint64_t chunk = engine->trash.chunk;
+    struct stat st;
+    if (fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0 || !S_ISREG(st.st_mode) ||
+        st.st_nlink != 1 || (uint64_t)st.st_size <= chunk)
+        return;
+    int fd = openat(dir_fd, name, O_WRONLY | O_NOFOLLOW | O_NONBLOCK | O_CLOEXEC);
+    if (fd < 0)
+        return;
+    // 打开前后可能被替换为其他文件，确认仍是同一个只有一个链接的文件
+    struct stat cur;
+    if (fstat(fd, &cur) == 0 && cur.st_ino == st.st_ino && cur.st_dev == st.st_dev && cur.st_nlink == 1) {
+        uint64_t size = (uint64_t)cur.st_size;
+        while (size > chunk) {
+            size -= chunk;
+            throttle_acquire(1);
+            if (ftruncate(fd, (off_t)size) != 0)
+                break;
+        }
+    }
+    close(fd);
+}
+
+// 删除回收目录中的条目并计数；失败时（应用在移动前打开的目录中仍可能写入新文件）留到下一次处理
+static int trash_unlink(int dir_fd, const char *name, const char *path, int is_dir) {
+    throttle_acquire(1);
+    if (unlinkat(dir_fd, name, is_dir ? AT_REMOVEDIR : 0) != 0) {
+        log_message(2, "回收目录中的条目暂时无法删除: %s, 错误: %s\n", path, strerror(errno));
+        return 0;
+    }
+    if (is_dir)
+        thread_stats->dirs++;
+    else
+        thread_stats->files++;
+    return 1;
+}
+
+// 后序删除一个回收目录的全部内容，目录层次用显式栈遍历（见 DirWalk）
+static void trash_drain(int trash_fd) {
+    DirWalk w;
+    DirProbe probe = { 0 };
+    if (!dir_walk_init(&w, "", 0) || !dir_walk_push(&w, trash_fd, ".", 0, &probe)) {
+        dir_walk_free(&w);
+        return;
+    }
+    while (w.depth) {
+        WalkFrame *f = &w.frames[w.depth - 1];
+        DirEntry e;
+        int ret, descended = 0;
+        while ((ret = dir_walk_next(&w, &e)) > 0) {
+            int fd = f->reader.fd;
+            size_t len = dir_walk_path_push(&w, f->path_len, e.name);
+            int is_dir = entry_is_dir(fd, &e);
+            if (!len || is_dir < 0) {
+                kept_add(&f->kept, 0);
+            } else if (is_dir) {
+                if (dir_walk_push(&w, fd, e.name, len, &probe)) {
+                    descended = 1;
+                    break;
+                }
+                f = &w.frames[w.depth - 1];
+                kept_add(&f->kept, 0);
+            } else {
+                if (engine->trash.chunk && e.type != DT_LNK)
+                    trash_truncate(fd, e.name);
+                if (!trash_unlink(fd, e.name, w.path, 0))
+                    kept_add(&f->kept, 0);
+            }
+            w.path[f->path_len] = '\0';
+        }
+        if (descended)
+            continue;
+        int empty = ret == 0 && f->kept.count == 0;
+        size_t name_off = w.depth > 1 ? w.frames[w.depth - 2].path_len + 1 : 0;
+        int fd = dir_walk_pop(&w, -1);
+        if (!w.depth)
+            break;
+        f = &w.frames[w.depth - 1];
+        if (!empty || fd < 0 || !trash_unlink(fd, w.path + name_off, w.path, 1))
+            kept_add(&f->kept, 0);
+        w.path[f->path_len] = '\0';
+    }
+    dir_walk_free(&w);
+}
+
+// 后台删除线程：被唤醒后清空全部回收目录；停止时先处理完已移入的内容
+static void *trash_main(void *arg) {
+    CleanContext *ctx = arg;
+    Trash *t = &ctx->trash;
+    DeleteStats done = { 0 };
+    engine = ctx;
+    thread_stats = &done;
+    if (setpriority(PRIO_PROCESS, (id_t)syscall(SYS_gettid), 19) != 0 ||
+        syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_IDLE) != 0)
+        log_message(2, "无法降低回收目录清理线程的优先级: %s\n", strerror(errno));
+    pthread_mutex_lock(&t->lock);
+    for (;;) {
+        while (!t->pending && !t->stop)
+            pthread_cond_wait(&t->cond, &t->lock);
+        if (!t->pending)
+            break;
+        t->pending = 0;
+        int count = t->count;
+        pthread_mutex_unlock(&t->lock);
+        for (int i = 0; i < count; i++)
+            if (t->dirs[i].fd >= 0)
+                trash_drain(t->dirs[i].fd);
+        if (done.files || done.dirs)
+            log_message(2, "回收目录清理完成: 删除 %d 个文件、%d 个目录\n", done.files, done.dirs);
+        memset(&done, 0, sizeof(done));
+        pthread_mutex_lock(&t->lock);
+    }
+    pthread_mutex_unlock(&t->lock);
+    return NULL;
+}
+
+static void trash_init(Trash *t, const CleanOptions *opt) {
+    pthread_mutex_init(&t->lock, NULL);
+    pthread_cond_init(&t->cond, NULL);
+    t->enabled = opt->trash;
+    t->chunk = opt->trash_chunk;
+}
+
+// 等待后台线程删除完已移入的内容后释放
+static void trash_free(Trash *t) {
+    pthread_mutex_lock(&t->lock);
+    t->stop = 1;
+    pthread_cond_signal(&t->cond);
+    pthread_mutex_unlock(&t->lock);
+    if (t->started)
+        pthread_join(t->thread, NULL);
+    for (int i = 0; i < t->count; i++)
+        if (t->dirs[i].fd >= 0)
+            close(t->dirs[i].fd);
+    pthread_cond_destroy(&t->cond);
+    pthread_mutex_destroy(&t->lock);
+}
+
+// 处理命中规则的目标条目：目录整体递归删除（或移入回收目录），文件（含符号链接）按过期规则删除
+static void delete_target_at(int dir_fd, DirEntry *entry, char *path, size_t len,
+    const Whitelist *wl, const WlState *wl_state, int check_expiry, int days) {
+    if (child_in_whitelist(wl, wl_state, entry->name)) {
+        log_message(2, "跳过白名单项: %s\n", path);
+        prof_counts[PROF_WHITELIST]++;
+        return;
+    }
+    int is_dir = entry_is_dir(dir_fd, entry);
+    if (is_dir < 0) {
+        if (errno != ENOENT)
+            log_message(1, "无法获取文件信息: %s, 错误: %s\n", path, strerror(errno));
+    } else if (is_dir) {
+        if (!check_expiry && engine->trash.enabled && !engine->opt.decide && trash_move(dir_fd, entry->name, path))
+            return;
+        delete_directory_at(dir_fd, entry->name, path, len, wl, NULL, NULL, check_expiry, days, 0);
+    } else {
+        delete_file_ordered(dir_fd, entry, path, check_expiry, days, NULL);
+    }
+}
+
+// 求子目录在白名单索引中的活动集合，返回 WL_* 标志；父目录集合为空时子目录集合也为空
+static int child_whitelist_state(const Whitelist *wl, const WlState *wl_state, const char *name, WlState *child_state) {
+    child_state->count = 0;
+    child_state->overflow = 0;
+    return wl_state ? whitelist_step(wl, wl_state, name, child_state) : 0;
+}
+
+/*
+   配额规则：命中的目录（配额根）总占用超过配额时，按修改时间从旧到新删除文件，
+   释放量刚好达到超出部分即停止，近期仍在使用的缓存文件得以保留。
+   超出量要在统计完整个目录后才知道，因此分两遍：第一遍只累计占用（stx_blocks），
+   未超额时到此为止（常见情况）；超额时第二遍用以 mtime 为键的有界最大堆收集候选，
+   堆内只保留"去掉最新一项后仍不足超出量"的最旧文件集合，复杂度 O(n log k)，
+   内存只与最终删除的文件数 k 相关。受白名单保护的文件计入占用但不会被删除；
+   子目录不会因清空而删除
+*/
+typedef struct {
+    time_t mtime;
+    uint64_t bytes;
+    ino_t ino;
+    char *rel;           // 相对配额根的路径
+} QuotaItem;
+
+typedef struct {
+    QuotaItem *heap;     // 最大堆，堆顶为候选中最新的文件
+    uint32_t count, cap;
+    uint64_t heap_bytes;
+    uint64_t excess;     // 需要释放的字节数
+    uint64_t total;      // 已统计的总占用
+    int collect;         // 0 为第一遍（只统计），1 为第二遍（收集候选）
+    int incomplete;      // 有子目录或文件未能统计，占用偏小，本轮不按配额删除
+    size_t rel_off;      // 路径缓冲区中相对路径的起始位置
+} QuotaScan;
+
+static void quota_sift_down(QuotaItem *heap, uint32_t count, uint32_t i) {
+    for (;;) {
+        uint32_t largest = i, l = 2 * i + 1, r = l + 1;
+        if (l < count && heap[l].mtime > heap[largest].mtime)
+            largest = l;
+        if (r < count && heap[r].mtime > heap[largest].mtime)
+            largest = r;
+        if (largest == i)
+            return;
+        QuotaItem tmp = heap[i];
+        heap[i] = heap[largest];
+        heap[largest] = tmp;
+        i = largest;
+    }
+}
+
+// 弹出堆顶（候选中最新的文件）
+static void quota_pop(QuotaScan *qs) {
+    qs->heap_bytes -= qs->heap[0].bytes;
+    free(qs->heap[0].rel);
+    qs->heap[0] = qs->heap[--qs->count];
+    quota_sift_down(qs->heap, qs->count, 0);
+}
+
+// 提交一个候选文件；比已足够覆盖超出量的候选集中最新一项还新的文件直接丢弃
+static void quota_offer(QuotaScan *qs, const DirEntry *e, uint64_t bytes, const char *rel) {
+    if (qs->heap_bytes >= qs->excess && qs->count && e->mtime >= qs->heap[0].mtime)
+        return;
+    QuotaItem item = { e->mtime, bytes, e->ino, strdup(rel) };
+    if (!item.rel || !grow_array((void **)&qs->heap, &qs->cap, sizeof(QuotaItem), qs->count + 1)) {
+        free(item.rel);
+        return;
+    }
+    uint32_t i = qs->count++;
+    while (i > 0 && qs->heap[(i - 1) / 2].mtime < item.mtime) {
+        qs->heap[i] = qs->heap[(i - 1) / 2];
+        i = (i - 1) / 2;
+    }
+    qs->heap[i] = item;
+    qs->heap_bytes += bytes;
+    while (qs->count > 1 && qs->heap_bytes - qs->heap[0].bytes >= qs->excess)
+        quota_pop(qs);
+}
+
+// 配额扫描中一层目录的白名单状态；protected 表示整个目录受白名单保护
+typedef struct {
+    WlState wl_state;
+    int has_wl;
+    int protected;
+} QuotaFrame;
+
+/*
+   遍历配额根 parent_fd/name，累计占用并在第二遍收集候选。目录层次用显式栈遍历（见 DirWalk），
+   每层只打开一次，打开的目录数受 WALK_OPEN_MAX 限制；子目录不跨越挂载点（挂载点不计入占用）。
+   配额根本身打不开时返回 0；其下有内容未能统计时置 qs->incomplete
+*/
+static int quota_scan(int parent_fd, const char *name, const char *path, size_t path_len,
+    const Whitelist *wl, const WlState *wl_state, QuotaScan *qs) {
+    DirWalk w;
+    DirProbe probe = { 0 };
+    QuotaFrame *frames = NULL;
+    uint32_t frame_cap = 0;
+    if (!dir_walk_init(&w, path, path_len) || !grow_array((void **)&frames, &frame_cap, sizeof(QuotaFrame), 1) ||
+        !dir_walk_push(&w, parent_fd, name, path_len, &probe)) {
+        if (errno != ENOENT && errno != ENOTDIR)
+            log_message(1, "无法打开目录: %s, 错误: %s\n", path, strerror(errno));
+        free(frames);
+        dir_walk_free(&w);
+        return 0;
+    }
+    frames[0].has_wl = wl_state != NULL;
+    if (wl_state)
+        frames[0].wl_state = *wl_state;
+    frames[0].protected = 0;
+    while (w.depth) {
+        WalkFrame *f = &w.frames[w.depth - 1];
+        DirEntry entry;
+        int ret, descended = 0;
+        while ((ret = dir_walk_next(&w, &entry)) > 0) {
+            int fd = f->reader.fd;
+            QuotaFrame *q = &frames[w.depth - 1];
+            const WlState *state = q->has_wl ? &q->wl_state : NULL;
+            size_t len = dir_walk_path_push(&w, f->path_len, entry.name);
+            if (!len || len >= PATH_MAX) {
+                log_message(1, "路径过长: %s/%s\n", w.path, entry.name);
+                w.path[f->path_len] = '\0';
+                qs->incomplete = 1;
+                continue;
+            }
+            int is_dir = entry_is_dir(fd, &entry);
+            if (is_dir > 0) {
+                WlState child_state;
+                int flags = q->protected ? WL_PROTECTED : child_whitelist_state(wl, state, entry.name, &child_state);
+                if (!grow_array((void **)&frames, &frame_cap, sizeof(QuotaFrame), w.depth + 1)) {
+                    log_message(1, "内存分配失败: %s\n", w.path);
+                    qs->incomplete = 1;
+                } else if (dir_walk_push(&w, fd, entry.name, len, &probe)) {
+                    QuotaFrame *child = &frames[w.depth - 1];
+                    child->protected = flags & WL_PROTECTED;
+                    child->has_wl = !child->protected && child_state.count;
+                    if (child->has_wl)
+                        child->wl_state = child_state;
+                    descended = 1;
+                    break;
+                } else if (errno != ENOENT) {
+                    log_subdir_error(w.path);
+                    if (errno != EXDEV)
+                        qs->incomplete = 1;
+                }
+                f = &w.frames[w.depth - 1];
+            } else if (is_dir == 0 && entry_stat(fd, &entry, STATX_MTIME | STATX_BLOCKS) == 0) {
+                uint64_t bytes = entry.blocks * 512;
+                qs->total += bytes;
+                if (qs->collect && !q->protected && !child_in_whitelist(wl, state, entry.name))
+                    quota_offer(qs, &entry, bytes, w.path + qs->rel_off);
+            } else if (errno != ENOENT) {
+                log_message(1, "无法获取文件信息: %s, 错误: %s\n", w.path, strerror(errno));
+                qs->incomplete = 1;
+            }
+            w.path[f->path_len] = '\0';
+        }
+        if (descended)
+            continue;
+        // 读取出错或该层无法重新打开（dir_walk_pop 已记录）时，其余子项未能统计
+        if (ret < 0) {
+            if (f->reader.fd >= 0)
+                log_message(1, "无法读取目录: %.*s, 错误: %s\n", (int)f->path_len, w.path, strerror(errno));
+            qs->incomplete = 1;
+        }
+        dir_walk_pop(&w, parent_fd);
+        if (w.depth)
+            w.path[w.frames[w.depth - 1].path_len] = '\0';
+    }
+    free(frames);
+    dir_walk_free(&w);
+    return 1;
+}
+
+/*
+   按相对路径逐级重新打开候选文件的父目录（不跟随符号链接），确认文件仍是收集时的那一个
+   且此后未被修改，再删除；返回释放的字节数，文件已变化或删除失败时返回 0
+*/
+static uint64_t quota_evict(int root_fd, char *path, size_t path_len, const QuotaItem *item) {
+    char rel[PATH_MAX];
+    snprintf(rel, sizeof(rel), "%s", item->rel);
+    size_t len = path_push(path, path_len, rel);
+    if (!len)
+        return 0;
+    int dir_fd = root_fd;
+    char *name = rel;
+    for (char *slash; (slash = strchr(name, '/')); name = slash + 1) {
+        *slash = '\0';
+        int fd = open_dir_at(dir_fd, name);
+        if (dir_fd != root_fd)
+            close(dir_fd);
+        if ((dir_fd = fd) < 0)
+            break;
+    }
+    uint64_t freed = 0;
+    struct stat st;
+    prof_counts[PROF_STATS]++;
+    if (dir_fd >= 0 && fstatat(dir_fd, name, &st, AT_SYMLINK_NOFOLLOW) == 0 && !S_ISDIR(st.st_mode)) {
+        if (st.st_ino != item->ino || st.st_mtime != item->mtime)
+            log_message(2, "文件在扫描后已变化，保留: %s\n", path);
+        else if (delete_item_at(dir_fd, name, path, 0, S_ISLNK(st.st_mode)))
+            freed = item->bytes;
+    }
+    if (dir_fd >= 0 && dir_fd != root_fd)
+        close(dir_fd);
+    path[path_len] = '\0';
+    return freed;
+}
+
+// 对命中配额规则的目录执行配额检查与按旧到新的删除
+static void quota_enforce_at(int parent_fd, const char *name, char *path, size_t path_len,
+    const Whitelist *wl, const WlState *wl_state, uint64_t quota) {
+    QuotaScan qs;
+    memset(&qs, 0, sizeof(qs));
+    qs.rel_off = path_len + 1;
+    if (!quota_scan(parent_fd, name, path, path_len, wl, wl_state, &qs))
+        return;
+    // 统计不完整时占用偏小，"未超出配额"的结论与删除候选都不可靠
+    if (qs.incomplete) {
+        log_message(1, "目录占用统计不完整（已统计 %llu 字节），本轮跳过配额检查: %s\n",
+            (unsigned long long)qs.total, path);
+        return;
+    }
+    if (qs.total <= quota) {
+        log_message(2, "目录未超出配额: %s, 占用 %llu 字节, 配额 %llu 字节\n",
+            path, (unsigned long long)qs.total, (unsigned long long)quota);
+        return;
+    }
+    log_message(1, "目录超出配额: %s, 占用 %llu 字节, 配额 %llu 字节\n",
+        path, (unsigned long long)qs.total, (unsigned long long)quota);
+    qs.excess = qs.total - quota;
+    qs.total = 0;
+    qs.collect = 1;
+    // 删除时重新打开配额根，逐个核对候选文件仍是扫描时的那一个
+    int root_fd = -1;
+    if (!quota_scan(parent_fd, name, path, path_len, wl, wl_state, &qs) || qs.incomplete) {
+        log_message(1, "目录占用统计不完整，本轮跳过配额清理: %s\n", path);
+    } else if ((root_fd = open_dir_at(parent_fd, name)) < 0) {
+        log_message(1, "无法打开目录: %s, 错误: %s，本轮跳过配额清理\n", path, strerror(errno));
+    } else {
+        // 原地堆排序，得到按 mtime 从旧到新排列的候选
+        for (uint32_t n = qs.count; n > 1; n--) {
+            QuotaItem tmp = qs.heap[0];
+            qs.heap[0] = qs.heap[n - 1];
+            qs.heap[n - 1] = tmp;
+            quota_sift_down(qs.heap, n - 1, 0);
+        }
+        uint64_t freed = 0;
+        int evicted = 0;
+        for (uint32_t i = 0; i < qs.count && freed < qs.excess; i++) {
+            uint64_t bytes = quota_evict(root_fd, path, path_len, &qs.heap[i]);
+            if (bytes) {
+                stats_add((long long)bytes, 0);
+                freed += bytes;
+                evicted++;
+            }
+        }
+        close(root_fd);
+        log_message(1, "配额清理: %s, 删除 %d 个文件, 释放 %llu 字节%s\n", path, evicted,
+            (unsigned long long)freed, freed < qs.excess ? "（可删除的文件不足，仍超出配额）" : "");
+    }
+    for (uint32_t i = 0; i < qs.count; i++)
+        free(qs.heap[i].rel);
+    free(qs.heap);
+}
+
+// 命中叶子模式的条目要执行的动作
+#define TARGET_DELETE 1  // -1 规则：直接删除
+#define TARGET_EXPIRY 2  // -2 规则：删除已过期的部分
+#define TARGET_QUOTA  4  // 配额规则：目录超出配额时按旧到新删除
+
+static void plan_visit(int dir_fd, char *path, size_t path_len, const Whitelist *wl, const WlState *wl_state,
+    const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count);
+
+// 进入已打开的子目录继续遍历，接管 fd；多线程模式下作为任务提交
+static void plan_descend(int fd, char *path, size_t path_len, const Whitelist *wl, const WlState *wl_state,
+    const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count) {
+    if (pool_active() && pool_spawn_walk(fd, path, path_len, wl, wl_state, plan, node, roles, role_count))
+        return;
+    plan_visit(fd, path, path_len, wl, wl_state, plan, node, roles, role_count);
+    close(fd);
+}
+
+// 规则组在该层级是否需要扫描目录；只含字面量名称的层级按名称直接探测
+static int role_needs_scan(const Role *r) {
+    const RuleGroup *g = r->group;
+    if (r->level < g->middle_count)
+        return component_is_glob(g->middle[r->level], strlen(g->middle[r->level]));
+    if (g->mode == RULE_FILTER)
+        return 0;
+    return g->mode == RULE_ANY_DEPTH || !g->literal_only;
+}
+
+/*
+   求子项对各规则组的匹配结果，返回命中的叶子模式（TARGET_* 位）：命中中间模式或未命中的
+   "**" 规则组带着相应状态写入 child_roles 继续向下匹配；开销计入第一个命中的 -1 / -2 规则组
+*/
+static int plan_match(const DirEntry *entry, const Role *roles, uint32_t role_count, Role *child_roles,
+    uint32_t *child_count, const RuleGroup **delete_group, const RuleGroup **expiry_group) {
+    int target = 0;
+    *child_count = 0;
+    *delete_group = *expiry_group = NULL;
+    for (uint32_t i = 0; i < role_count; i++) {
+        const Role *r = &roles[i];
+        const RuleGroup *g = r->group;
+        if (r->level < g->middle_count) {
+            const char *pattern = g->middle[r->level];
+            int hit = component_is_glob(pattern, strlen(pattern)) ? fnmatch(pattern, entry->name, 0) == 0
+                                                                  : strcmp(pattern, entry->name) == 0;
+            if (hit)
+                child_roles[(*child_count)++] = (Role){ g, r->level + 1, r->check_expiry };
+        } else if (g->mode == RULE_FILTER) {
+            continue;
+        } else if (nameset_match(&g->names, entry->name) >= 0) {
+            int bit = g->mode == RULE_QUOTA ? TARGET_QUOTA : r->check_expiry ? TARGET_EXPIRY : TARGET_DELETE;
+            if (bit == TARGET_DELETE && !*delete_group)
+                *delete_group = g;
+            else if (bit == TARGET_EXPIRY && !*expiry_group)
+                *expiry_group = g;
+            target |= bit;
+        } else if (g->mode == RULE_ANY_DEPTH) {
+            // "**" 规则：未命中的子目录继续向下匹配
+            child_roles[(*child_count)++] = *r;
+        }
+    }
+    return target;
+}
+
+/*
+   对命中叶子模式的子项执行动作：-1 / -2 规则删除目标，配额规则检查目录占用。
+   timed 为 0 时（已知不是目录的目标）只切换计数，不为单个文件读取时钟
+*/
+static void plan_target_at(int dir_fd, DirEntry *entry, char *path, size_t len, const Whitelist *wl,
+    const WlState *wl_state, const WlState *child_wl, int target, const RuleGroup *delete_group,
+    const RuleGroup *expiry_group, int timed, const Role *roles, uint32_t role_count) {
+    if (target & (TARGET_DELETE | TARGET_EXPIRY)) {
+        const RuleGroup *g = (target & TARGET_DELETE) ? delete_group : expiry_group;
+        ProfileScope prof_prev = profile_switch(profile_row(g->prof), timed);
+        DeadlineRoot *prev_root = walk_root;
+        prof_counts[PROF_MATCHES]++;
+        walk_root = (target & TARGET_DELETE) ? NULL : deadline_root_add(path, NULL);
+        delete_target_at(dir_fd, entry, path, len, wl, wl_state, !(target & TARGET_DELETE), engine->opt.days);
+        walk_root = prev_root;
+        profile_switch(prof_prev, timed);
+    }
+    for (uint32_t i = 0; timed && (target & TARGET_QUOTA) && i < role_count; i++) {
+        const RuleGroup *g = roles[i].group;
+        if (g->mode == RULE_QUOTA && roles[i].level == g->middle_count && nameset_match(&g->names, entry->name) >= 0) {
+            ProfileScope prof_prev = profile_switch(profile_row(g->prof), 1);
+            prof_counts[PROF_MATCHES]++;
+            quota_enforce_at(dir_fd, entry->name, path, len, wl, child_wl, g->quota);
+            profile_switch(prof_prev, 1);
+        }
+    }
+}
+
+// 规则组状态是否都是末级的 "**"：此时子目录不在前缀树上，遍历深度没有上限
+static int roles_any_depth_only(const Role *roles, uint32_t count) {
+    for (uint32_t i = 0; i < count; i++) {
+        const RuleGroup *g = roles[i].group;
+        if (g->mode != RULE_ANY_DEPTH || roles[i].level < g->middle_count)
+            return 0;
+    }
+    return count > 0;
+}
+
+// "**" 子树遍历中一层目录的状态；target 等为该目录自身命中的叶子模式，回到上一层后处理
+typedef struct {
+    Role *roles;            // 本层的规则组状态，容量为入口的规则组数（逐层只会减少），各层分配一次后复用
+    uint32_t role_count;
+    WlState wl_state;
+    int has_wl;
+    int target;
+    const RuleGroup *delete_group, *expiry_group;
+    ProfileScope prof_prev;
+} AnyDepthFrame;
+
+// 确保第 index 层可用（index 至多比已分配的层数多 1）；内存不足时返回 0
+static int any_depth_reserve(AnyDepthFrame **frames, uint32_t *cap, uint32_t *ready, uint32_t index, uint32_t role_count) {
+    if (index < *ready)
+        return 1;
+    if (!grow_array((void **)frames, cap, sizeof(AnyDepthFrame), index + 1) ||
+        !((*frames)[index].roles = malloc(role_count * sizeof(Role))))
+        return 0;
+    (*ready)++;
+    return 1;
+}
+
+/*
+   遍历只剩末级 "**" 规则组的子目录 dir_fd/name：深度没有上限，因此不逐层递归 plan_visit，
+   而用显式栈遍历（见 DirWalk），打开的目录数受 WALK_OPEN_MAX 限制，与前缀相同可以跨越挂载点。
+   同时命中过期规则的目录先遍历子树，回到上一层时再执行过期删除，与 plan_entry 的顺序一致
+*/
+static void any_depth_walk(int dir_fd, const char *name, const char *path, size_t path_len, const Whitelist *wl,
+    const WlState *wl_state, const Role *roles, uint32_t role_count) {
+    DirWalk w;
+    DirProbe probe = { 0 };
+    AnyDepthFrame *frames = NULL;
+    uint32_t frame_cap = 0, ready = 0;
+    if (!dir_walk_init(&w, path, path_len) || !any_depth_reserve(&frames, &frame_cap, &ready, 0, role_count)) {
+        log_message(1, "内存分配失败: %s\n", path);
+        goto out;
+    }
+    w.any_fs = 1;
+    if (!dir_walk_push(&w, dir_fd, name, path_len, &probe)) {
+        if (errno != ENOENT)
+            log_subdir_error(path);
+        goto out;
+    }
+    memcpy(frames[0].roles, roles, role_count * sizeof(Role));
+    frames[0].role_count = role_count;
+    frames[0].has_wl = wl_state != NULL;
+    if (wl_state)
+        frames[0].wl_state = *wl_state;
+    frames[0].target = 0;
+    int entered = 1;
+    while (w.depth) {
+        WalkFrame *f = &w.frames[w.depth - 1];
+        AnyDepthFrame *a = &frames[w.depth - 1];
+        // 与 plan_visit 相同，每层按自身的规则组计费并登记监听
+        if (entered) {
+            a->prof_prev = profile_switch(profile_roles(a->roles, a->role_count), 1);
+            for (uint32_t i = 0; engine->watch && i < a->role_count; i++)
+                watch_add(engine->watch, f->reader.fd, w.path, a->roles[i].group, a->roles[i].level, a->roles[i].check_expiry);
+            entered = 0;
+        }
+        DirEntry entry;
+        while (dir_walk_next(&w, &entry) > 0) {
+            int fd = f->reader.fd;
+            int reserved = any_depth_reserve(&frames, &frame_cap, &ready, w.depth, role_count);
+            a = &frames[w.depth - 1];
+            if (!reserved) {
+                log_message(1, "内存分配失败: %s/%s\n", w.path, entry.name);
+                continue;
+            }
+            const WlState *state = a->has_wl ? &a->wl_state : NULL;
+            AnyDepthFrame *child = &frames[w.depth];
+            uint32_t child_count;
+            const RuleGroup *delete_group, *expiry_group;
+            int target = plan_match(&entry, a->roles, a->role_count, child->roles, &child_count,
+                &delete_group, &expiry_group);
+            if (!target && !child_count)
+                continue;
+            size_t len = dir_walk_path_push(&w, f->path_len, entry.name);
+            if (!len || len >= PATH_MAX) {
+                log_message(1, "路径过长: %s/%s\n", w.path, entry.name);
+                w.path[f->path_len] = '\0';
+                continue;
+            }
+            WlState child_state;
+            int wl_flags = child_whitelist_state(wl, state, entry.name, &child_state);
+            const WlState *child_wl = child_state.count ? &child_state : NULL;
+            if (wl_flags & WL_PROTECTED) {
+                log_message(2, "项目在白名单中，跳过: %s\n", w.path);
+                prof_counts[PROF_WHITELIST]++;
+            } else if ((target & TARGET_DELETE) && !wl_flags) {
+                plan_target_at(fd, &entry, w.path, len, wl, state, NULL, TARGET_DELETE, delete_group, NULL,
+                    entry.type != DT_REG && entry.type != DT_LNK, NULL, 0);
+            } else {
+                int is_dir = entry_is_dir(fd, &entry);
+                if (is_dir < 0) {
+                    if (errno != ENOENT)
+                        log_message(1, "无法获取文件信息: %s, 错误: %s\n", w.path, strerror(errno));
+                    w.path[f->path_len] = '\0';
+                    continue;
+                }
+                if (is_dir && child_count && watch_should_descend(fd, entry.name, w.path)) {
+                    if (dir_walk_push(&w, fd, entry.name, len, &probe)) {
+                        child->role_count = child_count;
+                        child->has_wl = child_wl != NULL;
+                        if (child_wl)
+                            child->wl_state = child_state;
+                        child->target = target;
+                        child->delete_group = delete_group;
+                        child->expiry_group = expiry_group;
+                        entered = 1;
+                        break;
+                    }
+                    if (errno != ENOENT)
+                        log_subdir_error(w.path);
+                    f = &w.frames[w.depth - 1];
+                }
+                plan_target_at(fd, &entry, w.path, len, wl, state, child_wl, target, delete_group, expiry_group,
+                    is_dir, a->roles, a->role_count);
+            }
+            w.path[f->path_len] = '\0';
+        }
+        if (entered)
+            continue;
+        file_batch_flush();
+        const AnyDepthFrame *done = a;
+        size_t len = f->path_len;
+        size_t name_off = w.depth > 1 ? w.frames[w.depth - 2].path_len + 1 : 0;
+        int fd = dir_walk_pop(&w, dir_fd);
+        profile_switch(done->prof_prev, 1);
+        if (!w.depth)
+            break;
+        a = &frames[w.depth - 1];
+        if (fd >= 0 && (done->target & (TARGET_DELETE | TARGET_EXPIRY))) {
+            memset(&entry, 0, sizeof(entry));
+            entry.name = w.path + name_off;
+            entry.type = DT_DIR;
+            plan_target_at(fd, &entry, w.path, len, wl, a->has_wl ? &a->wl_state : NULL,
+                done->has_wl ? &done->wl_state : NULL, done->target, done->delete_group, done->expiry_group, 1,
+                a->roles, a->role_count);
+        }
+        w.path[w.frames[w.depth - 1].path_len] = '\0';
+    }
+out:
+    for (uint32_t i = 0; i < ready; i++)
+        free(frames[i].roles);
+    free(frames);
+    dir_walk_free(&w);
+}
+
+/*
+   对目录 dir_fd 下的一个子项求出所有规则组的结果：命中中间模式或 "**" 的子目录带着相应的
+   规则组状态继续遍历，命中叶子模式的按规则删除或检查配额。同一子项同时命中多条规则时，
+   -1 的删除优先（整棵子树一并删除）；否则先遍历子目录中的其他规则，再执行过期删除与配额检查。
+   前缀树上的子目录与规则根目录的打开方式一致，允许是符号链接
+*/
+static void plan_entry(int dir_fd, DirEntry *entry, char *path, size_t path_len, const Whitelist *wl,
+    const WlState *wl_state, const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count, Role *child_roles) {
+    uint32_t child_count;
+    const RuleGroup *delete_group, *expiry_group;
+    int target = plan_match(entry, roles, role_count, child_roles, &child_count, &delete_group, &expiry_group);
+    uint32_t child_node = plan_find_child(plan, node, entry->name);
+    if (!target && !child_count && !child_node)
+        return;
+    // 相对路径规则的顶端路径为空串，子项路径不加前导 '/'
+    size_t len = node == PLAN_REL_ROOT ? (size_t)snprintf(path, PATH_MAX, "%s", entry->name)
+                                       : path_push(path, path_len, entry->name);
+    if (!len || len >= PATH_MAX) {
+        path[path_len] = '\0';
+        return;
+    }
+    WlState child_state;
+    int wl_flags = child_whitelist_state(wl, wl_state, entry->name, &child_state);
+    const WlState *child_wl = child_state.count ? &child_state : NULL;
+    if (wl_flags & WL_PROTECTED) {
+        log_message(2, "项目在白名单中，跳过: %s\n", path);
+        prof_counts[PROF_WHITELIST]++;
+    } else if (!target && !child_count) {
+        int fd = openat(dir_fd, entry->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (fd >= 0)
+            plan_descend(fd, path, len, wl, child_wl, plan, child_node, NULL, 0);
+        else if (errno != ENOENT)
+            log_subdir_error(path);
+    } else if ((target & TARGET_DELETE) && !wl_flags) {
+        plan_target_at(dir_fd, entry, path, len, wl, wl_state, NULL, TARGET_DELETE, delete_group, NULL,
+            entry->type != DT_REG && entry->type != DT_LNK, NULL, 0);
+    } else {
+        int is_dir = entry_is_dir(dir_fd, entry);
+        if (is_dir < 0) {
+            if (errno != ENOENT)
+                log_message(1, "无法获取文件信息: %s, 错误: %s\n", path, strerror(errno));
+            path[path_len] = '\0';
+            return;
+        }
+        // 只有子树中还有规则要处理时才打开目录，单纯命中过期或配额规则的目录由各自的处理重新打开
+        int fd = -1;
+        if (is_dir && (child_count || child_node) && watch_should_descend(dir_fd, entry->name, path)) {
+            // 子树中的规则须在过期删除与配额检查之前处理完，因此在当前线程内完成
+            walk_serial++;
+            if (!child_node && roles_any_depth_only(child_roles, child_count))
+                any_depth_walk(dir_fd, entry->name, path, len, wl, child_wl, child_roles, child_count);
+            else if ((fd = open_dir_at(dir_fd, entry->name)) >= 0)
+                plan_descend(fd, path, len, wl, child_wl, plan, child_node, child_roles, child_count);
+            else if (errno != ENOENT)
+                log_subdir_error(path);
+            walk_serial--;
+        } else if (!is_dir && child_node && entry->type == DT_LNK) {
+            // 指向目录的符号链接只按前缀树上的规则根目录进入
+            if ((fd = openat(dir_fd, entry->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC)) >= 0) {
+                walk_serial++;
+                plan_descend(fd, path, len, wl, child_wl, plan, child_node, NULL, 0);
+                walk_serial--;
+            }
+        }
+        plan_target_at(dir_fd, entry, path, len, wl, wl_state, child_wl, target, delete_group, expiry_group,
+            is_dir, roles, role_count);
+    }
+    path[path_len] = '\0';
+}
+
+static int compare_names(const void *a, const void *b) {
+    return strcmp(*(const char *const *)a, *(const char *const *)b);
+}
+
+/*
+   收集目录中需要按名称探测的子项（各规则的字面量中间目录与叶子、前缀树子节点），
+   排序去重后写入 names，返回个数；内存不足时返回 -1
+*/
+static int plan_probe_names(const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count, const char ***names) {
+    uint32_t cap = 0, n = 0;
+    for (uint32_t c = node ? plan->nodes[node].first_child : 0; c; c = plan->nodes[c].next_sibling)
+        cap++;
+    for (uint32_t i = 0; i < role_count; i++) {
+        const RuleGroup *g = roles[i].group;
+        cap += roles[i].level < g->middle_count ? 1 : g->names.lit_cap;
+    }
+    const char **list = cap ? malloc(cap * sizeof(char *)) : NULL;
+    if (cap && !list)
+        return -1;
+    for (uint32_t c = node ? plan->nodes[node].first_child : 0; c; c = plan->nodes[c].next_sibling)
+        list[n++] = plan->nodes[c].name;
+    for (uint32_t i = 0; i < role_count; i++) {
+        const RuleGroup *g = roles[i].group;
+        if (roles[i].level < g->middle_count) {
+            list[n++] = g->middle[roles[i].level];
+        } else if (g->mode != RULE_FILTER) {
+            const NameSet *ns = &g->names;
+            for (uint32_t j = 0; j < ns->lit_cap; j++) {
+                if (ns->literals[j].rule >= 0)
+                    list[n++] = ns->strings + ns->literals[j].name_off;
+            }
+        }
+    }
+    qsort(list, n, sizeof(char *), compare_names);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < n; i++) {
+        if (!unique || strcmp(list[unique - 1], list[i]) != 0)
+            list[unique++] = list[i];
+    }
+    *names = list;
+    return (int)unique;
+}
+
+/*
+   按遍历计划处理目录 dir_fd：活动规则为继承的规则组状态加上以该目录为根的规则组。
+   任一规则需要匹配通配符时整个目录只扫描一次，否则只按名称探测用到的子项；
+   方括号规则在其他规则处理完后，再过滤删除整个子树
+*/
+static void plan_visit(int dir_fd, char *path, size_t path_len, const Whitelist *wl, const WlState *wl_state,
+    const Plan *plan, uint32_t node, const Role *roles, uint32_t role_count) {
+    const PlanNode *pn = node ? &plan->nodes[node] : NULL;
+    uint32_t count = role_count + (pn ? pn->role_count : 0);
+    Role local[32];
+    Role *all = count * 2 <= sizeof(local) / sizeof(local[0]) ? local : malloc(count * 2 * sizeof(Role));
+    if (!all) {
+        log_message(1, "内存分配失败: roles\n");
+        return;
+    }
+    Role *child_roles = all + count;
+    if (role_count)
+        memcpy(all, roles, role_count * sizeof(Role));
+    if (pn && pn->role_count)
+        memcpy(all + role_count, pn->roles, pn->role_count * sizeof(Role));
+    ProfileScope prof_prev = profile_switch(profile_roles(all, count), 1);
+    int scan = 0;
+    for (uint32_t i = 0; i < count; i++) {
+        const RuleGroup *g = all[i].group;
+        if (engine->watch && !(g->mode == RULE_FILTER && all[i].level == g->middle_count))
+            watch_add(engine->watch, dir_fd, path, g, all[i].level, all[i].check_expiry);
+        scan |= role_needs_scan(&all[i]);
+    }
+    DirEntry entry;
+    if (scan) {
+        DirReader reader;
+        if (dir_reader_open(&reader, open_dir_at(dir_fd, "."))) {
+            while (dir_reader_next(&reader, &entry) > 0)
+                plan_entry(reader.fd, &entry, path, path_len, wl, wl_state, plan, node, all, count, child_roles);
+            file_batch_flush();
+            dir_reader_close(&reader);
+        }
+    } else {
+        const char **names;
+        int n = plan_probe_names(plan, node, all, count, &names);
+        for (int i = 0; i < n; i++) {
+            memset(&entry, 0, sizeof(entry));
+            entry.name = names[i];
+            entry.type = DT_UNKNOWN;
+            plan_entry(dir_fd, &entry, path, path_len, wl, wl_state, plan, node, all, count, child_roles);
+        }
+        file_batch_flush();
+        if (n >= 0)
+            free(names);
+    }
+    for (uint32_t i = 0; i < count; i++) {
+        const RuleGroup *g = all[i].group;
+        if (g->mode == RULE_FILTER && all[i].level == g->middle_count) {
+            ProfileScope scope = profile_switch(profile_row(g->prof), 1);
+            DeadlineRoot *prev_root = walk_root;
+            walk_root = all[i].check_expiry && path_len ? deadline_root_add(path, g) : NULL;
+            delete_directory_at(dir_fd, ".", path, path_len, wl, wl_state, g,
+                all[i].check_expiry, all[i].check_expiry ? engine->opt.days : 0, 1);
+            walk_root = prev_root;
+            profile_switch(scope, 1);
+        }
+    }
+    profile_switch(prof_prev, 1);
+    if (all != local)
+        free(all);
+}
+
+/*
+   任务的一个引用结束（自身扫描或一个子目录任务完成）；最后一个引用释放时，
+   删除任务在自身与子目录都没有保留项时删除目录，否则计入父任务的保留数，再向父任务传递
+*/
+static void task_release(Task *t) {
+    while (t && atomic_fetch_sub(&t->pending, 1) == 1) {
+        Task *parent = t->parent;
+        if (t->kind == TASK_DELETE_DIR) {
+            ProfileScope prof_prev = profile_switch(profile_row(t->prof), 0);
+            int removed = !t->skip_root && t->fd >= 0 && t->kept.count == 0 && atomic_load(&t->kept_children) == 0 &&
+                remove_empty_dir_at(parent ? parent->fd : t->parent_fd, t->name, t->path);
+            if (!removed && parent)
+                atomic_fetch_add(&parent->kept_children, 1);
+            profile_switch(prof_prev, 0);
+        }
+        task_free(t);
+        ThreadPool *p = engine->pool;
+        if (atomic_fetch_sub(&p->outstanding, 1) == 1) {
+            pthread_mutex_lock(&p->lock);
+            pthread_cond_broadcast(&p->done_cond);
+            pthread_mutex_unlock(&p->lock);
+        }
+        t = parent;
+    }
+}
+
+// 执行遍历任务：按记录的前缀树节点与继承的规则组状态处理目录
+static void task_run_walk(Task *t) {
+    char path[PATH_MAX];
+    memcpy(path, t->path, t->path_len + 1);
+    plan_visit(t->fd, path, t->path_len, t->wl, t->wl_state, t->plan, t->node, t->roles, t->role_count);
+    task_release(t);
+}
+
+// 执行删除任务：与 delete_directory_at 相同地处理各子项，子目录作为子任务提交
+static void task_run_delete(Task *t) {
+    DirReader reader;
+    ProfileScope prof_prev = profile_switch(profile_row(t->prof), 1);
+    int parent_fd = t->parent ? t->parent->fd : t->parent_fd;
+    if (!dir_reader_open(&reader, t->nested ? open_subdir_at(parent_fd, t->name) : open_dir_at(parent_fd, t->name))) {
+        log_subdir_error(t->path);
+        kept_add(&t->kept, 0);
+        profile_switch(prof_prev, 1);
+        task_release(t);
+        return;
+    }
+    t->fd = reader.fd;
+    if (t->group && engine->watch)
+        watch_add(engine->watch, t->fd, t->path, t->group, t->group->middle_count, t->check_expiry);
+    DeadlineRoot *prev_root = walk_root;
+    walk_root = t->root;
+    char path[PATH_MAX];
+    memcpy(path, t->path, t->path_len + 1);
+    DirEntry entry;
+    int ret;
+    while ((ret = dir_reader_next(&reader, &entry)) > 0) {
+        size_t len = path_push(path, t->path_len, entry.name);
+        if (!len) {
+            log_message(1, "路径过长: %s/%s\n", path, entry.name);
+            kept_add(&t->kept, 0);
+            continue;
+        }
+        if (delete_directory_entry(t->fd, &entry, path, t->wl, t->wl_state, t->group, t->check_expiry, t->days, &t->kept)) {
+            DirProbe probe;
+            t->subdirs++;
+            if (scan_cache_skip(t->fd, entry.name, path, t->group, t->check_expiry, t->days, &probe))
+                kept_add(&t->kept, 0);
+            else if (t->depth + 1 < WALK_OPEN_MAX / 2 &&
+                     pool_spawn_delete(t, t->fd, entry.name, path, len, t->wl, NULL, t->group, t->check_expiry, t->days, 0, 1, &probe))
+                ;
+            else {
+                // 任务链过深时在当前线程内用显式栈处理整棵子树，打开的目录数受 WALK_OPEN_MAX 限制
+                walk_serial++;
+                if (!delete_directory_at(t->fd, entry.name, path, len, t->wl, NULL, t->group, t->check_expiry, t->days, 0))
+                    kept_add(&t->kept, 0);
+                walk_serial--;
+            }
+        }
+        path[t->path_len] = '\0';
+    }
+    if (ret < 0)
+        kept_add(&t->kept, 0);
+    file_batch_flush();
+    scan_cache_record(&t->probe, &t->kept, t->subdirs);
+    walk_root = prev_root;
+    // 目录 fd 保留到所有子任务完成，供子任务相对打开及删除自身，批缓冲区先行释放
+    reader.fd = -1;
+    dir_reader_close(&reader);
+    // 计数须在释放任务之前结算：最后一个任务完成后主线程即合并并清零各线程的删除计数
+    profile_switch(prof_prev, 1);
+    task_release(t);
+}
+
+// 工作线程：先取自己队列尾部的任务，再依次从其他线程队列头部窃取，都没有时等待新任务
+static void *worker_main(void *arg) {
+    Worker *self = arg;
+    ThreadPool *p = self->pool;
+    engine = p->ctx;
+    current_worker = self;
+    thread_stats = &self->stats;
+    for (;;) {
+        Task *t = deque_pop(&self->deque);
+        for (int i = 1; !t && i < p->count; i++)
+            t = deque_steal(&p->workers[(self->index + i) % p->count].deque);
+        if (t) {
+            atomic_fetch_sub(&p->queued, 1);
+            if (t->kind == TASK_WALK)
+                task_run_walk(t);
+            else
+                task_run_delete(t);
+            continue;
+        }
+        pthread_mutex_lock(&p->lock);
+        while (!p->stop && atomic_load(&p->queued) == 0)
+            pthread_cond_wait(&p->work_cond, &p->lock);
+        int stop = p->stop;
+        pthread_mutex_unlock(&p->lock);
+        if (stop)
+            break;
+    }
+    uring_release();
+    order_release();
+    return NULL;
+}
+
+// 停止并回收工作线程
+static void pool_stop(void) {
+    ThreadPool *p = engine->pool;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    p->stop = 1;
+    pthread_cond_broadcast(&p->work_cond);
+    pthread_mutex_unlock(&p->lock);
+    for (int i = 0; i < p->count; i++) {
+        if (i < p->started)
+            pthread_join(p->workers[i].thread, NULL);
+        free(p->workers[i].deque.items);
+    }
+    engine->pool = NULL;
+    free(p->workers);
+    free(p);
+}
+
+// 启动 count 个工作线程，失败时返回 0 并保持单线程运行
+static int pool_start(int count) {
+    ThreadPool *p = calloc(1, sizeof(ThreadPool));
+    if (!p || !(p->workers = calloc(count, sizeof(Worker)))) {
+        free(p);
+        return 0;
+    }
+    pthread_mutex_init(&p->lock, NULL);
+    pthread_cond_init(&p->work_cond, NULL);
+    pthread_cond_init(&p->done_cond, NULL);
+    p->ctx = engine;
+    p->count = count;
+    for (int i = 0; i < count; i++) {
+        p->workers[i].index = i;
+        p->workers[i].pool = p;
+        pthread_mutex_init(&p->workers[i].deque.lock, NULL);
+    }
+    engine->pool = p;
+    for (int i = 0; i < count; i++) {
+        int err = pthread_create(&p->workers[i].thread, NULL, worker_main, &p->workers[i]);
+        if (err != 0) {
+            log_message(1, "创建工作线程失败: %s\n", strerror(err));
+            pool_stop();
+            return 0;
+        }
+        p->started++;
+    }
+    return 1;
+}
+
+// 等待已提交的任务全部完成，并将各线程的删除计数合并到上下文的计数
+static void pool_wait(void) {
+    ThreadPool *p = engine->pool;
+    if (!p)
+        return;
+    pthread_mutex_lock(&p->lock);
+    while (atomic_load(&p->outstanding) > 0)
+        pthread_cond_wait(&p->done_cond, &p->lock);
+    pthread_mutex_unlock(&p->lock);
+    DeleteStats *total = &engine->totals;
+    for (int i = 0; i < p->count; i++) {
+        DeleteStats *s = &p->workers[i].stats;
+        total->files += s->files;
+        total->dirs += s->dirs;
+        total->bytes += s->bytes;
+        total->scanned += s->scanned;
+        memset(s, 0, sizeof(*s));
+    }
+}
+
+
+// 以路径打开规则中的根目录（允许根目录本身是符号链接，如 /sdcard），失败时返回 -1
+static int open_base_dir(const char *base_path) {
+    return open(base_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+}
+
+// 按遍历计划执行一轮完整扫描：分别从 "/" 与当前目录出发，只进入前缀树上的目录及规则展开到的目录
+static void process_plan(const Plan *plan, const Whitelist *wl) {
+    for (uint32_t top = PLAN_ABS_ROOT; top <= PLAN_REL_ROOT && top < plan->node_count; top++) {
+        if (!plan->nodes[top].first_child && !plan->nodes[top].role_count)
+            continue;
+        WlState state;
+        whitelist_state_init(wl, top == PLAN_ABS_ROOT ? "/" : "", &state);
+        int fd = open_base_dir(top == PLAN_ABS_ROOT ? "/" : ".");
+        if (fd < 0)
+            continue;
+        // 顶端的路径缓冲区从空串开始，避免拼出 "//name"
+        char path[PATH_MAX] = "";
+        plan_descend(fd, path, 0, wl, state.count ? &state : NULL, plan, top, NULL, 0);
+    }
+    // 多线程模式下等待本轮任务全部完成，再合并各线程的删除计数
+    pool_wait();
+}
+
+// 单调时钟毫秒数，用于事件去抖、对账与耗时统计
+static int64_t monotonic_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+// 按 JSON 字符串规则转义 s 写入 out（不含引号），超出 cap 时截断
+static void json_escape(char *out, size_t cap, const char *s) {
+    size_t n = 0;
+    for (; *s && n + 7 < cap; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') {
+            out[n++] = '\\';
+            out[n++] = (char)c;
+        } else if (c < 0x20) {
+            n += (size_t)snprintf(out + n, cap - n, "\\u%04x", c);
+        } else {
+            out[n++] = (char)c;
+        }
+    }
+    out[n] = '\0';
+}
+
+typedef struct {
+    const RuleProfile *row;
+    long long v[PROF_COUNT];
+} ProfileLine;
+
+static int compare_profile_lines(const void *a, const void *b) {
+    long long x = ((const ProfileLine *)a)->v[PROF_WALL], y = ((const ProfileLine *)b)->v[PROF_WALL];
+    return x < y ? 1 : x > y ? -1 : 0;
+}
+
+/*
+   取出并清零本轮的规则开销计数，按墙钟时间降序记录前 profile_top 个规则组；
+   返回同样内容的 JSON 数组供统计记录使用（调用方释放），不剖析或没有开销时返回 NULL
+*/
+static char *profile_report(void) {
+    if (!engine->profile)
+        return NULL;
+    ProfileLine *lines = malloc(engine->profile_count * sizeof(ProfileLine));
+    uint32_t n = 0;
+    for (uint32_t i = 0; i < engine->profile_count; i++) {
+        RuleProfile *row = &engine->profile[i];
+        long long v[PROF_COUNT], any = 0;
+        for (int k = 0; k < PROF_COUNT; k++)
+            any |= v[k] = atomic_exchange_explicit(&row->v[k], 0, memory_order_relaxed);
+        if (any && lines) {
+            lines[n].row = row;
+            memcpy(lines[n++].v, v, sizeof(v));
+        }
+    }
+    if (!n) {
+        free(lines);
+        return NULL;
+    }
+    qsort(lines, n, sizeof(ProfileLine), compare_profile_lines);
+    if (n > (uint32_t)engine->opt.profile_top)
+        n = (uint32_t)engine->opt.profile_top;
+    size_t cap = n * (PATH_MAX + 320) + 3, len = 0;
+    char *json = malloc(cap);
+    if (json)
+        json[len++] = '[';
+    log_message(1, "规则开销（按耗时排序，前 %u 项）:\n", n);
+    log_message(1, "%9s %9s %9s %8s %7s %8s %7s %10s %6s  %s\n",
+        "耗时/ms", "CPU/ms", "目录项", "stat", "命中", "删除文件", "删除目录", "释放/KB", "白名单", "规则");
+    for (uint32_t i = 0; i < n; i++) {
+        const RuleProfile *row = lines[i].row;
+        const long long *v = lines[i].v;
+        char label[PATH_MAX + 32];
+        if (!row->list)
+            snprintf(label, sizeof(label), "（多个规则共用的前缀目录）");
+        else if (row->rules > 1)
+            snprintf(label, sizeof(label), "-%d %s（同组 %u 条规则）", row->list, row->rule, row->rules);
+        else
+            snprintf(label, sizeof(label), "-%d %s", row->list, row->rule);
+        log_message(1, "%9.1f %9.1f %9lld %8lld %7lld %8lld %7lld %10lld %6lld  %s\n",
+            v[PROF_WALL] / 1e6, v[PROF_CPU] / 1e6, v[PROF_VISITED], v[PROF_STATS], v[PROF_MATCHES],
+            v[PROF_FILES], v[PROF_DIRS], v[PROF_BYTES] / 1024, v[PROF_WHITELIST], label);
+        if (!json)
+            continue;
+        char rule[PATH_MAX];
+        json_escape(rule, sizeof(rule), row->list ? row->rule : "");
+        len += (size_t)snprintf(json + len, cap - len,
+            "%s{\"list\":%d,\"rule\":\"%s\",\"rules\":%u,\"wall_ms\":%.1f,\"cpu_ms\":%.1f,\"visited\":%lld,"
+            "\"stat\":%lld,\"matches\":%lld,\"files\":%lld,\"dirs\":%lld,\"bytes\":%lld,\"whitelisted\":%lld}",
+            i ? "," : "", row->list, rule, row->rules, v[PROF_WALL] / 1e6, v[PROF_CPU] / 1e6,
+            v[PROF_VISITED], v[PROF_STATS], v[PROF_MATCHES], v[PROF_FILES], v[PROF_DIRS], v[PROF_BYTES],
+            v[PROF_WHITELIST]);
+    }
+    if (json)
+        snprintf(json + len, cap - len, "]");
+    free(lines);
+    return json;
+}
+
+/*
+   向统计文件追加一条 JSON 记录（一行）。单次 O_APPEND 写入保证记录完整，
+   WebUI 按字节偏移增量读取；文件超过 MAX_STATS_SIZE 时滚动为 .old
+*/
+static void stats_append(const CleanStats *st, const char *rules) {
+    const char *stats_file = engine->stats_file;
+    if (!stats_file)
+        return;
+    char time_str[32], phases[160];
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&st->ts));
+    if (strcmp(st->mode, "watch") == 0)
+        snprintf(phases, sizeof(phases), "{\"watch_ms\":%lld}", (long long)st->watch_ms);
+    else
+        snprintf(phases, sizeof(phases), "{\"load_ms\":%lld,\"walk_ms\":%lld}",
+            (long long)st->load_ms, (long long)st->walk_ms);
+    // 剖析时附带开销最高的规则组
+    size_t size = 512 + (rules ? strlen(rules) + 16 : 0);
+    char *line = malloc(size);
+    if (!line)
+        return;
+    int len = snprintf(line, size,
+        "{\"ts\":%lld,\"time\":\"%s\",\"mode\":\"%s\",\"files\":%d,\"dirs\":%d,\"bytes\":%lld,"
+        "\"scanned\":%lld,\"duration_ms\":%lld,\"phases\":%s%s%s}\n",
+        (long long)st->ts, time_str, st->mode, st->files, st->dirs, st->bytes,
+        st->scanned, (long long)st->duration_ms, phases, rules ? ",\"rules\":" : "", rules ? rules : "");
+    int fd = open(stats_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        log_message(1, "无法打开统计文件: %s, 错误: %s\n", stats_file, strerror(errno));
+        free(line);
+        return;
+    }
+    struct stat sb;
+    if (fstat(fd, &sb) == 0 && sb.st_size > MAX_STATS_SIZE) {
+        char old_path[PATH_MAX];
+        snprintf(old_path, sizeof(old_path), "%s.old", stats_file);
+        close(fd);
+        rename(stats_file, old_path);
+        fd = open(stats_file, O_WRONLY | O_APPEND | O_CREAT | O_CLOEXEC, 0644);
+        if (fd < 0) {
+            free(line);
+            return;
+        }
+    }
+    if (write(fd, line, (size_t)len) != len)
+        log_message(1, "写入统计文件失败: %s\n", strerror(errno));
+    close(fd);
+    free(line);
+}
+
+// 把本轮计数填入 st 并记录删除的文件与目录数，追加统计记录、通知回调后清零计数
+static void report_totals(CleanStats *st) {
+    DeleteStats *total = &engine->totals;
+    char time_str[100];
+    st->ts = time(NULL);
+    st->files = total->files;
+    st->dirs = total->dirs;
+    st->bytes = total->bytes;
+    st->scanned = total->scanned;
+    strftime(time_str, sizeof(time_str), "%Y-%m-%d %H:%M:%S", localtime(&st->ts));
+    log_message(1, "%s 已删除文件数: %d\n", time_str, st->files);
+    log_message(1, "%s 已删除目录数: %d\n", time_str, st->dirs);
+    long long wait_ns = atomic_exchange(&engine->throttle.wait_ns, 0);
+    if (wait_ns)
+        log_message(2, "删除限速累计等待 %lld 毫秒\n", wait_ns / 1000000);
+    char *rules = profile_report();
+    stats_append(st, rules);
+    free(rules);
+    if (engine->opt.cycle)
+        engine->opt.cycle(engine->opt.user, st);
+    memset(total, 0, sizeof(*total));
+}
+
+// 创建监听集合；fanotify 不可用（内核过旧或无权限）时只使用 inotify
+static WatchSet *watch_create(void) {
+    WatchSet *ws = calloc(1, sizeof(WatchSet));
+    if (!ws)
+        return NULL;
+    pthread_mutex_init(&ws->lock, NULL);
+    ws->fan_fd = -1;
+    ws->ino_fd = -1;
+#ifdef FAN_REPORT_DFID_NAME
+    ws->fan_fd = fanotify_init(FAN_CLASS_NOTIF | FAN_REPORT_DFID_NAME | FAN_CLOEXEC | FAN_NONBLOCK, O_RDONLY);
+    if (ws->fan_fd < 0)
+        log_message(2, "fanotify 不可用，使用 inotify: %s\n", strerror(errno));
+#endif
+    return ws;
+}
+
+// 释放监听集合，关闭内核监听实例
+static void watch_free(WatchSet *ws) {
+    if (!ws)
+        return;
+    for (uint32_t i = 0; i < ws->count; i++) {
+        WatchRole *r = ws->dirs[i].roles;
+        while (r) {
+            WatchRole *next = r->next;
+            free(r);
+            r = next;
+        }
+        free(ws->dirs[i].path);
+        free(ws->dirs[i].handle);
+    }
+    if (ws->fan_fd >= 0)
+        close(ws->fan_fd);
+    if (ws->ino_fd >= 0)
+        close(ws->ino_fd);
+    free(ws->dirs);
+    free(ws->path_index);
+    free(ws->key_index);
+    free(ws->dirty);
+    pthread_mutex_destroy(&ws->lock);
+    free(ws);
+}
+
+// 将目录加入脏集合
+static void watch_mark_dirty(WatchSet *ws, WatchDir *d) {
+    if (d->dirty)
+        return;
+    if (!grow_array((void **)&ws->dirty, &ws->dirty_cap, sizeof(uint32_t), ws->dirty_count + 1)) {
+        ws->overflow = 1;
+        return;
+    }
+    d->dirty = 1;
+    ws->dirty[ws->dirty_count++] = (uint32_t)(d - ws->dirs);
+}
+
+// 按事件键值（inotify wd 或 fanotify 句柄）查找监听目录；索引中的失效键值通过比对实际键值排除
+static WatchDir *watch_find_key(WatchSet *ws, int wd, const unsigned char *handle, uint32_t handle_len) {
+    if (!ws->index_cap)
+        return NULL;
+    uint32_t hash = handle ? wl_name_hash((const char *)handle, handle_len) : (uint32_t)wd * 0x9E3779B1u;
+    uint32_t mask = ws->index_cap - 1;
+    for (uint32_t i = hash & mask; ws->key_index[i]; i = (i + 1) & mask) {
+        WatchDir *d = &ws->dirs[ws->key_index[i] - 1];
+        if (handle ? (d->handle_len == handle_len && memcmp(d->handle, handle, handle_len) == 0) : d->wd == wd)
+            return d;
+    }
+    return NULL;
+}
+
+// 读取 inotify 事件并标记对应目录；队列溢出时要求完整对账
+static void watch_read_inotify(WatchSet *ws) {
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct inotify_event))));
+    ssize_t n;
+    while ((n = read(ws->ino_fd, buf, sizeof(buf))) > 0) {
+        for (char *p = buf; p < buf + n; p += sizeof(struct inotify_event) + ((struct inotify_event *)p)->len) {
+            const struct inotify_event *ev = (const struct inotify_event *)p;
+            if (ev->mask & IN_Q_OVERFLOW) {
+                ws->overflow = 1;
+                continue;
+            }
+            WatchDir *d = watch_find_key(ws, ev->wd, NULL, 0);
+            if (!d)
+                continue;
+            if (ev->mask & IN_IGNORED)
+                d->wd = -1;     // 目录已删除或卸载，重建后由父目录的事件重新登记
+            else
+                watch_mark_dirty(ws, d);
+        }
+    }
+}
+
+#ifdef FAN_REPORT_DFID_NAME
+// 读取 fanotify 事件，以事件中父目录的 fsid + 句柄查找监听目录；未登记的目录直接忽略
+static void watch_read_fanotify(WatchSet *ws) {
+    char buf[16 * 1024] __attribute__((aligned(__alignof__(struct fanotify_event_metadata))));
+    ssize_t n;
+    while ((n = read(ws->fan_fd, buf, sizeof(buf))) > 0) {
+        const struct fanotify_event_metadata *ev = (const struct fanotify_event_metadata *)buf;
+        for (; FAN_EVENT_OK(ev, n); ev = FAN_EVENT_NEXT(ev, n)) {
+            if (ev->mask & FAN_Q_OVERFLOW) {
+                ws->overflow = 1;
+                continue;
+            }
+            const struct fanotify_event_info_fid *fid = (const struct fanotify_event_info_fid *)(ev + 1);
+            if (ev->event_len < sizeof(*ev) + sizeof(*fid) + sizeof(struct file_handle) ||
+                (fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID_NAME && fid->hdr.info_type != FAN_EVENT_INFO_TYPE_DFID))
+                continue;
+            const struct file_handle *fh = (const struct file_handle *)fid->handle;
+            unsigned char key[sizeof(fsid_t) + sizeof(int) + MAX_HANDLE_SZ];
+            if (fh->handle_bytes > MAX_HANDLE_SZ)
+                continue;
+            memcpy(key, &fid->fsid, sizeof(fsid_t));
+            memcpy(key + sizeof(fsid_t), &fh->handle_type, sizeof(int));
+            memcpy(key + sizeof(fsid_t) + sizeof(int), fh->f_handle, fh->handle_bytes);
+            WatchDir *d = watch_find_key(ws, -1, key, sizeof(fsid_t) + sizeof(int) + fh->handle_bytes);
+            if (d)
+                watch_mark_dirty(ws, d);
+        }
+    }
+}
+#endif
+
+/*
+   增量处理脏目录：按目录登记的角色，从对应层级重新展开规则。
+   处理期间已登记的子目录不再递归，新出现的目录在遍历中完成登记。
+   遍历可能登记新目录导致 dirs 扩容，因此每次按下标重新取记录
+*/
+static void watch_process_dirty(WatchSet *ws, const Whitelist *wl) {
+    ws->incremental = 1;
+    for (uint32_t i = 0; i < ws->dirty_count; i++) {
+        uint32_t idx = ws->dirty[i];
+        ws->dirs[idx].dirty = 0;
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s", ws->dirs[idx].path);
+        WlState state;
+        if (whitelist_state_init(wl, path, &state) & WL_PROTECTED)
+            continue;
+        int dir_fd = open_base_dir(path);
+        if (dir_fd < 0)
+            continue;
+        log_message(2, "处理变更目录: %s\n", path);
+        // 与 process_plan 一致，根目录 "/" 时路径缓冲区从空串开始
+        size_t path_len = strcmp(path, "/") == 0 ? 0 : strlen(path);
+        path[path_len] = '\0';
+        // 目录的全部角色合并为一次遍历，不经过前缀树
+        uint32_t count = 0;
+        for (const WatchRole *r = ws->dirs[idx].roles; r; r = r->next)
+            count++;
+        Role *roles = malloc(count * sizeof(Role));
+        if (!roles) {
+            close(dir_fd);
+            continue;
+        }
+        count = 0;
+        for (const WatchRole *r = ws->dirs[idx].roles; r; r = r->next)
+            roles[count++] = (Role){ r->group, r->level, r->check_expiry };
+        plan_visit(dir_fd, path, path_len, wl, state.count ? &state : NULL, NULL, 0, roles, count);
+        free(roles);
+        close(dir_fd);
+    }
+    ws->dirty_count = 0;
+    ws->incremental = 0;
+}
+
+// 记录规则文件的修改时间与大小，用于发现规则变更
+static void rule_files_snapshot(char **files, int count, struct stat *snap) {
+    for (int i = 0; i < count; i++) {
+        memset(&snap[i], 0, sizeof(snap[i]));
+        if (files[i])
+            stat(files[i], &snap[i]);
+    }
+}
+
+static int rule_files_changed(char **files, int count, const struct stat *snap) {
+    struct stat now[3];
+    rule_files_snapshot(files, count, now);
+    for (int i = 0; i < count; i++) {
+        if (now[i].st_mtim.tv_sec != snap[i].st_mtim.tv_sec || now[i].st_mtim.tv_nsec != snap[i].st_mtim.tv_nsec ||
+            now[i].st_size != snap[i].st_size || now[i].st_ino != snap[i].st_ino)
+            return 1;
+    }
+    return 0;
+}
+
+/*
+   监听模式主循环：等待事件，首个事件到达后再等待 WATCH_SETTLE_MS 以合并突发写入，
+   随后只处理脏目录。到达对账间隔、事件队列溢出或规则文件变更时返回 0，由调用方执行完整扫描；
+   wake_fd 可读时返回 1，由调用方处理后再次进入
+*/
+static int watch_wait(WatchSet *ws, const Whitelist *wl, int interval, int wake_fd) {
+    int64_t reconcile_at = monotonic_ms() + (int64_t)interval * 1000;
+    int64_t rule_check_at = monotonic_ms() + 60000;
+    int64_t settle_at = 0;
+    while (!ws->overflow) {
+        int64_t now = monotonic_ms();
+        if (now >= reconcile_at)
+            return 0;
+        // 每分钟检查一次规则文件
+        int64_t wake = reconcile_at < rule_check_at ? reconcile_at : rule_check_at;
+        if (ws->dirty_count && settle_at < wake)
+            wake = settle_at;
+        struct pollfd fds[3];
+        int nfds = 0;
+        if (wake_fd >= 0)
+            fds[nfds++] = (struct pollfd){ .fd = wake_fd, .events = POLLIN };
+        if (ws->fan_fd >= 0)
+            fds[nfds++] = (struct pollfd){ .fd = ws->fan_fd, .events = POLLIN };
+        if (ws->ino_fd >= 0)
+            fds[nfds++] = (struct pollfd){ .fd = ws->ino_fd, .events = POLLIN };
+        int ret = poll(fds, nfds, wake > now ? (int)(wake - now) : 0);
+        if (ret < 0 && errno != EINTR) {
+            log_message(1, "等待文件事件失败: %s\n", strerror(errno));
+            return 0;
+        }
+        // 唤醒时先处理已合并完的脏目录，未到去抖时间的留在集合中，下次进入时继续等待
+        int woken = ret > 0 && wake_fd >= 0 && (fds[0].revents & POLLIN);
+        uint32_t was_dirty = ws->dirty_count;
+#ifdef FAN_REPORT_DFID_NAME
+        if (ws->fan_fd >= 0)
+            watch_read_fanotify(ws);
+#endif
+        if (ws->ino_fd >= 0)
+            watch_read_inotify(ws);
+        now = monotonic_ms();
+        if (!was_dirty && ws->dirty_count)
+            settle_at = now + WATCH_SETTLE_MS;
+        if (ws->dirty_count && now >= settle_at) {
+            CleanStats st = { .mode = "watch" };
+            watch_process_dirty(ws, wl);
+            st.watch_ms = st.duration_ms = monotonic_ms() - now;
+            // 增量批次只在有删除时记录，避免空闲时日志与统计不断增长
+            if (engine->totals.files || engine->totals.dirs)
+                report_totals(&st);
+            else
+                memset(&engine->totals, 0, sizeof(engine->totals));
+        }
+        if (now >= rule_check_at) {
+            rule_check_at = now + 60000;
+            if (clean_rules_changed(engine)) {
+                log_message(1, "规则文件已变更，重新加载\n");
+                return 0;
+            }
+        }
+        if (woken)
+            return 1;
+    }
+    log_message(1, "文件事件队列溢出，执行完整扫描\n");
+    return 0;
+}
+
+// 编译后的规则，由 clean_compile_rules 整体替换
+struct CleanRules {
+    Whitelist whitelist;
+    Blacklist blacklist1;
+    Blacklist blacklist2;
+    Plan plan;              // -1 与 -2 规则合并后的遍历计划
+    char **lines[2];        // -1、-2 规则的原始行
+    int line_count[2];
+    int64_t load_ms;        // 读取并编译耗时，计入下一轮完整扫描的统计
+    uint32_t path_map;      // 编译时生效的路径映射的哈希，0 表示未改写
+    void *map;              // 由规则包加载时的映射区，各数组与字符串指向其中
+    size_t map_len;
+};
+
+static void bundle_free_blacklist(Blacklist *bl);
+
+static void rules_free(CleanRules *r) {
+    if (!r)
+        return;
+    if (r->map) {
+        bundle_free_blacklist(&r->blacklist1);
+        bundle_free_blacklist(&r->blacklist2);
+        plan_free(&r->plan);
+        free(r->lines[0]);
+        free(r->lines[1]);
+        munmap(r->map, r->map_len);
+        free(r);
+        return;
+    }
+    blacklist_free(&r->blacklist1);
+    blacklist_free(&r->blacklist2);
+    plan_free(&r->plan);
+    free_array(r->lines[0], r->line_count[0]);
+    free_array(r->lines[1], r->line_count[1]);
+    whitelist_free(&r->whitelist);
+    free(r);
+}
+
+/*
+   规则包：编译后的规则按原样（均以下标关联，可直接映射）写入一个文件，下次启动时 mmap 后即可使用，
+   不再逐行读取、分配与编译。文件头记录三个规则文件的 (dev, inode, 大小, mtime)，
+   与当前规则文件不一致时视为过期，改为从规则文件编译并重写规则包。
+   白名单前缀树、名称匹配器的各个数组与字符串池直接指向映射区；规则组、中间模式与原始行的
+   指针数组在加载时按偏移重建，合并正则（regex_t 无法重定位）在加载时重新编译，遍历计划同样在加载时生成。
+   各数组以本机的结构体布局写入，只在同一构建的程序之间通用（布局不同时文件头校验失败）
+*/
+#define RULE_BUNDLE_MAGIC 0x31424c43u   // "CLB1"
+#define RULE_BUNDLE_VERSION 1
+#define RULE_BUNDLE_NONE UINT32_MAX     // 字符串偏移：空行（NULL）
+
+typedef struct {
+    uint64_t off;
+    uint32_t count;
+    uint32_t cap;       // 哈希表数组写入全部槽位，cap 即槽位数
+} BundleArray;
+
+typedef struct {
+    uint64_t dev, ino, size;
+    int64_t mtime_sec, mtime_nsec;
+} BundleSource;
+
+typedef struct {
+    uint32_t root;      // 字符串区偏移
+    uint32_t middle;    // 字符串区偏移数组的起始下标（见 BundleHeader.offsets）
+    int32_t middle_count;
+    int32_t mode;
+    int32_t literal_only;
+    int32_t any_rule;
+    uint64_t quota;
+    BundleArray literals, prefix, suffix, globs, strings;
+} BundleGroup;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t layout;    // 各结构体大小，防止不同构建之间误用
+    uint32_t path_map;  // 编译时生效的路径映射的哈希，FUSE 挂载状态变化后需重新编译
+    uint64_t size;
+    BundleSource sources[3];
+    BundleArray wl_nodes, wl_edges, wl_strings;
+    BundleArray groups[2];
+    int32_t rule_count[2];
+    BundleArray lines[2];   // 规则原始行在字符串区的偏移
+    BundleArray offsets;    // 中间模式的字符串区偏移
+    BundleArray text;       // 字符串区
+} BundleHeader;
+
+#define RULE_BUNDLE_LAYOUT ((uint32_t)(sizeof(BundleHeader) ^ sizeof(BundleGroup) << 8 ^ sizeof(WlNode) << 16 ^ \
+    sizeof(WlEdge) << 20 ^ sizeof(NameLiteral) << 24 ^ sizeof(CharNode) << 28 ^ sizeof(NameGlob) << 12))
+
+// 写入缓冲区：各段按 8 字节对齐追加
+typedef struct {
+    char *buf;
+    size_t len, cap;
+    int failed;
+} BundleWriter;
+
+static uint64_t bundle_put(BundleWriter *w, const void *data, size_t size) {
+    size_t off = (w->len + 7) & ~(size_t)7;
+    if (off + size > w->cap) {
+        size_t cap = w->cap ? w->cap : 4096;
+        while (cap < off + size)
+            cap *= 2;
+        char *buf = realloc(w->buf, cap);
+        if (!buf) {
+            w->failed = 1;
+            return 0;
+        }
+        w->buf = buf;
+        w->cap = cap;
+    }
+    memset(w->buf + w->len, 0, off - w->len);
+    if (size)
+        memcpy(w->buf + off, data, size);
+    w->len = off + size;
+    return off;
+}
+
+static BundleArray bundle_put_array(BundleWriter *w, const void *data, uint32_t count, uint32_t cap, size_t elem) {
+    BundleArray a = { 0, count, cap };
+    a.off = bundle_put(w, data, (size_t)cap * elem);
+    return a;
+}
+
+// 把字符串追加到字符串区，返回偏移；字符串区放在单独的缓冲区中，最后整体写入
+static uint32_t bundle_put_text(BundleWriter *text, const char *s) {
+    if (!s)
+        return RULE_BUNDLE_NONE;
+    size_t len = strlen(s) + 1;
+    uint32_t off = (uint32_t)text->len;
+    if (text->len + len > text->cap) {
+        size_t cap = text->cap ? text->cap : 4096;
+        while (cap < text->len + len)
+            cap *= 2;
+        char *buf = realloc(text->buf, cap);
+        if (!buf) {
+            text->failed = 1;
+            return RULE_BUNDLE_NONE;
+        }
+        text->buf = buf;
+        text->cap = cap;
+    }
+    memcpy(text->buf + text->len, s, len);
+    text->len += len;
+    return off;
+}
+
+static void bundle_source(BundleSource *src, const struct stat *st) {
+    src->dev = st->st_dev;
+    src->ino = st->st_ino;
+    src->size = (uint64_t)st->st_size;
+    src->mtime_sec = st->st_mtim.tv_sec;
+    src->mtime_nsec = st->st_mtim.tv_nsec;
+}
+
+// 序列化编译后的规则，成功返回 0
+static int bundle_write(const CleanRules *r, const struct stat snap[3], const char *path) {
+    BundleWriter w = { 0 }, text = { 0 };
+    BundleHeader h = { 0 };
+    uint32_t *offsets = NULL, offset_count = 0, offset_cap = 0;
+    h.magic = RULE_BUNDLE_MAGIC;
+    h.version = RULE_BUNDLE_VERSION;
+    h.layout = RULE_BUNDLE_LAYOUT;
+    h.path_map = r->path_map;
+    for (int i = 0; i < 3; i++)
+        bundle_source(&h.sources[i], &snap[i]);
+    bundle_put(&w, &h, sizeof(h));
+
+    const Whitelist *wl = &r->whitelist;
+    h.wl_nodes = bundle_put_array(&w, wl->nodes, wl->node_count, wl->node_count, sizeof(WlNode));
+    h.wl_edges = bundle_put_array(&w, wl->edges, wl->edge_count, wl->edge_cap, sizeof(WlEdge));
+    h.wl_strings = bundle_put_array(&w, wl->strings, wl->str_len, wl->str_len, 1);
+
+    for (int k = 0; k < 2; k++) {
+        const Blacklist *bl = k ? &r->blacklist2 : &r->blacklist1;
+        BundleGroup *groups = calloc(bl->group_count ? bl->group_count : 1, sizeof(BundleGroup));
+        uint32_t *lines = malloc(sizeof(uint32_t) * (r->line_count[k] ? r->line_count[k] : 1));
+        if (!groups || !lines) {
+            free(groups);
+            free(lines);
+            w.failed = 1;
+            break;
+        }
+        for (uint32_t i = 0; i < bl->group_count; i++) {
+            const RuleGroup *g = &bl->groups[i];
+            const NameSet *ns = &g->names;
+            BundleGroup *bg = &groups[i];
+            bg->root = bundle_put_text(&text, g->root);
+            bg->middle = offset_count;
+            bg->middle_count = g->middle_count;
+            for (int m = 0; m < g->middle_count; m++) {
+                if (!grow_array((void **)&offsets, &offset_cap, sizeof(uint32_t), offset_count + 1)) {
+                    w.failed = 1;
+                    break;
+                }
+                offsets[offset_count++] = bundle_put_text(&text, g->middle[m]);
+            }
+            bg->mode = g->mode;
+            bg->literal_only = g->literal_only;
+            bg->any_rule = ns->any_rule;
+            bg->quota = g->quota;
+            bg->literals = bundle_put_array(&w, ns->literals, ns->lit_count, ns->lit_cap, sizeof(NameLiteral));
+            bg->prefix = bundle_put_array(&w, ns->prefix, ns->prefix_count, ns->prefix_count, sizeof(CharNode));
+            bg->suffix = bundle_put_array(&w, ns->suffix, ns->suffix_count, ns->suffix_count, sizeof(CharNode));
+            bg->globs = bundle_put_array(&w, ns->globs, ns->glob_count, ns->glob_count, sizeof(NameGlob));
+            bg->strings = bundle_put_array(&w, ns->strings, ns->str_len, ns->str_len, 1);
+        }
+        for (int i = 0; i < r->line_count[k]; i++)
+            lines[i] = bundle_put_text(&text, r->lines[k][i]);
+        h.groups[k] = bundle_put_array(&w, groups, bl->group_count, bl->group_count, sizeof(BundleGroup));
+        h.rule_count[k] = bl->rule_count;
+        h.lines[k] = bundle_put_array(&w, lines, (uint32_t)r->line_count[k], (uint32_t)r->line_count[k], sizeof(uint32_t));
+        free(groups);
+        free(lines);
+    }
+    h.offsets = bundle_put_array(&w, offsets, offset_count, offset_count, sizeof(uint32_t));
+    // 字符串区以 '\0' 结尾，加载时据此保证任何偏移处的字符串都不会越界
+    bundle_put_text(&text, "");
+    h.text = bundle_put_array(&w, text.buf, (uint32_t)text.len, (uint32_t)text.len, 1);
+    h.size = w.len;
+    free(offsets);
+    free(text.buf);
+    if (w.failed || text.failed || text.len >= RULE_BUNDLE_NONE) {
+        free(w.buf);
+        return -1;
+    }
+    memcpy(w.buf, &h, sizeof(h));
+
+    // 先写临时文件再改名，运行中的实例不会映射到写了一半的规则包
+    char tmp[PATH_MAX];
+    snprintf(tmp, sizeof(tmp), "%s.tmp", path);
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    int ok = fd >= 0;
+    for (size_t done = 0; ok && done < w.len;) {
+        ssize_t n = write(fd, w.buf + done, w.len - done);
+        if (n <= 0)
+            ok = 0;
+        else
+            done += (size_t)n;
+    }
+    if (fd >= 0 && close(fd) != 0)
+        ok = 0;
+    free(w.buf);
+    if (!ok || rename(tmp, path) != 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// 取映射区中的数组，越界时返回 NULL；空数组返回 NULL 且视为有效
+static void *bundle_array(const char *map, uint64_t size, const BundleArray *a, size_t elem, int *bad) {
+    if (!a->cap)
+        return NULL;
+    if (a->off > size || (uint64_t)a->cap * elem > size - a->off || a->count > a->cap || (a->off & 7)) {
+        *bad = 1;
+        return NULL;
+    }
+    return (void *)(map + a->off);
+}
+
+static const char *bundle_text(const char *text, uint32_t text_len, uint32_t off, int *bad) {
+    if (off == RULE_BUNDLE_NONE)
+        return NULL;
+    if (off >= text_len) {
+        *bad = 1;
+        return NULL;
+    }
+    return text + off;
+}
+
+// 由映射区重建一个黑名单；规则组与中间模式指针数组在堆上，其余指向映射区
+static void bundle_load_blacklist(Blacklist *bl, const char *map, const BundleHeader *h, int k,
+    const char *text, const uint32_t *offsets, int *bad) {
+    const BundleGroup *groups = bundle_array(map, h->size, &h->groups[k], sizeof(BundleGroup), bad);
+    memset(bl, 0, sizeof(*bl));
+    bl->rule_count = h->rule_count[k];
+    if (*bad || !h->groups[k].count)
+        return;
+    if (!(bl->groups = calloc(h->groups[k].count, sizeof(RuleGroup)))) {
+        *bad = 1;
+        return;
+    }
+    bl->group_count = bl->group_cap = h->groups[k].count;
+    for (uint32_t i = 0; i < bl->group_count && !*bad; i++) {
+        const BundleGroup *bg = &groups[i];
+        RuleGroup *g = &bl->groups[i];
+        NameSet *ns = &g->names;
+        nameset_init(ns);
+        g->root = (char *)bundle_text(text, h->text.count, bg->root, bad);
+        g->mode = bg->mode;
+        g->literal_only = bg->literal_only;
+        g->quota = bg->quota;
+        if (bg->middle_count < 0 || bg->middle > h->offsets.count ||
+            (uint32_t)bg->middle_count > h->offsets.count - bg->middle) {
+            *bad = 1;
+            break;
+        }
+        if (bg->middle_count && !(g->middle = malloc(sizeof(char *) * bg->middle_count))) {
+            *bad = 1;
+            break;
+        }
+        g->middle_count = bg->middle_count;
+        for (int m = 0; m < bg->middle_count; m++)
+            g->middle[m] = (char *)bundle_text(text, h->text.count, offsets[bg->middle + m], bad);
+        ns->any_rule = bg->any_rule;
+        ns->literals = bundle_array(map, h->size, &bg->literals, sizeof(NameLiteral), bad);
+        ns->lit_count = bg->literals.count;
+        ns->lit_cap = bg->literals.cap;
+        ns->prefix = bundle_array(map, h->size, &bg->prefix, sizeof(CharNode), bad);
+        ns->prefix_count = bg->prefix.count;
+        ns->suffix = bundle_array(map, h->size, &bg->suffix, sizeof(CharNode), bad);
+        ns->suffix_count = bg->suffix.count;
+        ns->globs = bundle_array(map, h->size, &bg->globs, sizeof(NameGlob), bad);
+        ns->glob_count = bg->globs.count;
+        ns->strings = bundle_array(map, h->size, &bg->strings, 1, bad);
+        ns->str_len = bg->strings.count;
+        // 名称匹配器的字符串池同样须以 '\0' 结尾
+        if (!*bad && ns->str_len && ns->strings[ns->str_len - 1] != '\0')
+            *bad = 1;
+        if (!*bad)
+            nameset_finalize(ns);
+    }
+}
+
+// 释放由规则包加载的黑名单（只释放堆上的部分）
+static void bundle_free_blacklist(Blacklist *bl) {
+    for (uint32_t i = 0; i < bl->group_count; i++) {
+        free(bl->groups[i].middle);
+        if (bl->groups[i].names.glob_regex_valid)
+            regfree(&bl->groups[i].names.glob_regex);
+    }
+    free(bl->groups);
+    memset(bl, 0, sizeof(*bl));
+}
+
+static int bundle_source_matches(const BundleSource *src, const struct stat *st) {
+    return src->dev == (uint64_t)st->st_dev && src->ino == (uint64_t)st->st_ino &&
+        src->size == (uint64_t)st->st_size && src->mtime_sec == st->st_mtim.tv_sec &&
+        src->mtime_nsec == st->st_mtim.tv_nsec;
+}
+
+// 映射规则包，与规则文件快照及生效的路径映射一致时返回加载的规则，否则返回 NULL
+static CleanRules *bundle_load(const char *path, const struct stat snap[3], uint32_t path_map) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0)
+        return NULL;
+    struct stat st;
+    void *map = MAP_FAILED;
+    if (fstat(fd, &st) == 0 && (size_t)st.st_size >= sizeof(BundleHeader))
+        map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED)
+        return NULL;
+    const BundleHeader *h = map;
+    int bad = h->magic != RULE_BUNDLE_MAGIC || h->version != RULE_BUNDLE_VERSION ||
+        h->layout != RULE_BUNDLE_LAYOUT || h->size != (uint64_t)st.st_size || h->path_map != path_map;
+    for (int i = 0; i < 3 && !bad; i++)
+        bad = !bundle_source_matches(&h->sources[i], &snap[i]);
+    CleanRules *r = bad ? NULL : calloc(1, sizeof(CleanRules));
+    if (!r) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    r->map = map;
+    r->map_len = (size_t)st.st_size;
+    r->path_map = path_map;
+    const char *text = bundle_array(map, h->size, &h->text, 1, &bad);
+    const uint32_t *offsets = bundle_array(map, h->size, &h->offsets, sizeof(uint32_t), &bad);
+    if (!text || text[h->text.count - 1] != '\0')
+        bad = 1;
+
+    Whitelist *wl = &r->whitelist;
+    wl->nodes = bundle_array(map, h->size, &h->wl_nodes, sizeof(WlNode), &bad);
+    wl->node_count = wl->node_cap = h->wl_nodes.count;
+    wl->edges = bundle_array(map, h->size, &h->wl_edges, sizeof(WlEdge), &bad);
+    wl->edge_count = h->wl_edges.count;
+    wl->edge_cap = h->wl_edges.cap;
+    wl->strings = bundle_array(map, h->size, &h->wl_strings, 1, &bad);
+    wl->str_len = wl->str_cap = h->wl_strings.count;
+    if (wl->node_count <= WL_REL_ROOT || (wl->edge_cap & (wl->edge_cap - 1)) ||
+        !wl->str_len || wl->strings[wl->str_len - 1] != '\0')
+        bad = 1;
+
+    for (int k = 0; k < 2 && !bad; k++) {
+        bundle_load_blacklist(k ? &r->blacklist2 : &r->blacklist1, map, h, k, text, offsets, &bad);
+        const uint32_t *lines = bundle_array(map, h->size, &h->lines[k], sizeof(uint32_t), &bad);
+        if (bad || !h->lines[k].count)
+            continue;
+        if (!(r->lines[k] = malloc(sizeof(char *) * h->lines[k].count))) {
+            bad = 1;
+            break;
+        }
+        r->line_count[k] = (int)h->lines[k].count;
+        for (uint32_t i = 0; i < h->lines[k].count; i++)
+            r->lines[k][i] = (char *)bundle_text(text, h->text.count, lines[i], &bad);
+    }
+    if (bad || plan_compile(&r->plan, &r->blacklist1, &r->blacklist2) < 0) {
+        log_message(1, "规则包无效: %s，改为从规则文件编译\n", path);
+        rules_free(r);
+        return NULL;
+    }
+    return r;
+}
+
+static int compare_rule_ids(const void *a, const void *b) {
+    int32_t x = *(const int32_t *)a, y = *(const int32_t *)b;
+    return (x > y) - (x < y);
+}
+
+// 规则组内的规则条数（名称匹配器中出现的不同规则编号），first 为最小的编号
+static uint32_t group_rule_ids(const RuleGroup *g, int32_t *first) {
+    const NameSet *ns = &g->names;
+    uint32_t cap = ns->lit_cap + ns->prefix_count + ns->suffix_count + ns->glob_count + 1, n = 0;
+    int32_t *ids = malloc(cap * sizeof(int32_t));
+    *first = -1;
+    if (!ids)
+        return 0;
+    for (uint32_t i = 0; i < ns->lit_cap; i++)
+        if (ns->literals[i].rule >= 0)
+            ids[n++] = ns->literals[i].rule;
+    for (uint32_t i = 0; i < ns->prefix_count; i++)
+        if (ns->prefix[i].rule >= 0)
+            ids[n++] = ns->prefix[i].rule;
+    for (uint32_t i = 0; i < ns->suffix_count; i++)
+        if (ns->suffix[i].rule >= 0)
+            ids[n++] = ns->suffix[i].rule;
+    for (uint32_t i = 0; i < ns->glob_count; i++)
+        ids[n++] = ns->globs[i].rule;
+    if (ns->any_rule >= 0)
+        ids[n++] = ns->any_rule;
+    qsort(ids, n, sizeof(int32_t), compare_rule_ids);
+    uint32_t unique = 0;
+    for (uint32_t i = 0; i < n; i++)
+        if (!unique || ids[unique - 1] != ids[i])
+            ids[unique++] = ids[i];
+    if (unique)
+        *first = ids[0];
+    free(ids);
+    return unique;
+}
+
+// 为新编译的规则建立开销计数，替换上下文中的旧计数；内存不足时不剖析
+static void profile_build(CleanContext *ctx, CleanRules *r) {
+    free(ctx->profile);
+    ctx->profile = NULL;
+    ctx->profile_count = 0;
+    if (ctx->opt.profile_top <= 0)
+        return;
+    uint32_t count = 1 + r->blacklist1.group_count + r->blacklist2.group_count;
+    RuleProfile *rows = calloc(count, sizeof(RuleProfile));
+    if (!rows) {
+        log_message(1, "内存分配失败: profile\n");
+        return;
+    }
+    uint32_t n = 1;
+    for (int k = 0; k < 2; k++) {
+        Blacklist *bl = k ? &r->blacklist2 : &r->blacklist1;
+        for (uint32_t i = 0; i < bl->group_count; i++) {
+            RuleProfile *row = &rows[n++];
+            int32_t first;
+            row->list = k + 1;
+            row->rules = group_rule_ids(&bl->groups[i], &first);
+            row->rule = first >= 0 && first < r->line_count[k] && r->lines[k][first] ? r->lines[k][first] : bl->groups[i].root;
+            bl->groups[i].prof = row;
+        }
+    }
+    ctx->profile = rows;
+    ctx->profile_count = count;
+}
+
+void clean_options_init(CleanOptions *opt) {
+    memset(opt, 0, sizeof(*opt));
+    opt->debug_level = 1;
+    opt->threads = 1;
+    opt->backend = CLEAN_BACKEND_SYNC;
+    opt->wake_fd = -1;
+}
+
+CleanContext *clean_create(const CleanOptions *opt) {
+    CleanContext *ctx = calloc(1, sizeof(CleanContext));
+    if (!ctx)
+        return NULL;
+    ctx->opt = *opt;
+    if (opt->stats_path && opt->stats_path[0]) {
+        if (!(ctx->stats_file = strdup(opt->stats_path))) {
+            free(ctx);
+            return NULL;
+        }
+    }
+    // 释放空间写入统计记录、剖析结果，并通过 cycle 回调交给调用方（控制命令的回复），都不需要时不取块数
+    if (ctx->stats_file || opt->profile_top > 0 || opt->cycle)
+        ctx->stats_stat_mask = STATX_BLOCKS;
+    ctx->opt.stats_path = ctx->stats_file;
+    if (opt->rule_bundle && opt->rule_bundle[0] && !(ctx->bundle_file = strdup(opt->rule_bundle))) {
+        free(ctx->stats_file);
+        free(ctx);
+        return NULL;
+    }
+    ctx->opt.rule_bundle = ctx->bundle_file;
+    // 路径映射只在提供了挂载表时使用；映射为空时不必每次读取挂载表
+    if (opt->mountinfo_path && opt->mountinfo_path[0] && opt->path_map && opt->path_map[0] &&
+        (!(ctx->mountinfo_file = strdup(opt->mountinfo_path)) || path_map_parse(&ctx->path_map, opt->path_map) < 0)) {
+        free(ctx->mountinfo_file);
+        free(ctx->bundle_file);
+        free(ctx->stats_file);
+        free(ctx);
+        return NULL;
+    }
+    ctx->opt.mountinfo_path = ctx->mountinfo_file;
+    ctx->opt.path_map = NULL;
+    ctx->io_backend = opt->backend;
+    pthread_mutex_init(&ctx->deadline_lock, NULL);
+
+    CleanContext *prev = engine_bind(ctx);
+    throttle_init(&ctx->throttle, opt);
+    trash_init(&ctx->trash, opt);
+    ctx->opt.psi_path = ctx->throttle.psi_path;
+    // 工作线程与 io_uring 的内核工作线程继承创建者的 I/O 优先级，须在启动线程池之前设置
+    if (opt->io_idle && syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, IOPRIO_IDLE) != 0)
+        log_message(1, "无法设置 idle I/O 优先级: %s\n", strerror(errno));
+    // 运行时探测 io_uring，不可用时退回同步调用
+    if (ctx->io_backend == CLEAN_BACKEND_URING && !uring_probe()) {
+        ctx->io_backend = CLEAN_BACKEND_SYNC;
+        log_message(1, "内核不支持 io_uring 批量删除，使用同步后端\n");
+    }
+    log_message(2, "I/O 后端: %s\n", ctx->io_backend == CLEAN_BACKEND_URING ? "io_uring" : "同步");
+    if (opt->threads > 1 && !pool_start(opt->threads))
+        log_message(1, "无法启动工作线程，使用单线程运行\n");
+    // 缓存不可用（如已被其他进程占用）时照常完整扫描
+    if (opt->scan_cache_path && opt->scan_cache_path[0])
+        ctx->scan_cache = scan_cache_open(opt->scan_cache_path);
+    ctx->opt.scan_cache_path = NULL;
+    engine_bind(prev);
+    return ctx;
+}
+
+void clean_destroy(CleanContext *ctx) {
+    if (!ctx)
+        return;
+    CleanContext *prev = engine_bind(ctx);
+    pool_stop();
+    trash_free(&ctx->trash);
+    uring_release();
+    order_release();
+    watch_free(ctx->watch);
+    rules_free(ctx->rules);
+    scan_cache_close(ctx->scan_cache);
+    deadline_clear(ctx);
+    free(ctx->deadlines);
+    pthread_mutex_destroy(&ctx->deadline_lock);
+    throttle_free(&ctx->throttle);
+    free(ctx->profile);
+    for (int i = 0; i < 3; i++)
+        free(ctx->rule_files[i]);
+    free(ctx->stats_file);
+    free(ctx->bundle_file);
+    free(ctx->mountinfo_file);
+    path_map_free(&ctx->path_map);
+    engine_bind(prev == ctx ? NULL : prev);
+    free(ctx);
+}
+
+int clean_compile_rules(CleanContext *ctx, const char *blacklist1, const char *blacklist2, const char *whitelist) {
+    CleanContext *prev = engine_bind(ctx);
+    int64_t start = monotonic_ms();
+    const char *files[3] = { blacklist1, blacklist2, whitelist };
+    char *copies[3] = { NULL, NULL, NULL };
+    CleanRules *r = calloc(1, sizeof(CleanRules));
+    int ok = r != NULL;
+    for (int i = 0; i < 3 && ok; i++)
+        ok = !files[i] || (copies[i] = strdup(files[i]));
+    if (!ok) {
+        log_message(1, "内存分配失败: rules\n");
+        for (int i = 0; i < 3; i++)
+            free(copies[i]);
+        free(r);
+        engine_bind(prev);
+        return -1;
+    }
+    // 先记录快照再读取，读取期间发生的修改会在下次检查时发现
+    struct stat snap[3];
+    rule_files_snapshot(copies, 3, snap);
+
+    // 每次编译都重新确认映射前缀是否位于 FUSE 上，开机时规则可能早于 FUSE 挂载编译
+    uint32_t path_map = ctx->mountinfo_file ? path_map_detect(&ctx->path_map, ctx->mountinfo_file) : 0;
+
+    // 规则包与规则文件一致时直接映射，省去逐行读取与编译
+    CleanRules *mapped = ctx->bundle_file ? bundle_load(ctx->bundle_file, snap, path_map) : NULL;
+    int failed = 0;
+    if (mapped) {
+        free(r);
+        r = mapped;
+        r->load_ms = monotonic_ms() - start;
+        log_message(2, "使用规则包 %s，耗时 %lld 毫秒\n", ctx->bundle_file, (long long)r->load_ms);
+    } else {
+        char **wl_lines = NULL;
+        int bl1_count = blacklist1 ? read_file_to_array(blacklist1, &r->lines[0]) : 0;
+        int bl2_count = blacklist2 ? read_file_to_array(blacklist2, &r->lines[1]) : 0;
+        int wl_count = whitelist ? read_file_to_array(whitelist, &wl_lines) : 0;
+        failed = bl1_count < 0 || bl2_count < 0 || wl_count < 0;
+        r->line_count[0] = bl1_count > 0 ? bl1_count : 0;
+        r->line_count[1] = bl2_count > 0 ? bl2_count : 0;
+        wl_count = wl_count > 0 ? wl_count : 0;
+        r->path_map = path_map;
+
+        // 规则每次加载后编译为白名单前缀树、黑名单规则组与遍历计划；黑名单原始行保留，供按规则单独执行。
+        // 编译使用按路径映射改写后的规则
+        char **wl_mapped = path_map_lines(&ctx->path_map, wl_lines, wl_count);
+        char **bl1_mapped = path_map_lines(&ctx->path_map, r->lines[0], r->line_count[0]);
+        char **bl2_mapped = path_map_lines(&ctx->path_map, r->lines[1], r->line_count[1]);
+        if ((wl_count && !wl_mapped) || (r->line_count[0] && !bl1_mapped) || (r->line_count[1] && !bl2_mapped) ||
+            whitelist_compile(wl_mapped, wl_count, &r->whitelist) < 0 ||
+            blacklist_compile(bl1_mapped, r->line_count[0], &r->blacklist1) < 0 ||
+            blacklist_compile(bl2_mapped, r->line_count[1], &r->blacklist2) < 0 ||
+            plan_compile(&r->plan, &r->blacklist1, &r->blacklist2) < 0) {
+            log_message(1, "内存分配失败: rules\n");
+            failed = 1;
+        }
+        path_map_lines_free(wl_mapped, wl_lines, wl_count);
+        path_map_lines_free(bl1_mapped, r->lines[0], r->line_count[0]);
+        path_map_lines_free(bl2_mapped, r->lines[1], r->line_count[1]);
+        free_array(wl_lines, wl_count);
+        r->load_ms = monotonic_ms() - start;
+        // 读取不完整的规则不写入规则包，下次仍从规则文件编译
+        if (!failed && ctx->bundle_file) {
+            if (bundle_write(r, snap, ctx->bundle_file) == 0)
+                log_message(2, "已写入规则包 %s\n", ctx->bundle_file);
+            else
+                log_message(1, "无法写入规则包 %s: %s\n", ctx->bundle_file, strerror(errno));
+        }
+    }
+
+    // 重新加载失败时保留正在使用的规则，首次加载则尽量使用已读取的部分
+    if (failed && ctx->rules) {
+        log_message(1, "规则加载失败，继续使用之前的规则\n");
+        rules_free(r);
+        for (int i = 0; i < 3; i++)
+            free(copies[i]);
+        engine_bind(prev);
+        return -1;
+    }
+
+    // 编译完成后才替换；监听集合引用旧规则组，随旧规则一起释放，下一轮完整扫描时重建
+    watch_free(ctx->watch);
+    ctx->watch = NULL;
+    deadline_clear(ctx);
+    rules_free(ctx->rules);
+    ctx->rules = r;
+    profile_build(ctx, r);
+    for (int i = 0; i < 3; i++) {
+        free(ctx->rule_files[i]);
+        ctx->rule_files[i] = copies[i];
+        ctx->rule_snap[i] = snap[i];
+    }
+    engine_bind(prev);
+    return 0;
+}
+
+int clean_write_rule_bundle(CleanContext *ctx, const char *path) {
+    if (!ctx->rules)
+        return -1;
+    CleanContext *prev = engine_bind(ctx);
+    int ret = bundle_write(ctx->rules, ctx->rule_snap, path);
+    engine_bind(prev);
+    return ret;
+}
+
+int clean_rules_changed(CleanContext *ctx) {
+    return !ctx->rules || rule_files_changed(ctx->rule_files, 3, ctx->rule_snap);
+}
+
+int clean_run_cycle(CleanContext *ctx, CleanStats *stats) {
+    CleanRules *r = ctx->rules;
+    if (!r)
+        return -1;
+    CleanContext *prev = engine_bind(ctx);
+    CleanStats st = { .mode = "full", .load_ms = r->load_ms };
+    r->load_ms = 0;
+    int64_t cycle_start = monotonic_ms();
+
+    // 监听模式下每次完整扫描重建监听集合，扫描过程中登记规则解析到的目录
+    if (ctx->opt.watch) {
+        watch_free(ctx->watch);
+        ctx->watch = watch_create();
+        ctx->watch_woken = 0;
+    }
+
+    // 到期调度目标每轮完整扫描重新登记
+    deadline_clear(ctx);
+    ctx->deadline_collect = 1;
+    int64_t walk_start = monotonic_ms();
+    process_plan(&r->plan, &r->whitelist);
+    st.walk_ms = monotonic_ms() - walk_start;
+    ctx->deadline_collect = 0;
+    deadline_finish(ctx);
+    st.duration_ms = st.load_ms + monotonic_ms() - cycle_start;
+    if (ctx->deadline_count)
+        log_message(2, "%u 个过期目标待到期处理，最早 %lld 秒后\n", ctx->deadline_count,
+            (long long)(deadline_due(ctx->deadlines[0]) - (int64_t)time(NULL)));
+    if (ctx->scan_cache) {
+        int skipped = atomic_exchange(&ctx->scan_cache->skipped, 0);
+        if (skipped)
+            log_message(2, "扫描状态缓存: 跳过 %d 个未变化的目录\n", skipped);
+    }
+
+    report_totals(&st);
+    if (stats)
+        *stats = st;
+    engine_bind(prev);
+    return 0;
+}
+
+int clean_watch(CleanContext *ctx, int interval) {
+    if (!ctx->watch || !ctx->rules)
+        return -1;
+    CleanContext *prev = engine_bind(ctx);
+    // 被唤醒后再次进入时不重复记录基础日志
+    log_message(ctx->watch_woken ? 2 : 1, "进入监听模式，已监听 %u 个目录，%d 秒后执行完整扫描\n",
+        ctx->watch->count, interval);
+    int ret = watch_wait(ctx->watch, &ctx->rules->whitelist, interval, ctx->opt.wake_fd);
+    ctx->watch_woken = ret == 1;
+    engine_bind(prev);
+    return ret;
+}
+
+int clean_run_rule(CleanContext *ctx, const char *rule, CleanStats *stats) {
+    CleanRules *r = ctx->rules;
+    if (!r)
+        return -1;
+    // 只执行规则文件中已有的规则：-2 规则沿用过期判断，白名单照常生效
+    int list = -1;
+    char **line = NULL;
+    for (int k = 0; k < 2 && list < 0; k++) {
+        for (int i = 0; i < r->line_count[k]; i++) {
+            if (r->lines[k][i] && strcmp(r->lines[k][i], rule) == 0) {
+                list = k;
+                line = &r->lines[k][i];
+                break;
+            }
+        }
+    }
+    if (list < 0)
+        return -1;
+
+    CleanContext *prev = engine_bind(ctx);
+    CleanStats st = { .mode = "rule" };
+    int64_t start = monotonic_ms();
+    Blacklist bl;
+    Plan plan;
+    // 与完整扫描相同，按编译规则时生效的路径映射改写
+    char **mapped = path_map_lines(&ctx->path_map, line, 1);
+    int compiled = mapped ? blacklist_compile(mapped, 1, &bl) : -1;
+    path_map_lines_free(mapped, line, 1);
+    if (compiled < 0) {
+        log_message(1, "内存分配失败: rule\n");
+        engine_bind(prev);
+        return -1;
+    }
+    if (plan_compile(&plan, list == 0 ? &bl : NULL, list == 1 ? &bl : NULL) < 0) {
+        log_message(1, "内存分配失败: rule\n");
+        blacklist_free(&bl);
+        engine_bind(prev);
+        return -1;
+    }
+    log_message(1, "执行单条规则: %s\n", rule);
+    // 临时规则组随本次执行释放，不能登记到监听集合中
+    WatchSet *ws = ctx->watch;
+    ctx->watch = NULL;
+    st.load_ms = monotonic_ms() - start;
+    int64_t walk_start = monotonic_ms();
+    process_plan(&plan, &r->whitelist);
+    st.walk_ms = monotonic_ms() - walk_start;
+    st.duration_ms = monotonic_ms() - start;
+    ctx->watch = ws;
+    plan_free(&plan);
+    blacklist_free(&bl);
+
+    report_totals(&st);
+    if (stats)
+        *stats = st;
+    engine_bind(prev);
+    return 0;
+}
+
+// 重新处理一个到期的目标：与完整扫描相同地按白名单、过期规则删除，未过期文件计入 root
+static void deadline_run_root(DeadlineRoot *root, const Whitelist *wl) {
+    char path[PATH_MAX], parent[PATH_MAX];
+    snprintf(path, sizeof(path), "%s", root->path);
+    size_t len = strlen(path);
+    WlState state;
+    int days = engine->opt.days;
+    ProfileScope prof_prev = profile_switch(profile_row(root->prof), 1);
+    walk_root = root;
+    if (root->filter) {
+        int fd;
+        if (!(whitelist_state_init(wl, path, &state) & WL_PROTECTED) && (fd = open_base_dir(path)) >= 0) {
+            delete_directory_at(fd, ".", path, len, wl, state.count ? &state : NULL, root->filter, 1, days, 1);
+            close(fd);
+        }
+    } else {
+        // 目标按名称相对父目录处理；相对路径规则的顶层目标以当前目录为父目录
+        const char *slash = strrchr(path, '/');
+        const char *name = slash ? slash + 1 : path;
+        if (!slash)
+            snprintf(parent, sizeof(parent), ".");
+        else
+            snprintf(parent, sizeof(parent), "%.*s", slash == path ? 1 : (int)(slash - path), path);
+        int fd;
+        if (*name && (fd = open_base_dir(parent)) >= 0) {
+            whitelist_state_init(wl, slash ? parent : "", &state);
+            DirEntry entry = { .name = name, .type = DT_UNKNOWN };
+            delete_target_at(fd, &entry, path, len, wl, state.count ? &state : NULL, 1, days);
+            file_batch_flush();
+            close(fd);
+        }
+    }
+    walk_root = NULL;
+    profile_switch(prof_prev, 1);
+}
+
+int clean_run_due(CleanContext *ctx, CleanStats *stats) {
+    CleanRules *r = ctx->rules;
+    int64_t now = (int64_t)time(NULL);
+    if (!r || !ctx->deadline_count || deadline_due(ctx->deadlines[0]) > now)
+        return 0;
+    CleanContext *prev = engine_bind(ctx);
+    CleanStats st = { .mode = "due" };
+    int64_t start = monotonic_ms();
+    // 先取出全部到期目标，处理完成（含多线程任务）后再按新的到期时间放回
+    DeadlineRoot **due = malloc(ctx->deadline_count * sizeof(DeadlineRoot *));
+    if (!due) {
+        log_message(1, "内存分配失败: deadlines\n");
+        engine_bind(prev);
+        return -1;
+    }
+    uint32_t n = 0;
+    while (ctx->deadline_count && deadline_due(ctx->deadlines[0]) <= now)
+        due[n++] = deadline_pop(ctx);
+    log_message(1, "处理 %u 个到期的过期目标\n", n);
+    for (uint32_t i = 0; i < n; i++) {
+        atomic_store(&due[i]->due, INT64_MAX);
+        deadline_run_root(due[i], &r->whitelist);
+    }
+    pool_wait();
+    for (uint32_t i = 0; i < n; i++) {
+        if (deadline_due(due[i]) != INT64_MAX)
+            deadline_push(ctx, due[i]);
+        else
+            free(due[i]);
+    }
+    free(due);
+    st.walk_ms = st.duration_ms = monotonic_ms() - start;
+    report_totals(&st);
+    if (stats)
+        *stats = st;
+    engine_bind(prev);
+    return (int)n;
+}
+
+time_t clean_next_deadline(CleanContext *ctx) {
+    return ctx->deadline_count ? (time_t)deadline_due(ctx->deadlines[0]) : 0;
+}
+
+void clean_rule_counts(CleanContext *ctx, int *blacklist1, int *blacklist2) {
+    CleanRules *r = ctx->rules;
+    *blacklist1 = r ? r->blacklist1.rule_count : 0;
+    *blacklist2 = r ? r->blacklist2.rule_count : 0;
+}
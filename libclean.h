@@ -0,0 +1,138 @@
+#ifndef LIBCLEAN_H
+#define LIBCLEAN_H
+
+/*
+   清理引擎接口：规则编译、遍历与删除的全部状态保存在 CleanContext 中，
+   一个进程内可以同时存在多个上下文（各自的规则、线程池、监听集合与统计）。
+   典型用法:
+       CleanOptions opt;
+       clean_options_init(&opt);
+       CleanContext *ctx = clean_create(&opt);
+       clean_compile_rules(ctx, "blacklist1.txt", NULL, "whitelist.txt");
+       clean_run_cycle(ctx, &stats);
+       clean_destroy(ctx);
+   规则编译后常驻内存，只有规则文件变化（clean_rules_changed）时才需要重新编译。
+   日志默认写入 clean_log_open 打开的异步日志文件（进程内共享），设置 log 回调后改由回调接收
+*/
+
+#include <stdint.h>
+#include <time.h>
+
+typedef struct CleanContext CleanContext;
+
+enum {
+    CLEAN_BACKEND_SYNC,     // 逐个阻塞调用
+    CLEAN_BACKEND_URING     // io_uring 批量提交，内核不支持时自动回退
+};
+
+// 一轮处理的统计；mode 为 "full"（完整扫描）、"watch"（监听模式的增量批次）、"rule"（单条规则）或 "due"（到期目标）
+typedef struct {
+    const char *mode;
+    time_t ts;
+    int files;
+    int dirs;
+    long long bytes;        // 删除文件占用的块数 × 512；移入回收目录的内容不计入，未设置 stats_path、profile_top 与 cycle 时为 0
+    long long scanned;
+    int64_t duration_ms;
+    int64_t load_ms;        // 读取并编译规则
+    int64_t walk_ms;        // 按合并后的 -1 与 -2 规则遍历并删除
+    int64_t watch_ms;       // 监听模式下处理变更目录
+} CleanStats;
+
+/*
+   回调均可能在工作线程中并发调用（threads > 1 时），实现需自行保证线程安全。
+   decide: 即将删除 path 时调用（过期规则在判断过期之后），返回 0 保留该条目
+   visit:  每个删除结果，err 为 0 表示成功，否则为 errno
+   log:    接收已格式化的日志消息，替代日志文件
+   cycle:  每轮处理（含监听模式的增量批次）结束时调用
+*/
+typedef int (*clean_decide_fn)(void *user, const char *path, int is_dir);
+typedef void (*clean_visit_fn)(void *user, const char *path, int is_dir, int err);
+typedef void (*clean_log_fn)(void *user, int level, const char *msg);
+typedef void (*clean_cycle_fn)(void *user, const CleanStats *stats);
+
+typedef struct {
+    int debug_level;            // 0=无日志, 1=基础日志, 2=详细日志
+    int days;                   // -2 规则的过期天数
+    int threads;                // 工作线程数，1 表示在调用线程中顺序处理
+    int backend;                // CLEAN_BACKEND_*
+    int watch;                  // 完整扫描时登记监听目录，供 clean_watch 使用
+    const char *stats_path;     // 每轮追加 JSON 统计记录的文件，NULL 或空串表示不写
+    int wake_fd;                // 可读时使 clean_watch 提前返回，-1 表示不使用（默认）
+    const char *scan_cache_path;    // -2 规则的扫描状态缓存文件（跳过未变化且没有过期文件的目录），NULL 或空串表示不使用
+    int max_rate;               // 每秒最多删除的条目数（unlinkat/rmdir），0 表示不设上限
+    const char *psi_path;       // I/O 压力文件（如 /proc/pressure/io），压力升高时降低删除速率；NULL 或空串表示不使用
+    int io_idle;                // 以 idle I/O 调度类运行（调用线程与之后创建的工作线程）
+    int trash;                  // 整体删除的目录先移入所在文件系统的回收目录，由后台线程删除（未设置 decide 时）
+    uint64_t trash_chunk;       // 后台删除大于该字节数的文件前分段截断，0 表示直接删除
+    const char *rule_bundle;    // 规则包：与规则文件一致时直接映射使用，否则编译后重写；NULL 或空串表示不使用
+    const char *mountinfo_path; // 挂载表（/proc/self/mountinfo 格式），用于确认 path_map 中的前缀位于 FUSE 上；NULL 或空串表示不改写规则
+    const char *path_map;       // 规则路径前缀映射 "前缀=下层路径,..."，前缀位于 FUSE 上时规则改写为下层路径后编译
+    int unlink_batch;           // 删除目录中的文件时每攒够这么多个按 inode 排序后再处理，0 或 1 表示按读取顺序
+    int profile_top;            // 按规则组统计开销，每轮结束时记录耗时最高的前 N 组（也写入统计记录）；0 表示不统计
+    clean_decide_fn decide;
+    clean_visit_fn visit;
+    clean_log_fn log;
+    clean_cycle_fn cycle;
+    void *user;                 // 原样传给各回调
+} CleanOptions;
+
+// 填入默认选项：日志级别 1、单线程、同步后端、不写统计文件、不限速
+void clean_options_init(CleanOptions *opt);
+
+// 创建上下文并按选项启动线程池、探测 io_uring；失败返回 NULL
+CleanContext *clean_create(const CleanOptions *opt);
+
+// 停止线程池，等待回收目录删除完毕，并释放上下文的全部资源
+void clean_destroy(CleanContext *ctx);
+
+/*
+   读取并编译规则文件，全部成功后才替换之前编译的规则；blacklist2 可为 NULL。成功返回 0。
+   已有规则时读取或编译失败返回 -1 并继续使用原规则
+*/
+int clean_compile_rules(CleanContext *ctx, const char *blacklist1, const char *blacklist2, const char *whitelist);
+
+/*
+   把当前编译的规则写入规则包 path（先写临时文件再改名），规则包记录各规则文件的 inode、大小与 mtime，
+   只在规则文件未变化时被 clean_compile_rules 采用。尚未编译规则或写入失败时返回 -1
+*/
+int clean_write_rule_bundle(CleanContext *ctx, const char *path);
+
+// 规则文件自上次编译后是否变化（尚未编译时返回 1）
+int clean_rules_changed(CleanContext *ctx);
+
+// 按已编译的规则执行一轮完整扫描，stats 可为 NULL。未编译规则时返回 -1
+int clean_run_cycle(CleanContext *ctx, CleanStats *stats);
+
+/*
+   监听模式：等待文件事件并只处理变更目录，需以 watch 选项创建上下文并先完成一轮完整扫描。
+   到达 interval 秒、事件队列溢出或规则文件变更时返回 0，由调用方执行下一轮完整扫描；
+   wake_fd 可读时返回 1（不读取 wake_fd），调用方处理后可再次调用继续监听。
+   没有可用的监听集合（未启用 watch 或创建失败）时立即返回 -1
+*/
+int clean_watch(CleanContext *ctx, int interval);
+
+// 只执行一条已编译的黑名单规则（与规则文件中的行完全相同），统计的 mode 为 "rule"。规则不存在时返回 -1
+int clean_run_rule(CleanContext *ctx, const char *rule, CleanStats *stats);
+
+/*
+   到期调度：完整扫描记录每个 -2 规则目标中未过期文件最早的到期时间。
+   clean_next_deadline 返回最早的到期时间（0 表示没有），clean_run_due 只重新处理已到期的目标，
+   统计的 mode 为 "due"，返回处理的目标数
+*/
+time_t clean_next_deadline(CleanContext *ctx);
+int clean_run_due(CleanContext *ctx, CleanStats *stats);
+
+// 当前已编译的 -1、-2 规则条数
+void clean_rule_counts(CleanContext *ctx, int *blacklist1, int *blacklist2);
+
+// 打开异步日志文件（超过上限时滚动为 <path>.old），未绑定上下文的日志按 debug_level 过滤；失败返回 -1
+int clean_log_open(const char *path, int debug_level);
+
+// 写出剩余日志并关闭日志文件
+void clean_log_close(void);
+
+// 记录日志：在引擎内部按当前上下文的级别与回调处理，否则写入日志文件
+void log_message(int level, const char *format, ...) __attribute__((format(printf, 2, 3)));
+
+#endif
@@ -54,47 +54,229 @@ export function parseLogContent(logContent) {
     // 将按时间戳存储的数据转换为数组
     return Object.values(dataByTimestamp);
 }
+const DAILY_KEY = 'dailyStats';
+const STATS_CURSOR_KEY = 'statsCursor';
+const LOG_CURSOR_KEY = 'logCursor';
+// 旧版本的存储：按时间戳的数组与只记录偏移的统计文件读取位置，首次读取时并入每日汇总
+const LEGACY_DATA_KEY = 'logData';
+const LEGACY_OFFSET_KEY = 'statsOffset';
+const KEEP_DAYS = 7;
+
+/**
+ * 将统计文件中的一条 JSON 记录转换为图表使用的数据格式
+ * @param {Object} record - 程序每轮写入的统计记录
+ * @returns {Object} - 与 parseLogContent 返回项相同结构的数据
+ */
+function statsRecordToEntry(record) {
+    return {
+        timestamp: record.time,
+        date: record.time.split(' ')[0],
+        deletedFiles: record.files,
+        deletedDirs: record.dirs,
+        dirtySegments: 0,
+        bytesFreed: record.bytes,
+        scanned: record.scanned,
+        durationMs: record.duration_ms,
+    };
+}
+
+/**
+ * 一次取得多个文件的 inode 与大小
+ * @param {Function} exec - 执行 shell 命令的函数
+ * @param {Array<string>} paths - 文件路径（不含空白字符）
+ * @returns {Promise<Object>} - 路径到 { ino, size } 的映射，不存在的文件没有对应项
+ */
+async function statFiles(exec, paths) {
+    const { stdout } = await exec(`stat -c '%n %i %s' ${paths.join(' ')} 2>/dev/null`);
+    const files = {};
+    stdout.split('\n').forEach(line => {
+        const [name, ino, size] = line.trim().split(' ');
+        if (name && size !== undefined) files[name] = { ino, size: parseInt(size, 10) };
+    });
+    return files;
+}
+
+/**
+ * 读取文件中 [start, end) 字节
+ */
+async function readRange(exec, path, start, end) {
+    const { errno, stdout, stderr } = await exec(`tail -c +${start + 1} ${path} | head -c ${end - start}`);
+    if (errno !== 0) throw new Error(`读取 ${path} 失败: ${stderr}`);
+    return stdout;
+}
+
+function loadCursor(key) {
+    try {
+        return JSON.parse(localStorage.getItem(key) || 'null');
+    } catch (e) {
+        return null;
+    }
+}
+
 /**
- * 更新 localStorage 中的数据
- * @param {Array} newData - 新解析的日志数据
+ * 增量读取程序追加写入、超过上限时重命名为 <文件>.old 的文件（run.log、stats.jsonl）。
+ * 读取位置按 (inode, 偏移) 记录：inode 变化说明文件已滚动，先读完 .old 中上次停下之后的内容
+ * 再从新文件开头读取；文件变小（被清空）时从头读取。只消费到最后一个换行符，未写完的行留到下次读取
+ * @param {Function} exec - 执行 shell 命令的函数
+ * @param {string} path - 文件路径
+ * @param {string} cursorKey - 保存读取位置的 localStorage 键
+ * @returns {Promise<string|null>} - 新增的完整行；文件不存在时返回 null
  */
-export function updateLocalStorage(newData) {
-    const storedData = JSON.parse(localStorage.getItem('logData') || '[]');
-
-    // 将新数据按时间戳合并到存储的数据中
-    newData.forEach(newEntry => {
-        const existingEntry = storedData.find(entry => entry.timestamp === newEntry.timestamp);
-        if (existingEntry) {
-            // 如果时间戳已存在，更新数值（避免重复累加）
-            existingEntry.deletedFiles = newEntry.deletedFiles;
-            existingEntry.deletedDirs = newEntry.deletedDirs;
-            existingEntry.dirtySegments = newEntry.dirtySegments;
-            // 移除 existingEntry.trimmedMB = newEntry.trimmedMB;
-        } else {
-            // 否则添加新数据
-            storedData.push(newEntry);
+async function readAppendedLines(exec, path, cursorKey) {
+    const oldPath = `${path}.old`;
+    const files = await statFiles(exec, [path, oldPath]);
+    const current = files[path];
+    if (!current) return null;
+
+    let cursor = loadCursor(cursorKey);
+    let text = '';
+    if (cursor && cursor.ino === null) {
+        // 旧版本迁移来的读取位置：沿用偏移，offset 为 -1 表示已有内容都已计入
+        cursor = { ino: current.ino, offset: cursor.offset < 0 ? current.size : cursor.offset };
+    } else if (cursor && cursor.ino !== current.ino) {
+        const old = files[oldPath];
+        if (old && old.ino === cursor.ino && old.size > cursor.offset) {
+            text = await readRange(exec, oldPath, cursor.offset, old.size);
+            if (!text.endsWith('\n')) text += '\n';
+        }
+        cursor = null;
+    }
+    if (!cursor || current.size < cursor.offset) cursor = { ino: current.ino, offset: 0 };
+
+    if (current.size > cursor.offset) {
+        const chunk = await readRange(exec, path, cursor.offset, current.size);
+        const end = chunk.lastIndexOf('\n');
+        if (end >= 0) {
+            const lines = chunk.slice(0, end + 1);
+            text += lines;
+            cursor.offset += new TextEncoder().encode(lines).length;
+        }
+    }
+    localStorage.setItem(cursorKey, JSON.stringify(cursor));
+    return text;
+}
+
+/**
+ * 增量读取统计文件，刷新开销只与新增周期数有关
+ * @param {Function} exec - 执行 shell 命令的函数
+ * @param {string} statsPath - 统计文件路径
+ * @returns {Promise<Array|null>} - 新增的数据；统计文件不存在（旧版本程序）时返回 null
+ */
+export async function readStatsIncremental(exec, statsPath) {
+    migrateLegacyData();
+    const text = await readAppendedLines(exec, statsPath, STATS_CURSOR_KEY);
+    if (text === null) return null;
+
+    const entries = [];
+    text.split('\n').forEach(line => {
+        if (!line) return;
+        try {
+            entries.push(statsRecordToEntry(JSON.parse(line)));
+        } catch (e) {
+            // 跳过损坏的行
         }
     });
+    return entries;
+}
 
-    // 只保留最近7天的数据
-    const cutoffDate = new Date();
-    cutoffDate.setDate(cutoffDate.getDate() - 6); // 保留7天内的数据
-    const filteredData = storedData.filter(entry => new Date(entry.date) >= cutoffDate);
+/**
+ * 增量读取日志文件（run.log 及其滚动出的 run.log.old），供不输出统计文件的旧版本程序使用
+ * @param {Function} exec - 执行 shell 命令的函数
+ * @param {string} logPath - 日志文件路径
+ * @returns {Promise<Array|null>} - 新增的数据；日志文件不存在时返回 null
+ */
+export async function readLogIncremental(exec, logPath) {
+    migrateLegacyData();
+    const text = await readAppendedLines(exec, logPath, LOG_CURSOR_KEY);
+    return text === null ? null : parseLogContent(text);
+}
+
+// 保留的最早日期（YYYY-MM-DD），含当天共 KEEP_DAYS 天
+function cutoffDate() {
+    const date = new Date();
+    date.setDate(date.getDate() - (KEEP_DAYS - 1));
+    const month = String(date.getMonth() + 1).padStart(2, '0');
+    const day = String(date.getDate()).padStart(2, '0');
+    return `${date.getFullYear()}-${month}-${day}`;
+}
 
-    localStorage.setItem('logData', JSON.stringify(filteredData));
+/**
+ * 按日期累加到每日汇总，只保留最近 KEEP_DAYS 天。每行只会被读取一次，因此直接相加；
+ * 存储的数据量只与天数有关，与历史记录条数无关
+ * @param {Object} daily - 日期到汇总数据的映射
+ * @param {Array} newData - 新增的数据
+ */
+function addToDaily(daily, newData) {
+    newData.forEach(entry => {
+        const day = daily[entry.date] || (daily[entry.date] = {
+            deletedFiles: 0,
+            deletedDirs: 0,
+            dirtySegments: 0,
+            bytesFreed: 0,
+        });
+        day.deletedFiles += entry.deletedFiles || 0;
+        day.deletedDirs += entry.deletedDirs || 0;
+        day.dirtySegments += entry.dirtySegments || 0;
+        day.bytesFreed += entry.bytesFreed || 0;
+    });
+    const cutoff = cutoffDate();
+    Object.keys(daily).forEach(date => {
+        if (date < cutoff) delete daily[date];
+    });
+}
+
+/**
+ * 把旧版本保存的按时间戳数组并入每日汇总。旧版本每次刷新都重新解析整个日志，
+ * 其中的内容视为已计入；统计文件沿用旧的读取偏移
+ */
+function migrateLegacyData() {
+    const legacy = localStorage.getItem(LEGACY_DATA_KEY);
+    if (legacy === null) return;
+    let entries = [];
+    try {
+        entries = JSON.parse(legacy);
+    } catch (e) {
+        // 损坏的旧数据直接丢弃
+    }
+    const daily = getDailyStats();
+    addToDaily(daily, entries);
+    localStorage.setItem(DAILY_KEY, JSON.stringify(daily));
+    const offset = localStorage.getItem(LEGACY_OFFSET_KEY);
+    if (offset !== null) {
+        localStorage.setItem(STATS_CURSOR_KEY, JSON.stringify({ ino: null, offset: parseInt(offset, 10) }));
+    }
+    localStorage.setItem(LOG_CURSOR_KEY, JSON.stringify({ ino: null, offset: -1 }));
+    localStorage.removeItem(LEGACY_DATA_KEY);
+    localStorage.removeItem(LEGACY_OFFSET_KEY);
+}
+
+/**
+ * 将新增数据并入每日汇总并保存
+ * @param {Array} newData - 新增的数据
+ */
+export function appendStoredData(newData) {
+    if (!newData.length) return;
+    const daily = getDailyStats();
+    addToDaily(daily, newData);
+    localStorage.setItem(DAILY_KEY, JSON.stringify(daily));
 }
 
 /**
- * 获取 localStorage 中存储的数据
- * @returns {Array} - 返回存储的日志数据
+ * 获取每日汇总，柱状图直接使用
+ * @returns {Object} - 日期（YYYY-MM-DD）到 { deletedFiles, deletedDirs, dirtySegments, bytesFreed } 的映射
  */
-export function getStoredData() {
-    return JSON.parse(localStorage.getItem('logData') || '[]');
+export function getDailyStats() {
+    try {
+        return JSON.parse(localStorage.getItem(DAILY_KEY) || '{}');
+    } catch (e) {
+        return {};
+    }
 }
 
 /**
- * 清除 localStorage 中的数据
+ * 清除已保存的数据与读取位置，下次刷新时从头读取
  */
 export function clearStoredData() {
-    localStorage.removeItem('logData');
+    [DAILY_KEY, STATS_CURSOR_KEY, LOG_CURSOR_KEY, LEGACY_DATA_KEY, LEGACY_OFFSET_KEY]
+        .forEach(key => localStorage.removeItem(key));
 }
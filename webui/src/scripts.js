@@ -1,5 +1,5 @@
 import { exec， spawn， toast } from 'kernelsu';
-import { parseLogContent， updateLocalStorage， getStoredData， clearStoredData } from './logParser.js';
+import { readStatsIncremental, readLogIncremental, appendStoredData, getDailyStats, clearStoredData } from './logParser.js';
 import { Ripple， initMDB } from 'mdb-ui-kit/js/mdb.es.min.js';
 import Chart from 'chart.js/auto';
 window。Ripple = Ripple;
@@ -207,45 +207,38 @@ document。addEventListener('DOMContentLoaded'， async () => {
         }
     }
 
-    // 加载日志文件
+    // 加载统计数据：优先增量读取 stats.jsonl，旧版本程序没有该文件时增量读取日志，只解析新增的行
     async function loadLogFile() {
         try {
-            const { errno， stdout， stderr } = await exec('cat /data/adb/modules/Clean-C/run.log');
-            if (errno === 0) {
-                const parsedData = parseLogContent(stdout);
-                updateLocalStorage(parsedData);
-                updateBarChart();
-            } else {
-                throw new 错误(`读取日志失败: ${stderr}`);
+            let newData = await readStatsIncremental(exec, '/data/adb/modules/Clean-C/stats.jsonl');
+            if (newData === null) {
+                newData = await readLogIncremental(exec, '/data/adb/modules/Clean-C/run.log');
+            }
+            if (newData === null) {
+                throw new Error('日志文件不存在');
             }
+            appendStoredData(newData);
+            updateBarChart();
         } catch (error) {
-            toast(`加载日志失败: ${error。message}`);
+            toast(`加载日志失败: ${error.message}`);
         }
     }
 
-    // 更新柱状图 (移除裁剪数据)
+    // 更新柱状图：直接使用预先汇总的每日数据
     function updateBarChart() {
-        const storedData = getStoredData();
-        const selectedDate = dateSelect。value;
-
-        const filteredData = selectedDate
-            ? storedData。filter(entry => entry。date === selectedDate)
-            : storedData;
+        const daily = getDailyStats();
+        const selectedDate = dateSelect.value;
 
+        const dates = selectedDate
+            ? (daily[selectedDate] ? [selectedDate] : [])
+            : Object.keys(daily).sort();
         const aggregatedData = {};
-        filteredData。forEach(entry => {
-            if (!aggregatedData[entry。date]) {
-                aggregatedData[entry。date] = {
-                    deletedFiles: 0，
-                    deletedDirs: 0，
-                    dirtySegments: isExt4 ? undefined : 0，
-                    // 移除 trimmedMB
-                };
-            }
-            aggregatedData[entry。date]。deletedFiles += entry。deletedFiles;
-            aggregatedData[entry。date]。deletedDirs += entry。deletedDirs;
-            if (!isExt4) aggregatedData[entry。date]。dirtySegments += entry。dirtySegments;
-            // 移除 trimmedMB 相关代码
+        dates.forEach(date => {
+            aggregatedData[date] = {
+                deletedFiles: daily[date].deletedFiles,
+                deletedDirs: daily[date].deletedDirs,
+                dirtySegments: isExt4 ? undefined : daily[date].dirtySegments,
+            };
         });
 
         barChart。data。datasets。forEach(dataset => {
@@ -253,7 +246,6 @@ document。addEventListener('DOMContentLoaded'， async () => {
         });
         barChart。update();
 
-        const dates = Object。keys(aggregatedData);
         const deletedFiles = dates。map(date => aggregatedData[date]。deletedFiles);
         const deletedDirs = dates。map(date => aggregatedData[date]。deletedDirs);
         const dirtySegments = dates。map(date => aggregatedData[date]。dirtySegments);